@@ -0,0 +1,289 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   bridge.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/11 16:40:12 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/11 16:40:12 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Channel fan-out to <users> members, first as one socket each, then as
+** virtual users behind a single bridge connection. In both runs one sender
+** writes <messages> PRIVMSGs to #bench and the run ends when every member
+** has every line; over the bridge a line tagged with several users counts
+** once for each. Reports deliveries per second, the bytes and the reads it
+** took on the receiving side and, given the server's pid, server CPU time
+** per delivery.
+**
+**   ./ircserv 6667 pw -class bridge,268435456,1048576,none -bridge matrix,secret,bridge
+**   ./bench/bridge 6667 pw matrix,secret <users> <messages> [server-pid]
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double serverCpu(const std::string &pid) {
+    std::ifstream stat(("/proc/" + pid + "/stat").c_str());
+    std::string line;
+    if (pid.empty() || !std::getline(stat, line))
+        return -1;
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14)
+            utime = strtoul(field.c_str(), NULL, 10);
+        if (i == 15)
+            stime = strtoul(field.c_str(), NULL, 10);
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int connectClient(int port, const std::string &registration) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    if (fd < 0)
+        return -1;
+    send(fd, registration.data(), registration.size(), 0);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/*
+** Counts deliveries in what a receiver reads: on a socket every PRIVMSG to
+** #bench is one, behind a bridge it is one per tag in front of the line.
+** End of NAMES replies are counted the same way to know when every member
+** has joined; other lines do not count. partial holds a line split across
+** reads.
+*/
+struct Receiver {
+    int fd;
+    bool tagged;
+    std::string partial;
+};
+
+struct Totals {
+    long deliveries;
+    long joined;
+    long bytes;
+    long reads;
+};
+
+/*
+** Returns the deliveries read, -1 once the connection closed.
+*/
+static long readReceiver(Receiver &receiver, Totals &totals) {
+    char buffer[65536];
+    long delivered = 0;
+    ssize_t n;
+
+    while ((n = recv(receiver.fd, buffer, sizeof(buffer), 0)) > 0) {
+        totals.bytes += n;
+        totals.reads++;
+        receiver.partial.append(buffer, n);
+        std::string::size_type start = 0;
+        std::string::size_type end;
+        while ((end = receiver.partial.find('\n', start)) != std::string::npos) {
+            std::string::size_type space = receiver.partial.find(' ', start);
+            long recipients = receiver.tagged
+                ? std::count(receiver.partial.begin() + start, receiver.partial.begin() + space, ',') + 1 : 1;
+            if (receiver.partial.find(" PRIVMSG #bench ", start) < end)
+                delivered += recipients;
+            else if (receiver.partial.find(" 366 ", start) < end)
+                totals.joined += recipients;
+            start = end + 1;
+        }
+        receiver.partial.erase(0, start);
+    }
+    if (n == 0)
+        return -1;
+    return delivered;
+}
+
+/*
+** Waits until every member has joined and the JOINs have stopped coming.
+** A server that went into overload mode on the burst of registrations
+** accepts no connections for a few seconds, hence the generous limit.
+*/
+static void drain(std::vector<Receiver> &receivers, int sender, long users) {
+    std::vector<struct pollfd> pfds(receivers.size());
+    Totals ignored;
+    char buffer[65536];
+    double start = now();
+    double quiet = start;
+
+    memset(&ignored, 0, sizeof(ignored));
+    for (size_t i = 0; i < receivers.size(); ++i) {
+        pfds[i].fd = receivers[i].fd;
+        pfds[i].events = POLLIN;
+    }
+    while ((ignored.joined < users || now() - quiet < 1.0) && now() - start < 60.0) {
+        if (poll(&pfds[0], pfds.size(), 100) > 0)
+            quiet = now();
+        for (size_t i = 0; i < receivers.size(); ++i)
+            readReceiver(receivers[i], ignored);
+        while (recv(sender, buffer, sizeof(buffer), 0) > 0)
+            ;
+    }
+}
+
+static bool run(const std::string &name, std::vector<Receiver> &receivers, int sender, long users,
+    long messages, const std::string &pid) {
+    std::vector<struct pollfd> pfds(receivers.size());
+    std::string payload(80, 'x');
+    std::string out;
+    char buffer[65536];
+    Totals totals;
+    long written = 0;
+    long expected = messages * users;
+
+    drain(receivers, sender, users);
+    memset(&totals, 0, sizeof(totals));
+    for (size_t i = 0; i < receivers.size(); ++i) {
+        pfds[i].fd = receivers[i].fd;
+        pfds[i].events = POLLIN;
+    }
+    double cpuBefore = serverCpu(pid);
+    double start = now();
+    double lastProgress = start;
+    while (totals.deliveries < expected && now() - lastProgress < 10.0) {
+        while (out.size() < 65536 && written < messages) {
+            std::ostringstream line;
+            line << "PRIVMSG #bench :" << written++ << " " << payload << "\r\n";
+            out += line.str();
+        }
+        if (!out.empty()) {
+            ssize_t sent = send(sender, out.data(), out.size(), MSG_NOSIGNAL);
+            if (sent > 0)
+                out.erase(0, sent);
+            else if (sent < 0 && errno != EAGAIN) {
+                std::cerr << "Error: sender disconnected" << std::endl;
+                return false;
+            }
+        }
+        while (recv(sender, buffer, sizeof(buffer), 0) > 0)
+            ;
+        if (poll(&pfds[0], pfds.size(), out.empty() ? 100 : 0) <= 0)
+            continue;
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (!pfds[i].revents)
+                continue;
+            long delivered = readReceiver(receivers[i], totals);
+            if (delivered < 0) {
+                std::cerr << "Error: receiver " << i << " disconnected" << std::endl;
+                return false;
+            }
+            totals.deliveries += delivered;
+            if (delivered)
+                lastProgress = now();
+        }
+    }
+    double elapsed = now() - start;
+    double cpuAfter = serverCpu(pid);
+
+    std::cout << name << std::endl;
+    std::cout << "  connections:          " << receivers.size() << std::endl;
+    std::cout << "  deliveries:           " << totals.deliveries << " / " << expected << std::endl;
+    std::cout << "  deliveries per sec:   " << (long)(totals.deliveries / elapsed) << std::endl;
+    std::cout << "  bytes per delivery:   " << (totals.deliveries ? totals.bytes / totals.deliveries : 0) << std::endl;
+    std::cout << "  reads:                " << totals.reads << std::endl;
+    if (cpuBefore >= 0 && cpuAfter >= 0 && totals.deliveries > 0)
+        std::cout << "  server ns/delivery:   " << (long)((cpuAfter - cpuBefore) * 1e9 / totals.deliveries) << std::endl;
+    return totals.deliveries == expected;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 6 && argc != 7) {
+        std::cerr << "Usage: ./bridge <port> <password> <bridge-name>,<bridge-password> <users> <messages> [server-pid]"
+            << std::endl;
+        return (1);
+    }
+    int port = atoi(argv[1]);
+    std::string password = argv[2];
+    std::string account = argv[3];
+    long users = atol(argv[4]);
+    long messages = atol(argv[5]);
+    std::string pid = argc == 7 ? argv[6] : "";
+    if (account.find(',') == std::string::npos || users <= 0) {
+        std::cerr << "Error: expected <bridge-name>,<bridge-password> and a positive user count" << std::endl;
+        return (1);
+    }
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    int sender = connectClient(port, "PASS " + password + "\r\nNICK sender\r\nUSER sender 0 * :bridge\r\nJOIN #bench\r\n");
+    if (sender < 0) {
+        std::cerr << "Error: sender connection failed" << std::endl;
+        return (1);
+    }
+
+    std::vector<Receiver> sockets;
+    for (long i = 0; i < users; ++i) {
+        std::ostringstream reg;
+        reg << "PASS " << password << "\r\nNICK s" << i << "\r\nUSER s" << i << " 0 * :socket\r\nJOIN #bench\r\n";
+        Receiver receiver = {connectClient(port, reg.str()), false, ""};
+        if (receiver.fd < 0) {
+            std::cerr << "Error: connection " << i << " failed" << std::endl;
+            return (1);
+        }
+        sockets.push_back(receiver);
+    }
+    bool complete = run("one socket per user", sockets, sender, users, messages, pid);
+    for (size_t i = 0; i < sockets.size(); ++i)
+        close(sockets[i].fd);
+
+    std::ostringstream reg;
+    reg << "PASS " << password << "\r\nBRIDGE " << account.substr(0, account.find(','))
+        << " " << account.substr(account.find(',') + 1) << "\r\n";
+    for (long i = 1; i <= users; ++i)
+        reg << i << " NICK b" << i << "\r\n" << i << " USER b" << i << " 0 * :bridged\r\n" << i << " JOIN #bench\r\n";
+    std::vector<Receiver> bridge;
+    Receiver receiver = {connectClient(port, reg.str()), true, ""};
+    if (receiver.fd < 0) {
+        std::cerr << "Error: bridge connection failed" << std::endl;
+        return (1);
+    }
+    bridge.push_back(receiver);
+    complete = run("one bridge", bridge, sender, users, messages, pid) && complete;
+    close(receiver.fd);
+    close(sender);
+    return (complete ? 0 : 1);
+}
@@ -0,0 +1,216 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   fanout.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/26 16:20:05 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/26 16:20:05 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Channel fan-out load: <receivers> clients join #bench, one sender writes
+** <messages> PRIVMSGs to it as fast as the server takes them, and the run
+** ends when every receiver has every line. Reports deliveries per second
+** and, given the server's pid, the server CPU time spent per delivery, so
+** the same run can be compared across -io backends. A "unix:/path" target
+** connects through a Unix domain listener instead of TCP loopback.
+**
+**   ./bench/fanout <port|unix:path> <password> <receivers> <messages> [server-pid]
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static double serverCpu(const std::string &pid) {
+    std::ifstream stat(("/proc/" + pid + "/stat").c_str());
+    std::string line;
+    if (pid.empty() || !std::getline(stat, line))
+        return -1;
+    std::istringstream fields(line.substr(line.rfind(')') + 2));
+    std::string field;
+    unsigned long utime = 0;
+    unsigned long stime = 0;
+    for (int i = 3; i <= 15 && fields >> field; ++i) {
+        if (i == 14)
+            utime = strtoul(field.c_str(), NULL, 10);
+        if (i == 15)
+            stime = strtoul(field.c_str(), NULL, 10);
+    }
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+static int connectClient(const std::string &target, const std::string &registration) {
+    int fd;
+
+    if (target.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, target.c_str() + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (fd < 0)
+        return -1;
+    send(fd, registration.data(), registration.size(), 0);
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    return fd;
+}
+
+/*
+** Reads everything available and returns the number of complete lines.
+*/
+static long countLines(int fd) {
+    char buffer[65536];
+    long lines = 0;
+    ssize_t n;
+
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        for (ssize_t i = 0; i < n; ++i)
+            if (buffer[i] == '\n')
+                lines++;
+    }
+    if (n == 0)
+        return -1;
+    return lines;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 5 && argc != 6) {
+        std::cerr << "Usage: ./fanout <port|unix:path> <password> <receivers> <messages> [server-pid]" << std::endl;
+        return (1);
+    }
+    std::string target = argv[1];
+    std::string password = argv[2];
+    int receivers = atoi(argv[3]);
+    long messages = atol(argv[4]);
+    std::string pid = argc == 6 ? argv[5] : "";
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    std::vector<struct pollfd> pfds;
+    for (int i = 0; i < receivers; ++i) {
+        std::ostringstream reg;
+        reg << "PASS " << password << "\r\nNICK r" << i << "\r\nUSER r" << i << " 0 * :fanout\r\nJOIN #bench\r\n";
+        int fd = connectClient(target, reg.str());
+        if (fd < 0) {
+            std::cerr << "Error: connection " << i << " failed" << std::endl;
+            return (1);
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        pfds.push_back(pfd);
+    }
+    int sender = connectClient(target, "PASS " + password + "\r\nNICK sender\r\nUSER sender 0 * :fanout\r\nJOIN #bench\r\n");
+    if (sender < 0) {
+        std::cerr << "Error: sender connection failed" << std::endl;
+        return (1);
+    }
+    double quiet = now();
+    while (now() - quiet < 1.0) {
+        if (poll(&pfds[0], pfds.size(), 100) > 0)
+            quiet = now();
+        for (size_t i = 0; i < pfds.size(); ++i)
+            countLines(pfds[i].fd);
+        countLines(sender);
+    }
+
+    std::string payload(80, 'x');
+    std::string out;
+    long written = 0;
+    long expected = messages * receivers;
+    long delivered = 0;
+    double cpuBefore = serverCpu(pid);
+    double start = now();
+    double lastProgress = start;
+    while (delivered < expected && now() - lastProgress < 10.0) {
+        while (out.size() < 65536 && written < messages) {
+            std::ostringstream line;
+            line << "PRIVMSG #bench :" << written++ << " " << payload << "\r\n";
+            out += line.str();
+        }
+        if (!out.empty()) {
+            ssize_t sent = send(sender, out.data(), out.size(), MSG_NOSIGNAL);
+            if (sent > 0)
+                out.erase(0, sent);
+            else if (sent < 0 && errno != EAGAIN) {
+                std::cerr << "Error: sender disconnected" << std::endl;
+                return (1);
+            }
+        }
+        countLines(sender);
+        if (poll(&pfds[0], pfds.size(), out.empty() ? 100 : 0) <= 0)
+            continue;
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (!pfds[i].revents)
+                continue;
+            long lines = countLines(pfds[i].fd);
+            if (lines < 0) {
+                std::cerr << "Error: receiver " << i << " disconnected" << std::endl;
+                return (1);
+            }
+            delivered += lines;
+            if (lines)
+                lastProgress = now();
+        }
+    }
+    double elapsed = now() - start;
+    double cpuAfter = serverCpu(pid);
+
+    std::cout << "receivers:            " << receivers << std::endl;
+    std::cout << "messages sent:        " << written << std::endl;
+    std::cout << "deliveries:           " << delivered << " / " << expected << std::endl;
+    std::cout << "elapsed:              " << elapsed << " s" << std::endl;
+    std::cout << "deliveries per sec:   " << (long)(delivered / elapsed) << std::endl;
+    if (cpuBefore >= 0 && cpuAfter >= 0 && delivered > 0) {
+        std::cout << "server CPU:           " << cpuAfter - cpuBefore << " s" << std::endl;
+        std::cout << "server ns/delivery:   " << (long)((cpuAfter - cpuBefore) * 1e9 / delivered) << std::endl;
+    }
+    for (size_t i = 0; i < pfds.size(); ++i)
+        close(pfds[i].fd);
+    close(sender);
+    return (delivered == expected ? 0 : 1);
+}
@@ -0,0 +1,108 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   idle_clients.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/21 11:37:50 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/21 11:37:50 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Opens <count> registered, idle connections to a running ircserv and reports
+** how much the server's resident memory grew per connection.
+**
+**   ./bench/idle_clients <port> <password> <count> <server-pid>
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../inc/Client.hpp"
+
+static long readRss(const std::string &pid) {
+    std::ifstream status(("/proc/" + pid + "/status").c_str());
+    std::string line;
+
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+            return atol(line.c_str() + 6) * 1024;
+    }
+    return -1;
+}
+
+static void drain(const std::vector<int> &fds) {
+    char buffer[4096];
+    for (size_t i = 0; i < fds.size(); ++i)
+        while (recv(fds[i], buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+            ;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 5) {
+        std::cerr << "Usage: ./idle_clients <port> <password> <count> <server-pid>" << std::endl;
+        return (1);
+    }
+    int port = atoi(argv[1]);
+    std::string password = argv[2];
+    int count = atoi(argv[3]);
+    std::string pid = argv[4];
+
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    long before = readRss(pid);
+    if (before < 0) {
+        std::cerr << "Error: cannot read /proc/" << pid << "/status" << std::endl;
+        return (1);
+    }
+    std::vector<int> fds;
+    for (int i = 0; i < count; ++i) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+            std::cerr << "Error: connection " << i << " failed" << std::endl;
+            if (fd >= 0)
+                close(fd);
+            break;
+        }
+        std::ostringstream reg;
+        reg << "PASS " << password << "\r\nNICK i" << i << "\r\nUSER u" << i << " 0 * :idle\r\n";
+        send(fd, reg.str().data(), reg.str().size(), 0);
+        fds.push_back(fd);
+        if (fds.size() % 256 == 0)
+            drain(fds);
+    }
+    sleep(1);
+    drain(fds);
+    sleep(1);
+    long after = readRss(pid);
+
+    std::cout << "connections:          " << fds.size() << std::endl;
+    std::cout << "sizeof(Client):       " << sizeof(Client) << " bytes" << std::endl;
+    std::cout << "server RSS before:    " << before << " bytes" << std::endl;
+    std::cout << "server RSS after:     " << after << " bytes" << std::endl;
+    if (!fds.empty())
+        std::cout << "bytes per idle conn:  " << (after - before) / (long)fds.size() << std::endl;
+    for (size_t i = 0; i < fds.size(); ++i)
+        close(fds[i]);
+    return (0);
+}
@@ -0,0 +1,140 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   numeric.cpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/09 11:17:50 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/09 11:17:50 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Cost of one numeric reply, from formatting to the bytes leaving the send
+** queue. "concat" builds the line with std::string operator+ and queues it
+** as its own SharedBuffer, the way replies used to be sent; "reply" writes
+** it with Reply::send(). Both queue the same 403 and 352 replies and flush
+** into a transport that discards the bytes every <batch> numerics. Global
+** operator new is counted, so the report shows heap allocations per
+** numeric next to the time.
+**
+**   ./bench/numeric [numerics] [batch]
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <new>
+#include <cerrno>
+#include <time.h>
+#include "../inc/Reply.hpp"
+
+static size_t allocations = 0;
+
+void *operator new(size_t size) throw(std::bad_alloc) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void *p) throw() {
+    free(p);
+}
+
+class NullTransport : public Transport {
+public:
+    const char *getName() const { return "null"; }
+    ssize_t receive(int, char *, size_t) { return -EAGAIN; }
+    ssize_t send(int, const struct iovec *iov, size_t count) {
+        ssize_t total = 0;
+        for (size_t i = 0; i < count; ++i)
+            total += iov[i].iov_len;
+        return total;
+    }
+    void release(int) {}
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const std::string server = "irc.local";
+static const std::string channel = "#benchmark";
+static const std::string user = "someuser";
+static const std::string host = "192.168.100.200";
+static const std::string realName = "A Realistic Real Name";
+
+static void concat(Client &client, size_t i) {
+    if (i % 2)
+        client.queue(SharedBuffer(":" + server + " 403 " + client.getNickName() + " " + channel
+            + " :No such channel\r\n"));
+    else
+        client.queue(SharedBuffer(":" + server + " 352 " + client.getNickName() + " " + channel + " " + user + " "
+            + host + " " + server + " " + client.getNickName() + " H@ :0 " + realName + "\r\n"));
+}
+
+static void reply(Client &client, size_t i) {
+    if (i % 2) {
+        ReplyArg name(channel);
+        const ReplyArg *args[] = {&name};
+        Reply::send(client, server, ERR_NOSUCHCHANNEL, args, 1);
+    } else {
+        ReplyArg where(channel);
+        ReplyArg userName(user);
+        ReplyArg address(host);
+        ReplyArg origin(server);
+        ReplyArg nick(client.getNick());
+        ReplyArg status("H@");
+        ReplyArg hops("0");
+        ReplyArg real(realName);
+        const ReplyArg *args[] = {&where, &userName, &address, &origin, &nick, &status, &hops, &real};
+        Reply::send(client, server, RPL_WHOREPLY, args, 8);
+    }
+}
+
+static void run(const char *name, void (*numeric)(Client &, size_t), size_t count, size_t batch) {
+    Client client(-1, "bench.host");
+    NullTransport transport;
+
+    client.setNickName("benchnick");
+    client.setConnClass(0, 1 << 30, 8192);
+    for (size_t i = 0; i < batch * 4; ++i) {
+        numeric(client, i);
+        if ((i + 1) % batch == 0)
+            client.flush(transport);
+    }
+    client.flush(transport);
+    size_t before = allocations;
+    double start = now();
+    for (size_t i = 0; i < count; ++i) {
+        numeric(client, i);
+        if ((i + 1) % batch == 0)
+            client.flush(transport);
+    }
+    client.flush(transport);
+    double elapsed = now() - start;
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed
+        << std::setprecision(1) << std::setw(10) << elapsed * 1e9 / count << " ns/numeric"
+        << std::setprecision(3) << std::setw(10) << static_cast<double>(allocations - before) / count
+        << " allocations/numeric" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t count = argc > 1 ? atol(argv[1]) : 2000000;
+    size_t batch = argc > 2 ? atol(argv[2]) : 64;
+
+    if (argc > 3 || count == 0 || batch == 0) {
+        std::cerr << "Usage: ./numeric [numerics] [batch]" << std::endl;
+        return (1);
+    }
+    std::cout << count << " numerics, flushed every " << batch << std::endl;
+    run("concat", concat, count, batch);
+    run("reply", reply, count, batch);
+    return (0);
+}
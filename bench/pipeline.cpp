@@ -0,0 +1,241 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   pipeline.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/08 10:02:48 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/08 10:02:48 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Runs the server's whole command pipeline in-process over a
+** MemoryTransport: no sockets, no poll, no scheduler between the driver and
+** the parser. <clients> clients register and join one of <channels>
+** channels, then every round each of them sends a fixed mix of channel and
+** private messages, PINGs, NOTICEs, WHO and a PART/JOIN. The server is
+** ticked until it has nothing left to do after every round, so a run is
+** fully deterministic: the digest of everything the clients received is the
+** same on every run and only changes when the server's output does.
+** Overload mode is switched off so timing cannot change the output either.
+**
+** With "websocket" the clients connect through a "ws:memory" listener: they
+** upgrade first, send every line as a masked frame and the digest is taken
+** over the lines unwrapped from the server's frames, so it must match the
+** digest of the plain run.
+**
+**   ./bench/pipeline [clients] [channels] [rounds] [plain|websocket]
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdlib>
+#include <cstdio>
+#include <time.h>
+#include "../inc/Server.hpp"
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+** FNV-1a over every byte received, in client order.
+*/
+static unsigned long long digest = 14695981039346656037ULL;
+static size_t linesReceived = 0;
+static bool websocket = false;
+static std::map<int, std::string> frames;
+
+static void hash(const char *data, size_t len) {
+    for (size_t j = 0; j < len; ++j) {
+        digest = (digest ^ static_cast<unsigned char>(data[j])) * 1099511628211ULL;
+        linesReceived += data[j] == '\n';
+    }
+}
+
+/*
+** Server frames are never masked and never longer than 65535 bytes here.
+** The upgrade response in front of the first one is skipped.
+*/
+static void unwrap(int fd, const std::string &data) {
+    std::string &in = frames[fd];
+    size_t at = 0;
+
+    in += data;
+    if (in.compare(0, 5, "HTTP/") == 0) {
+        std::string::size_type end = in.find("\r\n\r\n");
+        if (end == std::string::npos)
+            return;
+        at = end + 4;
+    }
+    while (in.size() - at >= 2) {
+        size_t len = static_cast<unsigned char>(in[at + 1]) & 0x7f;
+        size_t header = 2;
+        if (len == 126) {
+            if (in.size() - at < 4)
+                break;
+            len = (static_cast<unsigned char>(in[at + 2]) << 8) | static_cast<unsigned char>(in[at + 3]);
+            header = 4;
+        }
+        if (in.size() - at < header + len)
+            break;
+        if ((in[at] & 0x0f) <= 2) {
+            hash(in.data() + at + header, len);
+            hash("\r\n", 2);
+        }
+        at += header + len;
+    }
+    in.erase(0, at);
+}
+
+static void consume(MemoryTransport &transport, const std::vector<int> &fds) {
+    std::string data;
+
+    for (size_t i = 0; i < fds.size(); ++i) {
+        data.clear();
+        transport.read(fds[i], data);
+        if (websocket)
+            unwrap(fds[i], data);
+        else
+            hash(data.data(), data.size());
+    }
+}
+
+/*
+** One masked text frame per line; the key is fixed so runs stay identical.
+*/
+static void send(MemoryTransport &transport, int fd, const std::string &script) {
+    static const unsigned char key[4] = {0x12, 0x34, 0x56, 0x78};
+    std::string wire;
+    std::string::size_type start = 0;
+    std::string::size_type end;
+
+    if (!websocket) {
+        transport.write(fd, script);
+        return;
+    }
+    while ((end = script.find("\r\n", start)) != std::string::npos) {
+        size_t len = end - start;
+        wire += static_cast<char>(0x81);
+        if (len < 126)
+            wire += static_cast<char>(0x80 | len);
+        else {
+            wire += static_cast<char>(0x80 | 126);
+            wire += static_cast<char>(len >> 8);
+            wire += static_cast<char>(len & 0xff);
+        }
+        wire.append(reinterpret_cast<const char *>(key), 4);
+        for (size_t i = 0; i < len; ++i)
+            wire += script[start + i] ^ key[i & 3];
+        start = end + 2;
+    }
+    transport.write(fd, wire);
+}
+
+/*
+** Ticks until two ticks in a row moved no bytes either way.
+*/
+static size_t settle(Server &server, MemoryTransport &transport, const std::vector<int> &fds) {
+    size_t ticks = 0;
+    size_t idle = 0;
+
+    while (idle < 2) {
+        size_t before = transport.getBytesSent() + transport.getBytesReceived();
+        server.tick();
+        consume(transport, fds);
+        ticks++;
+        idle = transport.getBytesSent() + transport.getBytesReceived() == before ? idle + 1 : 0;
+    }
+    return ticks;
+}
+
+static std::string nick(size_t i) {
+    std::ostringstream oss;
+    oss << "user" << i;
+    return oss.str();
+}
+
+static std::string channel(size_t i, size_t channels) {
+    std::ostringstream oss;
+    oss << "#room" << i % channels;
+    return oss.str();
+}
+
+int main(int argc, char *argv[]) {
+    size_t clients = argc > 1 ? atoi(argv[1]) : 200;
+    size_t channels = argc > 2 ? atoi(argv[2]) : 10;
+    size_t rounds = argc > 3 ? atoi(argv[3]) : 200;
+    std::string mode = argc > 4 ? argv[4] : "plain";
+
+    websocket = mode == "websocket";
+    if (argc > 5 || clients < 2 || channels < 1 || rounds < 1 || (mode != "plain" && !websocket)) {
+        std::cerr << "Usage: ./pipeline [clients] [channels] [rounds] [plain|websocket]" << std::endl;
+        return (1);
+    }
+    MemoryTransport *transport = new MemoryTransport;
+    Server server(websocket ? "ws:memory" : "memory", "bench", transport);
+    server.setOverloadLimits("0,0,0");
+    server.start();
+
+    std::vector<int> fds;
+    for (size_t i = 0; i < clients; ++i) {
+        fds.push_back(transport->connect());
+        if (websocket)
+            transport->write(fds[i], "GET / HTTP/1.1\r\nHost: bench\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n");
+        send(*transport, fds[i], "PASS bench\r\nNICK " + nick(i) + "\r\nUSER " + nick(i) + " 0 * :Pipeline\r\nJOIN "
+            + channel(i, channels) + "\r\n");
+    }
+    settle(server, *transport, fds);
+
+    size_t commands = 0;
+    size_t ticks = 0;
+    double start = now();
+    for (size_t round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < clients; ++i) {
+            std::ostringstream script;
+            std::string room = channel(i, channels);
+            script << "PRIVMSG " << room << " :round " << round << " from " << nick(i) << "\r\n"
+                << "PRIVMSG " << nick((i + 1) % clients) << " :hello " << round << "\r\n"
+                << "PING :" << round << "\r\n"
+                << "NOTICE " << room << " :notice " << round << "\r\n";
+            commands += 4;
+            if ((round + i) % 16 == 0) {
+                script << "WHO " << room << "\r\n";
+                commands++;
+            }
+            if ((round + i) % 32 == 0) {
+                script << "PART " << room << " :bye\r\nJOIN " << room << "\r\n";
+                commands += 2;
+            }
+            send(*transport, fds[i], script.str());
+        }
+        ticks += settle(server, *transport, fds);
+    }
+    double elapsed = now() - start;
+
+    char hex[17];
+    snprintf(hex, sizeof(hex), "%016llx", digest);
+    std::cout << "clients:              " << clients << " (" << mode << ")" << std::endl;
+    std::cout << "channels:             " << channels << std::endl;
+    std::cout << "rounds:               " << rounds << std::endl;
+    std::cout << "commands:             " << commands << std::endl;
+    std::cout << "ticks:                " << ticks << std::endl;
+    std::cout << "lines received:       " << linesReceived << std::endl;
+    std::cout << "bytes received:       " << transport->getBytesSent() << std::endl;
+    std::cout << "elapsed:              " << elapsed << " s" << std::endl;
+    std::cout << "commands per sec:     " << (long)(commands / elapsed) << std::endl;
+    std::cout << "ns per command:       " << (long)(elapsed * 1e9 / commands) << std::endl;
+    std::cout << "output digest:        " << hex << std::endl;
+    for (size_t i = 0; i < fds.size(); ++i)
+        transport->hangup(fds[i]);
+    settle(server, *transport, fds);
+    return (0);
+}
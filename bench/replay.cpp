@@ -0,0 +1,322 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   replay.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/07 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/07 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Replays a -capture file against a fresh server: one connection per
+** captured connection, opened, fed and closed in capture order, either at
+** the captured timing ("timed") or as fast as the server takes it ("fast").
+** "PASS *" is sent with the given password.
+**
+** Latency is sampled by following every SAMPLE_EVERY-th line of a
+** connection with "PING :replay-marker" and timing its PONG; a final
+** marker on every connection marks the end of the run. The report is one
+** "key: value" per line so two builds can be compared with diff.
+**
+**   ./bench/replay <capture> <port|unix:path> <password> [timed|fast]
+*/
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "../inc/Capture.hpp"
+
+#define SAMPLE_EVERY 16
+#define HIGH_WATER (256 * 1024)
+#define DRAIN_SECONDS 10
+
+struct Event {
+    unsigned char type;
+    unsigned int conn;
+    double time;
+    std::string line;
+};
+
+struct Connection {
+    int fd;
+    bool closing;
+    std::string out;
+    std::string in;
+    std::deque<double> markers;
+    size_t lines;
+};
+
+static const std::string marker = "PING :replay-marker\r\n";
+
+static std::vector<double> latencies;
+static size_t bytesSent = 0;
+static size_t bytesReceived = 0;
+static size_t linesReceived = 0;
+static size_t lost = 0;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool load(const char *path, std::vector<Event> &events) {
+    std::ifstream in(path, std::ios::binary);
+    char magic[CAPTURE_MAGIC_LEN];
+    CaptureRecord record;
+
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN) != 0)
+        return false;
+    while (in.read(reinterpret_cast<char *>(&record), sizeof(record))) {
+        Event event;
+        event.type = record.type;
+        event.conn = record.conn;
+        event.time = record.time / 1e9;
+        event.line.resize(record.length);
+        if (record.length && !in.read(&event.line[0], record.length))
+            break;
+        events.push_back(event);
+    }
+    return true;
+}
+
+static int openSocket(const std::string &target) {
+    int fd;
+
+    if (target.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, target.c_str() + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+    } else {
+        struct sockaddr_in addr;
+        int yes = 1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+static void receive(Connection &conn) {
+    char chunk[65536];
+    ssize_t n;
+
+    while ((n = recv(conn.fd, chunk, sizeof(chunk), MSG_DONTWAIT)) > 0) {
+        bytesReceived += n;
+        conn.in.append(chunk, n);
+    }
+    std::string::size_type start = 0;
+    std::string::size_type eol;
+    while ((eol = conn.in.find('\n', start)) != std::string::npos) {
+        linesReceived++;
+        if (conn.in.compare(start, 4, "PONG") == 0 && conn.in.find("replay-marker", start) < eol
+            && !conn.markers.empty()) {
+            latencies.push_back((now() - conn.markers.front()) * 1e6);
+            conn.markers.pop_front();
+        }
+        start = eol + 1;
+    }
+    conn.in.erase(0, start);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+        lost += conn.markers.size();
+        conn.markers.clear();
+        close(conn.fd);
+        conn.fd = -1;
+    }
+}
+
+static void transmit(Connection &conn) {
+    if (conn.out.empty())
+        return;
+    ssize_t n = send(conn.fd, conn.out.data(), conn.out.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (n > 0) {
+        bytesSent += n;
+        conn.out.erase(0, n);
+    }
+    if (conn.out.empty() && conn.closing)
+        shutdown(conn.fd, SHUT_WR);
+}
+
+/*
+** One poll() over every open connection: writes what is queued and reads
+** what has arrived.
+*/
+static void service(std::map<unsigned int, Connection> &conns, int timeoutMs) {
+    std::vector<struct pollfd> fds;
+    std::vector<Connection *> owners;
+
+    for (std::map<unsigned int, Connection>::iterator it = conns.begin(); it != conns.end(); ++it) {
+        if (it->second.fd < 0)
+            continue;
+        struct pollfd pfd;
+        pfd.fd = it->second.fd;
+        pfd.events = POLLIN | (it->second.out.empty() ? 0 : POLLOUT);
+        pfd.revents = 0;
+        fds.push_back(pfd);
+        owners.push_back(&it->second);
+    }
+    if (fds.empty() || poll(&fds[0], fds.size(), timeoutMs) <= 0)
+        return;
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (fds[i].revents & POLLOUT)
+            transmit(*owners[i]);
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            receive(*owners[i]);
+    }
+}
+
+static size_t queued(const std::map<unsigned int, Connection> &conns) {
+    size_t total = 0;
+    for (std::map<unsigned int, Connection>::const_iterator it = conns.begin(); it != conns.end(); ++it)
+        total += it->second.out.size();
+    return total;
+}
+
+static size_t pendingMarkers(const std::map<unsigned int, Connection> &conns) {
+    size_t total = 0;
+    for (std::map<unsigned int, Connection>::const_iterator it = conns.begin(); it != conns.end(); ++it)
+        total += it->second.fd >= 0 ? it->second.markers.size() : 0;
+    return total;
+}
+
+static void queueMarker(Connection &conn) {
+    conn.out += marker;
+    conn.markers.push_back(now());
+}
+
+static double percentile(const std::vector<double> &sorted, double p) {
+    return sorted.empty() ? 0 : sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * p))];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4 || argc > 5 || (argc == 5 && std::string(argv[4]) != "timed" && std::string(argv[4]) != "fast")) {
+        std::cerr << "Usage: ./replay <capture> <port|unix:path> <password> [timed|fast]" << std::endl;
+        return (1);
+    }
+    std::vector<Event> events;
+    if (!load(argv[1], events)) {
+        std::cerr << "Error: " << argv[1] << " is not a capture file" << std::endl;
+        return (1);
+    }
+    bool timed = argc == 5 && std::string(argv[4]) == "timed";
+    std::string password = argv[3];
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    std::map<unsigned int, Connection> conns;
+    size_t linesSent = 0;
+    size_t connections = 0;
+    size_t failed = 0;
+    double start = now();
+    for (size_t i = 0; i < events.size(); ++i) {
+        const Event &event = events[i];
+        if (timed) {
+            double due = start + event.time;
+            while (now() < due)
+                service(conns, std::max(0, static_cast<int>((due - now()) * 1000)));
+        } else if (queued(conns) > HIGH_WATER || i % 256 == 0) {
+            service(conns, 0);
+        }
+        if (event.type == CAPTURE_OPEN) {
+            Connection conn;
+            conn.fd = openSocket(argv[2]);
+            conn.closing = false;
+            conn.lines = 0;
+            connections++;
+            if (conn.fd < 0)
+                failed++;
+            else
+                fcntl(conn.fd, F_SETFL, O_NONBLOCK);
+            conns[event.conn] = conn;
+            continue;
+        }
+        std::map<unsigned int, Connection>::iterator it = conns.find(event.conn);
+        if (it == conns.end() || it->second.fd < 0)
+            continue;
+        Connection &conn = it->second;
+        if (event.type == CAPTURE_CLOSE) {
+            conn.closing = true;
+            transmit(conn);
+            continue;
+        }
+        conn.out += event.line == "PASS *" ? "PASS " + password : event.line;
+        conn.out += "\r\n";
+        linesSent++;
+        if (++conn.lines % SAMPLE_EVERY == 0)
+            queueMarker(conn);
+        transmit(conn);
+    }
+    for (std::map<unsigned int, Connection>::iterator it = conns.begin(); it != conns.end(); ++it) {
+        if (it->second.fd >= 0 && !it->second.closing) {
+            queueMarker(it->second);
+            transmit(it->second);
+        }
+    }
+    double deadline = now() + DRAIN_SECONDS;
+    while ((pendingMarkers(conns) || queued(conns)) && now() < deadline)
+        service(conns, 100);
+    double elapsed = now() - start;
+    lost += pendingMarkers(conns);
+    for (std::map<unsigned int, Connection>::iterator it = conns.begin(); it != conns.end(); ++it) {
+        if (it->second.fd >= 0)
+            close(it->second.fd);
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    double total = 0;
+    for (size_t i = 0; i < latencies.size(); ++i)
+        total += latencies[i];
+    std::cout << "capture:              " << argv[1] << std::endl;
+    std::cout << "mode:                 " << (timed ? "timed" : "fast") << std::endl;
+    std::cout << "captured duration:    " << (events.empty() ? 0 : events.back().time) << " s" << std::endl;
+    std::cout << "connections:          " << connections << " (" << failed << " failed)" << std::endl;
+    std::cout << "lines sent:           " << linesSent << std::endl;
+    std::cout << "lines received:       " << linesReceived << std::endl;
+    std::cout << "bytes sent:           " << bytesSent << std::endl;
+    std::cout << "bytes received:       " << bytesReceived << std::endl;
+    std::cout << "elapsed:              " << elapsed << " s" << std::endl;
+    std::cout << "lines per sec:        " << (long)(linesSent / elapsed) << std::endl;
+    std::cout << "latency samples:      " << latencies.size() << " (" << lost << " lost)" << std::endl;
+    std::cout << "latency mean:         " << (latencies.empty() ? 0 : total / latencies.size()) << " us" << std::endl;
+    std::cout << "latency p50:          " << percentile(latencies, 0.50) << " us" << std::endl;
+    std::cout << "latency p90:          " << percentile(latencies, 0.90) << " us" << std::endl;
+    std::cout << "latency p99:          " << percentile(latencies, 0.99) << " us" << std::endl;
+    std::cout << "latency max:          " << (latencies.empty() ? 0 : latencies.back()) << " us" << std::endl;
+    return (failed != 0);
+}
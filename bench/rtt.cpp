@@ -0,0 +1,211 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   rtt.cpp                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/27 14:48:19 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/27 14:48:19 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Round trips as a local bot sees them: one client sends PING and waits for
+** the PONG <count> times in a row and reports the latency distribution, then
+** keeps 64 PINGs in flight to measure request throughput. Run it against a
+** TCP port and a "-listen unix:" socket of the same server to compare the
+** two paths, or against a server with and without -busypoll to compare the
+** modes; the mode is read back from STATS o. With "spin" the bench polls
+** its own socket without blocking too, so its wakeups do not hide the
+** server's.
+**
+**   ./bench/rtt <port|unix:path> <password> <count> [spin]
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#define WINDOW 64
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+** "6667" connects to 127.0.0.1:6667, "unix:/path" to a Unix domain socket.
+*/
+static int openSocket(const std::string &target) {
+    int fd;
+
+    if (target.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, target.c_str() + 5, sizeof(addr.sun_path) - 1);
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+    } else {
+        struct sockaddr_in addr;
+        int yes = 1;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(target.c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd >= 0)
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        if (fd >= 0 && connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+            return fd;
+    }
+    if (fd >= 0)
+        close(fd);
+    return -1;
+}
+
+static int receiveFlags = 0;
+
+/*
+** Reads until `count` lines containing `token` have arrived. Returns false
+** when the server closes the connection.
+*/
+static bool await(int fd, std::string &buffer, const std::string &token, long count) {
+    char chunk[65536];
+
+    while (count > 0) {
+        std::string::size_type eol;
+        while (count > 0 && (eol = buffer.find('\n')) != std::string::npos) {
+            if (buffer.find(token) < eol)
+                count--;
+            buffer.erase(0, eol + 1);
+        }
+        if (count == 0)
+            break;
+        ssize_t n = recv(fd, chunk, sizeof(chunk), receiveFlags);
+        if (n < 0 && errno == EAGAIN)
+            continue;
+        if (n <= 0)
+            return false;
+        buffer.append(chunk, n);
+    }
+    return true;
+}
+
+/*
+** The busypoll line of STATS o, or "blocking" when the server has none.
+*/
+static std::string serverMode(int fd, std::string &buffer) {
+    const std::string stats = "STATS o\r\n";
+    std::string mode = "blocking";
+    char chunk[4096];
+
+    send(fd, stats.data(), stats.size(), 0);
+    while (true) {
+        std::string::size_type eol;
+        while ((eol = buffer.find('\n')) != std::string::npos) {
+            std::string line = buffer.substr(0, eol);
+            buffer.erase(0, eol + 1);
+            if (line.find(" 219 ") != std::string::npos)
+                return mode;
+            if (line.find(":busypoll ") != std::string::npos)
+                mode = line.substr(line.find(":busypoll ") + 1, line.find_last_not_of("\r") - line.find(":busypoll "));
+        }
+        ssize_t n = recv(fd, chunk, sizeof(chunk), receiveFlags);
+        if (n < 0 && errno == EAGAIN)
+            continue;
+        if (n <= 0)
+            return mode;
+        buffer.append(chunk, n);
+    }
+}
+
+static double percentile(const std::vector<double> &sorted, double fraction) {
+    return sorted[std::min(sorted.size() - 1, static_cast<size_t>(sorted.size() * fraction))];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 4 && !(argc == 5 && std::string(argv[4]) == "spin")) {
+        std::cerr << "Usage: ./rtt <port|unix:path> <password> <count> [spin]" << std::endl;
+        return (1);
+    }
+    if (argc == 5)
+        receiveFlags = MSG_DONTWAIT;
+    std::string target = argv[1];
+    long count = atol(argv[3]);
+    std::ostringstream reg;
+    std::string buffer;
+
+    int fd = openSocket(target);
+    if (fd < 0 || count <= 0) {
+        std::cerr << "Error: cannot connect to " << target << std::endl;
+        return (1);
+    }
+    reg << "PASS " << argv[2] << "\r\nNICK rtt" << getpid() << "\r\nUSER rtt 0 * :rtt\r\n";
+    send(fd, reg.str().data(), reg.str().size(), 0);
+    if (!await(fd, buffer, " 001 ", 1)) {
+        std::cerr << "Error: registration failed" << std::endl;
+        return (1);
+    }
+
+    std::vector<double> samples;
+    const std::string ping = "PING :rtt\r\n";
+    for (long i = 0; i < count; ++i) {
+        double start = now();
+        send(fd, ping.data(), ping.size(), 0);
+        if (!await(fd, buffer, "PONG", 1)) {
+            std::cerr << "Error: server closed the connection" << std::endl;
+            return (1);
+        }
+        samples.push_back((now() - start) * 1e6);
+    }
+    std::string mode = serverMode(fd, buffer);
+    std::sort(samples.begin(), samples.end());
+    double total = 0;
+    for (size_t i = 0; i < samples.size(); ++i)
+        total += samples[i];
+
+    std::string window;
+    for (int i = 0; i < WINDOW; ++i)
+        window += ping;
+    long rounds = std::max(1L, count / WINDOW);
+    double start = now();
+    for (long i = 0; i < rounds; ++i) {
+        send(fd, window.data(), window.size(), 0);
+        if (!await(fd, buffer, "PONG", WINDOW)) {
+            std::cerr << "Error: server closed the connection" << std::endl;
+            return (1);
+        }
+    }
+    double elapsed = now() - start;
+    close(fd);
+
+    std::cout << "target:               " << target << std::endl;
+    std::cout << "server mode:          " << mode << std::endl;
+    std::cout << "client wait:          " << (receiveFlags ? "spin" : "blocking") << std::endl;
+    std::cout << "round trips:          " << count << std::endl;
+    std::cout << "mean:                 " << total / samples.size() << " us" << std::endl;
+    std::cout << "min:                  " << samples.front() << " us" << std::endl;
+    std::cout << "p50:                  " << percentile(samples, 0.5) << " us" << std::endl;
+    std::cout << "p90:                  " << percentile(samples, 0.9) << " us" << std::endl;
+    std::cout << "p99:                  " << percentile(samples, 0.99) << " us" << std::endl;
+    std::cout << "p99.9:                " << percentile(samples, 0.999) << " us" << std::endl;
+    std::cout << "max:                  " << samples.back() << " us" << std::endl;
+    std::cout << "pipelined per sec:    " << (long)(rounds * WINDOW / elapsed) << " (" << WINDOW << " in flight)" << std::endl;
+    return (0);
+}
@@ -0,0 +1,351 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   soak.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 11:02:47 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 11:02:47 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Long-running churn against one server, to catch leaks. Every round opens
+** <clients> connections: most register, join a shared and a private
+** channel, message, MONITOR, INVITE, set a topic and a ban, run WHO, then
+** either QUIT or just drop the socket; some give a wrong password and some
+** connect and close without a word. After each round an operator connection
+** waits for the server's object counts (STATS z) to fall back to what they
+** were before it and reads the accounted memory.
+**
+** The first round warms the pools up and gives the baseline. The run fails
+** when, after the last round, accounted memory other than the pools is
+** above the baseline by more than SOAK_SLACK bytes, or the server's RSS has
+** grown by more than 10% (at least SOAK_RSS_SLACK bytes).
+**
+**   ./ircserv 6667 pw -oper soak,secret
+**   ./bench/soak 6667 pw soak,secret [seconds] [clients]
+*/
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define SOAK_SLACK 16384
+#define SOAK_RSS_SLACK (8 * 1024 * 1024)
+#define SOAK_REPORT 10
+#define SOAK_TIMEOUT 30
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int connectTo(int port) {
+    struct sockaddr_in addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd >= 0 && connect(fd, (const struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+static bool sendAll(int fd, const std::string &data) {
+    size_t sent = 0;
+
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+    return true;
+}
+
+/*
+** The operator connection. STATS z answers with lines of the form
+** "<group> <key> <value> <key> <value> ...", read into group.key entries.
+*/
+class Control {
+private:
+    int fd;
+    std::string input;
+
+    bool readLine(std::string &line) {
+        std::string::size_type end;
+        char buffer[4096];
+
+        while ((end = input.find('\n')) == std::string::npos) {
+            ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+                return false;
+            input.append(buffer, n);
+        }
+        line = input.substr(0, end);
+        input.erase(0, end + 1);
+        return true;
+    }
+public:
+    Control() : fd(-1) {}
+    ~Control() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool open(int port, const std::string &password, const std::string &oper) {
+        std::string line;
+        std::string::size_type comma = oper.find(',');
+
+        fd = connectTo(port);
+        if (fd < 0 || comma == std::string::npos || !sendAll(fd, "PASS " + password + "\r\nNICK soakctl\r\n"
+                "USER soakctl 0 * :soak\r\nOPER " + oper.substr(0, comma) + " " + oper.substr(comma + 1) + "\r\n"))
+            return false;
+        while (readLine(line)) {
+            if (line.find(" 381 ") != std::string::npos)
+                return true;
+            if (line.find(" 464 ") != std::string::npos || line.find(" 491 ") != std::string::npos)
+                return false;
+        }
+        return false;
+    }
+
+    bool stats(std::map<std::string, size_t> &values) {
+        std::string line;
+
+        values.clear();
+        if (!sendAll(fd, "STATS z\r\n"))
+            return false;
+        while (readLine(line)) {
+            if (line.find(" 219 ") != std::string::npos)
+                return !values.empty();
+            if (line.find(" 481 ") != std::string::npos)
+                return false;
+            if (line.find(" 249 ") == std::string::npos)
+                continue;
+            std::istringstream fields(line.substr(line.find(" :") + 2));
+            std::string group;
+            std::string key;
+            size_t value;
+            fields >> group;
+            while (fields >> key >> value)
+                values[group + "." + key] = value;
+        }
+        return false;
+    }
+};
+
+/*
+** One churned connection. WRONG_PASS and QUIT wait for the server to close
+** it; DROP waits for the answer to its last PING and closes it itself.
+*/
+struct Churner {
+    enum Kind { WRONG_PASS, SILENT, QUIT, DROP };
+    int fd;
+    Kind kind;
+    std::string partial;
+};
+
+static std::string nick(size_t i) {
+    std::ostringstream oss;
+    oss << "s" << i;
+    return oss.str();
+}
+
+static std::string script(const Churner &churner, size_t i, size_t round, const std::string &password) {
+    std::ostringstream oss;
+    std::string own = "#t" + nick(i).substr(1);
+    std::ostringstream shared;
+
+    shared << "#soak" << round % 4;
+    if (churner.kind == Churner::WRONG_PASS)
+        return "PASS wrong-" + password + "\r\nNICK " + nick(i) + "\r\n";
+    oss << "PASS " << password << "\r\nNICK " << nick(i) << "\r\nUSER soak 0 * :soak bench\r\n"
+        << "JOIN " << shared.str() << "," << own << "\r\n"
+        << "MONITOR + " << nick(i + 1) << "," << nick(i + 2) << "\r\n"
+        << "PRIVMSG " << shared.str() << " :round " << round << " from " << nick(i) << "\r\n"
+        << "TOPIC " << own << " :private channel of " << nick(i) << "\r\n"
+        << "MODE " << own << " +b *!*@10.1." << i % 256 << ".0/24\r\n"
+        << "INVITE " << nick(i + 1) << " " << own << "\r\n"
+        << "PRIVMSG " << nick(i + 1) << " :hello\r\n"
+        << "WHO " << shared.str() << "\r\n";
+    oss << (churner.kind == Churner::QUIT ? "QUIT :soak\r\n" : "PING :done\r\n");
+    return oss.str();
+}
+
+/*
+** Reads what is there; returns true once the churner is finished.
+*/
+static bool readChurner(Churner &churner) {
+    char buffer[16384];
+    ssize_t n;
+
+    while ((n = recv(churner.fd, buffer, sizeof(buffer), 0)) > 0) {
+        if (churner.kind != Churner::DROP)
+            continue;
+        churner.partial.append(buffer, n);
+        std::string::size_type end;
+        while ((end = churner.partial.find('\n')) != std::string::npos) {
+            if (churner.partial.find("PONG :done") < end)
+                return true;
+            churner.partial.erase(0, end + 1);
+        }
+    }
+    return n == 0;
+}
+
+/*
+** Returns the number of connections that did not finish in time.
+*/
+static size_t churn(int port, const std::string &password, size_t count, size_t round) {
+    std::vector<Churner> churners;
+    std::vector<struct pollfd> pfds;
+    size_t left = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+        Churner churner;
+        static const Churner::Kind kinds[] = {Churner::WRONG_PASS, Churner::SILENT, Churner::QUIT, Churner::QUIT,
+            Churner::QUIT, Churner::DROP, Churner::DROP, Churner::DROP};
+        churner.kind = kinds[i % 8];
+        churner.fd = connectTo(port);
+        if (churner.fd < 0) {
+            std::cerr << "connect failed in round " << round << std::endl;
+            exit(1);
+        }
+        if (churner.kind == Churner::SILENT) {
+            close(churner.fd);
+            continue;
+        }
+        sendAll(churner.fd, script(churner, i, round, password));
+        fcntl(churner.fd, F_SETFL, O_NONBLOCK);
+        churners.push_back(churner);
+    }
+    double deadline = now() + SOAK_TIMEOUT;
+    left = churners.size();
+    while (left && now() < deadline) {
+        pfds.clear();
+        for (size_t i = 0; i < churners.size(); ++i) {
+            struct pollfd pfd = {churners[i].fd, POLLIN, 0};
+            pfds.push_back(pfd);
+        }
+        if (poll(&pfds[0], pfds.size(), 1000) <= 0)
+            continue;
+        for (size_t i = 0; i < pfds.size(); ++i) {
+            if (churners[i].fd < 0 || !pfds[i].revents || !readChurner(churners[i]))
+                continue;
+            close(churners[i].fd);
+            churners[i].fd = -1;
+            left--;
+        }
+    }
+    for (size_t i = 0; i < churners.size(); ++i)
+        if (churners[i].fd >= 0)
+            close(churners[i].fd);
+    return left;
+}
+
+/*
+** Polls STATS z until the server holds as many clients and channels as it
+** did at the baseline, which it should as soon as it has seen every close.
+*/
+static bool settle(Control &control, const std::map<std::string, size_t> &base,
+    std::map<std::string, size_t> &values) {
+    double deadline = now() + SOAK_TIMEOUT;
+
+    while (control.stats(values)) {
+        if (values["objects.clients"] == base.find("objects.clients")->second
+            && values["objects.channels"] == base.find("objects.channels")->second)
+            return true;
+        if (now() > deadline)
+            return false;
+        usleep(100000);
+    }
+    return false;
+}
+
+static size_t accounted(std::map<std::string, size_t> &values) {
+    return values["memory.total"] - values["memory.pools"];
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: ./soak <port> <password> <oper-name>,<oper-password> [seconds] [clients]" << std::endl;
+        return (1);
+    }
+    int port = atoi(argv[1]);
+    std::string password = argv[2];
+    double seconds = argc > 4 ? atof(argv[4]) : 60;
+    size_t count = argc > 5 ? atol(argv[5]) : 200;
+    Control control;
+    std::map<std::string, size_t> start;
+    std::map<std::string, size_t> base;
+    std::map<std::string, size_t> values;
+
+    if (!control.open(port, password, argv[3]) || !control.stats(start)) {
+        std::cerr << "cannot OPER or read STATS z" << std::endl;
+        return (1);
+    }
+    size_t stuck = churn(port, password, count, 0);
+    if (!settle(control, start, base)) {
+        std::cerr << "server did not settle after the warm-up round" << std::endl;
+        return (1);
+    }
+    size_t rounds = 1;
+    size_t connections = count;
+    size_t peak = accounted(base);
+    double began = now();
+    double report = began + SOAK_REPORT;
+    while (now() - began < seconds) {
+        stuck += churn(port, password, count, rounds);
+        if (!settle(control, start, values)) {
+            std::cerr << "server kept " << values["objects.clients"] << " clients and "
+                << values["objects.channels"] << " channels after round " << rounds << std::endl;
+            return (1);
+        }
+        rounds++;
+        connections += count;
+        peak = std::max(peak, accounted(values));
+        if (now() >= report) {
+            std::cout << "elapsed " << static_cast<long>(now() - began) << "s rounds " << rounds
+                << " connections " << connections << " accounted " << accounted(values)
+                << " buffers " << values["objects.buffers"] << " rss " << values["queued.rss"] << std::endl;
+            report += SOAK_REPORT;
+        }
+    }
+    if (values.empty())
+        values = base;
+    size_t rssBase = base["queued.rss"];
+    size_t rssLimit = rssBase + std::max(rssBase / 10, static_cast<size_t>(SOAK_RSS_SLACK));
+    bool leaked = accounted(values) > accounted(base) + SOAK_SLACK;
+    bool grew = values["queued.rss"] > rssLimit;
+    std::cout << "rounds: " << rounds << "\n"
+        << "connections: " << connections << "\n"
+        << "unfinished: " << stuck << "\n"
+        << "accounted-baseline: " << accounted(base) << "\n"
+        << "accounted-final: " << accounted(values) << "\n"
+        << "accounted-max: " << peak << "\n"
+        << "pools-final: " << values["memory.pools"] << "\n"
+        << "rss-baseline: " << rssBase << "\n"
+        << "rss-final: " << values["queued.rss"] << "\n"
+        << "result: " << (leaked ? "FAIL accounted memory" : grew ? "FAIL rss" : "ok") << std::endl;
+    return leaked || grew ? 1 : 0;
+}
@@ -0,0 +1,169 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   textscan.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/28 15:32:08 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/28 15:32:08 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** Throughput of the TextScan kernels on a pasted-log burst: CRLF-terminated
+** chat lines of 20 to 400 bytes, one in eight with non-ASCII UTF-8. Line
+** framing is measured the way processInput() consumes it (SCAN_BATCH offsets
+** per call), next to a find_first_of() loop as the baseline; UTF-8 validation
+** runs over every line body, and WebSocket unmasking over every line as if
+** each came in its own frame. Reports GB/s per implementation.
+**
+**   ./bench/textscan [burst-bytes] [seconds-per-test]
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <sys/time.h>
+#include "../inc/TextScan.hpp"
+
+#define SCAN_BATCH 64
+
+static double now() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static std::string makeBurst(size_t size, std::vector<std::pair<size_t, size_t> > &bodies) {
+    static const char *words[] = {"the", "server", "is", "lagging", "again", "anyone", "seen", "this",
+        "build", "failed", "on", "master", "café", "naïve", "日本語", "ok", "thanks", "😀", "lol", "patch"};
+    std::string burst;
+
+    srand(42);
+    while (burst.size() < size) {
+        std::string line = "PRIVMSG #paste :";
+        size_t length = 20 + rand() % 380;
+        bool utf8 = rand() % 8 == 0;
+        while (line.size() < length) {
+            size_t word = rand() % (utf8 ? 20 : 12);
+            line += words[word];
+            line += ' ';
+        }
+        bodies.push_back(std::make_pair(burst.size() + 16, line.size() - 16));
+        burst += line + "\r\n";
+    }
+    return burst;
+}
+
+static size_t scanBreaks(const std::string &burst) {
+    size_t positions[SCAN_BATCH];
+    size_t lines = 0;
+    size_t base = 0;
+
+    while (base < burst.size()) {
+        size_t found = TextScan::findBreaks(burst.data() + base, burst.size() - base, positions, SCAN_BATCH);
+        lines += found;
+        if (found < SCAN_BATCH)
+            break;
+        base += positions[found - 1] + 1;
+    }
+    return lines;
+}
+
+static size_t findFirstOf(const std::string &burst) {
+    size_t lines = 0;
+    std::string::size_type pos = 0;
+
+    while ((pos = burst.find_first_of(std::string("\r\n\0", 3), pos)) != std::string::npos) {
+        lines++;
+        pos++;
+    }
+    return lines;
+}
+
+static size_t validate(const std::string &burst, const std::vector<std::pair<size_t, size_t> > &bodies) {
+    size_t valid = 0;
+
+    for (size_t i = 0; i < bodies.size(); ++i)
+        valid += TextScan::isUtf8(burst.data() + bodies[i].first, bodies[i].second);
+    return valid;
+}
+
+static const unsigned char maskKey[4] = {0x37, 0xfa, 0x21, 0x3d};
+
+static size_t unmaskLines(const std::string &burst, const std::vector<std::pair<size_t, size_t> > &bodies,
+    std::vector<char> &out) {
+    for (size_t i = 0; i < bodies.size(); ++i)
+        TextScan::unmask(&out[bodies[i].first], burst.data() + bodies[i].first, bodies[i].second, maskKey, 0);
+    return static_cast<unsigned char>(out[bodies[0].first]);
+}
+
+static void report(const std::string &name, size_t bytes, double seconds) {
+    std::cout << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(2)
+        << std::setw(8) << bytes / seconds / 1e9 << " GB/s" << std::endl;
+}
+
+int main(int argc, char *argv[]) {
+    size_t size = argc > 1 ? atol(argv[1]) : 64 * 1024;
+    double duration = argc > 2 ? atof(argv[2]) : 0.5;
+    std::vector<std::pair<size_t, size_t> > bodies;
+    std::string burst = makeBurst(size, bodies);
+    const char *names[] = {"scalar", "sse2", "avx2"};
+    size_t expected = findFirstOf(burst);
+    std::vector<char> masked(burst.size());
+    std::vector<char> reference(burst.size());
+    size_t sink = 0;
+    size_t bodyBytes = 0;
+
+    for (size_t i = 0; i < bodies.size(); ++i)
+        bodyBytes += bodies[i].second;
+
+    std::cout << "burst: " << burst.size() << " bytes, " << bodies.size() << " lines" << std::endl;
+    size_t bytes = 0;
+    double start = now();
+    while (now() - start < duration) {
+        for (int i = 0; i < 100; ++i)
+            sink += findFirstOf(burst);
+        bytes += burst.size() * 100;
+    }
+    report("framing find_first_of", bytes, now() - start);
+    TextScan::select("scalar");
+    unmaskLines(burst, bodies, reference);
+    for (size_t n = 0; n < sizeof(names) / sizeof(names[0]); ++n) {
+        if (!TextScan::select(names[n]))
+            continue;
+        unmaskLines(burst, bodies, masked);
+        if (scanBreaks(burst) != expected || validate(burst, bodies) != bodies.size() || masked != reference) {
+            std::cerr << "Error: " << names[n] << " gives wrong results" << std::endl;
+            return (1);
+        }
+        bytes = 0;
+        start = now();
+        while (now() - start < duration) {
+            for (int i = 0; i < 100; ++i)
+                sink += scanBreaks(burst);
+            bytes += burst.size() * 100;
+        }
+        report(std::string("framing ") + names[n], bytes, now() - start);
+        bytes = 0;
+        start = now();
+        while (now() - start < duration) {
+            for (int i = 0; i < 100; ++i)
+                sink += validate(burst, bodies);
+            bytes += bodyBytes * 100;
+        }
+        report(std::string("utf-8 ") + names[n], bytes, now() - start);
+        bytes = 0;
+        start = now();
+        while (now() - start < duration) {
+            for (int i = 0; i < 100; ++i)
+                sink += unmaskLines(burst, bodies, masked);
+            bytes += bodyBytes * 100;
+        }
+        report(std::string("unmask ") + names[n], bytes, now() - start);
+    }
+    return (sink == 0);
+}
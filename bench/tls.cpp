@@ -0,0 +1,224 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   tls.cpp                                            :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/10 11:03:12 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/10 11:03:12 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+/*
+** TLS against plain TCP on one server. Connection setup: <connections>
+** times in a row, connect, send one line and wait for the server's answer,
+** then close; once over the plain port, once over the TLS port with a full
+** handshake each time and once resuming the previous session. Bulk: one
+** registered client keeps 64 PINGs with a 400-byte payload in flight until
+** <megabytes> have come back, on each port. Finally the server's STATS T
+** line tells how many sessions were resumed and whether kTLS was used.
+**
+**   ./ircserv 6667 pw -listen tls:6697 -tls cert.pem,key.pem
+**   ./bench/tls 6667 6697 pw [connections] [megabytes]
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/ssl.h>
+
+#define WINDOW 64
+#define PAYLOAD 400
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+** A connection to 127.0.0.1, optionally with TLS on top. Lines are read
+** through a small buffer so the same code serves both.
+*/
+class Connection {
+private:
+    int fd;
+    SSL *ssl;
+    std::string input;
+public:
+    Connection() : fd(-1), ssl(NULL) {}
+    ~Connection() { close(); }
+
+    bool open(int port, SSL_CTX *context, SSL_SESSION *session) {
+        struct sockaddr_in addr;
+        int yes = 1;
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0)
+            return false;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+            return false;
+        if (!context)
+            return true;
+        ssl = SSL_new(context);
+        SSL_set_fd(ssl, fd);
+        if (session)
+            SSL_set_session(ssl, session);
+        return SSL_connect(ssl) == 1;
+    }
+
+    bool write(const std::string &data) {
+        if (ssl)
+            return SSL_write(ssl, data.data(), data.size()) == static_cast<int>(data.size());
+        return ::send(fd, data.data(), data.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(data.size());
+    }
+
+    /*
+    ** Returns the number of bytes consumed, 0 when the connection closed.
+    */
+    size_t readLine(std::string &line) {
+        std::string::size_type end;
+        char buffer[16384];
+
+        while ((end = input.find('\n')) == std::string::npos) {
+            int n = ssl ? SSL_read(ssl, buffer, sizeof(buffer)) : recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+                return 0;
+            input.append(buffer, n);
+        }
+        line = input.substr(0, end);
+        input.erase(0, end + 1);
+        return end + 1;
+    }
+
+    SSL_SESSION *session() { return ssl ? SSL_get1_session(ssl) : NULL; }
+
+    void close() {
+        if (ssl) {
+            SSL_shutdown(ssl);
+            SSL_free(ssl);
+        }
+        if (fd >= 0)
+            ::close(fd);
+        ssl = NULL;
+        fd = -1;
+        input.clear();
+    }
+};
+
+static void report(const std::string &name, double value, const std::string &unit) {
+    std::cout << std::left << std::setw(22) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(12) << value << " " << unit << std::endl;
+}
+
+/*
+** A TLS 1.3 session ticket arrives after the handshake, so the session is
+** only taken once the reply has been read. Tickets are single use on the
+** client side, so every resumed connection hands its new one on.
+*/
+static double connections(int port, SSL_CTX *context, size_t count, bool resume) {
+    SSL_SESSION *session = NULL;
+    std::string line;
+    double start = now();
+
+    for (size_t i = 0; i < count; ++i) {
+        Connection connection;
+        if (!connection.open(port, context, resume ? session : NULL)
+            || !connection.write("PING :setup\r\n") || !connection.readLine(line)) {
+            std::cerr << "connection " << i << " to port " << port << " failed" << std::endl;
+            exit(1);
+        }
+        if (resume) {
+            if (session)
+                SSL_SESSION_free(session);
+            session = connection.session();
+        }
+    }
+    double elapsed = now() - start;
+    if (session)
+        SSL_SESSION_free(session);
+    return count / elapsed;
+}
+
+static double bulk(int port, SSL_CTX *context, const std::string &password, size_t megabytes) {
+    Connection connection;
+    std::string line;
+    std::string ping = "PING :" + std::string(PAYLOAD, 'x') + "\r\n";
+    std::string window;
+    size_t received = 0;
+    size_t target = megabytes << 20;
+
+    for (size_t i = 0; i < WINDOW; ++i)
+        window += ping;
+    if (!connection.open(port, context, NULL)
+        || !connection.write("PASS " + password + "\r\nNICK tlsbench\r\nUSER tlsbench 0 * :TLS bench\r\n"))
+        return 0;
+    do {
+        if (!connection.readLine(line))
+            return 0;
+    } while (line.find(" 001 ") == std::string::npos || line.find("Welcome") == std::string::npos);
+    double start = now();
+    while (received < target) {
+        if (!connection.write(window))
+            return 0;
+        for (size_t i = 0; i < WINDOW; ++i) {
+            size_t n = connection.readLine(line);
+            if (!n)
+                return 0;
+            received += n;
+        }
+    }
+    return received / (now() - start) / (1 << 20);
+}
+
+static std::string tlsStats(int port, SSL_CTX *context, const std::string &password) {
+    Connection connection;
+    std::string line;
+
+    if (!connection.open(port, context, NULL)
+        || !connection.write("PASS " + password + "\r\nNICK tlsstats\r\nUSER tlsstats 0 * :TLS bench\r\nSTATS T\r\n"))
+        return "";
+    while (connection.readLine(line) && line.find(" 219 ") == std::string::npos)
+        if (line.find(" 249 ") != std::string::npos)
+            return line.substr(line.find(" :") + 2);
+    return "";
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 4 || argc > 6) {
+        std::cerr << "Usage: ./tls <plain-port> <tls-port> <password> [connections] [megabytes]" << std::endl;
+        return (1);
+    }
+    int plain = atoi(argv[1]);
+    int secure = atoi(argv[2]);
+    std::string password = argv[3];
+    size_t count = argc > 4 ? atol(argv[4]) : 2000;
+    size_t megabytes = argc > 5 ? atol(argv[5]) : 64;
+
+    SSL_CTX *context = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_verify(context, SSL_VERIFY_NONE, NULL);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_CLIENT);
+
+    report("plain connects", connections(plain, NULL, count, false), "/s");
+    report("tls full handshakes", connections(secure, context, count, false), "/s");
+    report("tls resumed", connections(secure, context, count, true), "/s");
+    report("plain bulk", bulk(plain, NULL, password, megabytes), "MiB/s");
+    report("tls bulk", bulk(secure, context, password, megabytes), "MiB/s");
+    std::cout << "server: " << tlsStats(secure, context, password) << std::endl;
+    SSL_CTX_free(context);
+    return (0);
+}
@@ -0,0 +1,41 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Bridge.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/11 15:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/11 15:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BRIDGE_HPP
+#define BRIDGE_HPP
+
+#include <string>
+#include <map>
+
+class Client;
+
+/*
+** A -bridge account. Its bridge connections are moved into connClass, when
+** one was given, once they authenticate.
+*/
+struct BridgeAccount {
+    std::string password;
+    int connClass;
+};
+
+/*
+** A connection that authenticated with BRIDGE and carries the users of a
+** gateway to another chat network. users maps the tag the bridge gave each
+** of them to its virtual Client; received counts the lines it sent.
+*/
+struct Bridge {
+    std::string name;
+    std::map<unsigned int, Client *> users;
+    size_t received;
+};
+
+#endif
@@ -0,0 +1,33 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   BusyPoll.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 14:20:33 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 14:20:33 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef BUSYPOLL_HPP
+#define BUSYPOLL_HPP
+
+#define BUSYPOLL_MAX 100000
+
+/*
+** Low-latency mode set with -busypoll. spin is how many microseconds the
+** loop keeps checking for events without blocking before it sleeps (0 when
+** the mode is off), cpu the core the loop is pinned to (-1 for none). The
+** counters are what STATS o reports: wakeups found while spinning, waits
+** that went to sleep, and sockets that refused SO_BUSY_POLL.
+*/
+struct BusyPollState {
+    long long spin;
+    int cpu;
+    unsigned long spun;
+    unsigned long slept;
+    unsigned long refused;
+};
+
+#endif
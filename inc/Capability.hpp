@@ -0,0 +1,78 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Capability.hpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 16:05:19 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 16:05:19 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CAPABILITY_HPP
+#define CAPABILITY_HPP
+
+#include <string>
+#include "SharedBuffer.hpp"
+
+#define CAP_SERVER_TIME 1
+#define CAP_MESSAGE_TAGS 2
+#define CAP_ECHO_MESSAGE 4
+#define CAP_BATCH 8
+#define CAP_COUNT 4
+#define CAP_TAGS_MAX 4094
+#define TAG_VARIANTS 4
+
+/*
+** The IRCv3 capabilities a client can enable with CAP REQ, one bit each in
+** Client's capability byte.
+*/
+class Capability {
+public:
+    static unsigned char parse(const std::string &name);
+    static std::string list(unsigned char caps);
+};
+
+/*
+** The wall clock as of the current pass of the event loop. tick() reads
+** it once per pass; the server-time text is formatted on first use and
+** reused by every message of the same millisecond.
+*/
+class ServerTime {
+private:
+    static long long millis;
+    static long long formatted;
+    static std::string text;
+public:
+    static void tick();
+    static long long now();
+    static const std::string &get();
+    static std::string format(long long when);
+};
+
+/*
+** One message as its recipients need it. Which tags a line carries depends
+** only on two capabilities, server-time and message-tags (for the sender's
+** client-only tags), so there are at most TAG_VARIANTS serializations.
+** Each is built the first time a recipient needs it and then shared, like
+** the untagged line, by every recipient with the same capabilities. A
+** buffer of several lines gets the tags on each.
+*/
+class TaggedLine {
+private:
+    SharedBuffer variants[TAG_VARIANTS];
+    std::string clientTags;
+    long long time;
+
+    TaggedLine(const TaggedLine &other);
+    TaggedLine &operator=(const TaggedLine &other);
+public:
+    explicit TaggedLine(const SharedBuffer &plain, const std::string &clientTags = "");
+    size_t variant(unsigned char caps) const;
+    const SharedBuffer &forCaps(unsigned char caps);
+    const SharedBuffer &plain() const;
+    static std::string tagged(const std::string &tags, const SharedBuffer &line);
+};
+
+#endif
@@ -0,0 +1,40 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Capture.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/07 10:12:55 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/07 10:12:55 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CAPTURE_HPP
+#define CAPTURE_HPP
+
+#define CAPTURE_MAGIC "IRCCAP01"
+#define CAPTURE_MAGIC_LEN 8
+
+/*
+** Traffic capture file written with -capture and read by bench/replay:
+** CAPTURE_MAGIC followed by records, each a CaptureRecord and, for a line,
+** `length` bytes of the line without its line ending. conn numbers the
+** connections of the capture from 1 (descriptors get reused); time is in
+** nanoseconds on the monotonic clock since the capture started. PASS and
+** OPER passwords are stored as "*".
+*/
+enum CaptureType {
+    CAPTURE_OPEN = 'O',
+    CAPTURE_LINE = 'L',
+    CAPTURE_CLOSE = 'C'
+};
+
+struct CaptureRecord {
+    unsigned char type;
+    unsigned int conn;
+    unsigned long long time;
+    unsigned short length;
+} __attribute__((packed));
+
+#endif
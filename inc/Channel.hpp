@@ -16,21 +16,39 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
+#include <set>
 #include <iostream>
 #include <sys/socket.h>
 #include <sstream>
 #include "Client.hpp"
+#include "SharedBuffer.hpp"
+#include "MaskIndex.hpp"
 #include "Server.hpp"
 
+#define HISTORY_LEN 100
+
+struct HistoryEntry {
+    long long time;
+    SharedBuffer line;
+};
+
 class Channel {
 private:
-    std::string name;
+    ChannelName name;
     std::string topic;
     std::map<int, Client *> users;
     std::map<int, bool> operators;
+    std::set<int> invited;
     std::map<char, bool> modes;
     int userLimit;
     std::string password;
+    std::deque<HistoryEntry> history;
+    size_t historyBytes;
+    MaskIndex bans;
+    MaskIndex exceptions;
+    MaskIndex inviteExceptions;
+    std::map<int, bool> banVerdicts;
 public:
     Channel(const std::string &channelName);
     void setTopic(const std::string &newTopic);
@@ -40,12 +58,16 @@ public:
     bool isUserInChannel(int clientFd) const;
     Client *getUserByNick(const std::string &nickname) const;
     std::vector<std::string> listUsers() const;
+    const std::map<int, Client *> &getUsers() const;
     bool isOperator(int clientFd) const;
     void addOperator(int clientFd);
     void removeOperator(int clientFd);
     void broadcastMessage(const std::string &message, int senderFd);
+    void broadcastMessage(const SharedBuffer &message, int senderFd);
+    void broadcastMessage(TaggedLine &message, int senderFd, unsigned char requiredCaps = 0);
     void broadcastToOps(const std::string &message);
     std::string getName() const;
+    const ChannelName &getKey() const;
     bool hasMode(char mode) const;
     void setMode(char mode);
     void unsetMode(char mode);
@@ -56,9 +78,23 @@ public:
     bool isFull() const;
     void kickUser(int operatorFd, const std::string &targetNick, const std::string &reason);
     void inviteUser(Client *operatorClient, Client *targetClient);
+    void addInvite(int clientFd);
+    bool isInvited(int clientFd) const;
     void setPassword(const std::string &pass);
     bool checkPassword(const std::string &pass) const;
     std::string getPassword() const;
+    long addHistory(const SharedBuffer &line, long long when);
+    size_t evictHistory();
+    void clearHistory();
+    const std::deque<HistoryEntry> &getHistory() const;
+    size_t getHistoryBytes() const;
+    MaskIndex *getMaskList(char mode);
+    bool addMask(char mode, const std::string &mask, const std::string &setter, long long when);
+    bool removeMask(char mode, const std::string &mask);
+    bool isBanned(const Client *client);
+    bool isInviteExempt(const Client *client) const;
+    void forgetBanVerdict(int clientFd);
+    size_t memoryUsage() const;
 };
 
 #endif
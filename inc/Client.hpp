@@ -6,7 +6,7 @@
 /*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/02/27 10:26:22 by rtorres           #+#    #+#             */
-/*   Updated: 2025/03/10 18:29:24 by rtorres          ###   ########.fr       */
+/*   Updated: 2025/03/21 11:37:50 by rtorres          ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
@@ -16,52 +16,167 @@
 #include <string>
 #include <vector>
 #include <algorithm>
+#include <deque>
+#include <sys/socket.h>
+#include "SharedBuffer.hpp"
+#include "IrcName.hpp"
+#include "EventLoop.hpp"
+#include "Transport.hpp"
+#include "Capability.hpp"
 
+#define OUTPUT_POOL 256
+
+/*
+** Output state of a client, allocated on the first queued line and freed as
+** soon as everything has been written, so idle clients carry none of it.
+** Freed ones are kept for reuse, up to OUTPUT_POOL of them.
+*/
+struct ClientOutput {
+    std::deque<SharedBuffer> sendq;
+    size_t offset;
+    size_t bytes;
+    std::deque<SharedBuffer> replay;
+};
+
+/*
+** Per-connection state, kept small for large numbers of idle clients: flags
+** are packed into one byte, the nick and user are stored inline, the peer
+** address is kept in binary form and the host text only lives in the cached
+** prefix. Receive and send buffers exist only while data is in flight.
+**
+** A virtual client is a user behind a bridge connection: it has no socket
+** (its fd is a negative id, like a remote client's) and everything queued
+** for it goes into the bridge's send queue, prefixed with its tag.
+*/
 class Client {
 private:
+    enum {
+        FLAG_OPERATOR = 1,
+        FLAG_REGISTERED = 2,
+        FLAG_AUTHENTICATED = 4,
+        FLAG_LOGGEDIN = 8,
+        FLAG_SENDQ_EXCEEDED = 16,
+        FLAG_IRCOP = 32,
+        FLAG_BRIDGE = 64,
+        FLAG_NEGOTIATING = 128
+    };
     int fd;
-    bool isOperator;
-    bool registered;
-    bool authenticated;
-    bool logedin;
-    std::string nickname;
-    std::string username;
+    int uplink;
+    Client *bridge;
+    unsigned int tag;
+    unsigned char flags;
+    unsigned char caps;
+    unsigned char family;
+    unsigned char connClass;
+    unsigned char address[16];
+    NickName nickname;
+    char username[USERLEN + 1];
+    std::string prefix;
     std::string realname;
-    std::string ipadd;
-    std::string password;
-    std::string buffer;
-    std::vector<std::string> ChannelsInvite;
+    std::string server;
+    unsigned int sendqLimit;
+    unsigned int recvqLimit;
+    std::string *input;
+    ClientOutput *output;
+
+    Client(const Client &other);
+    Client &operator=(const Client &other);
+    void setFlag(unsigned char flag, bool value);
+    void updatePrefix(const std::string &host);
+    void openOutput();
+    void releaseOutput();
 public:
     Client();
-    Client(int fd, const std::string &ip);
+    Client(int fd, const struct sockaddr *addr);
+    Client(int fd, const std::string &host);
     ~Client();
     int getSocket() const;
     std::string getNickName() const;
+    const NickName &getNick() const;
     std::string getUserName() const;
-    std::string getRealName() const;
+    const std::string &getRealName() const;
     std::string getIpAddress() const;
-    std::string &getBuffer();
+    int getFamily() const;
+    const unsigned char *getAddress() const;
     std::string getHostname() const;
+    const std::string &getPrefix() const;
     bool isAuthenticated() const;
     bool isRegistered() const;
     bool isOperatorStatus() const;
     bool isLoggedIn() const;
-    bool isInvitedToChannel(const std::string &chName) const;
+    bool isIrcOperator() const;
     void setNickName(const std::string &nick);
     void setUserName(const std::string &user);
     void setRealName(const std::string &real);
-    void setPassword(const std::string &pass);
-    void setIpAddress(const std::string &ip);
     void setOperator(bool value);
     void setAuthenticated(bool value);
     void setRegistered(bool value);
     void setLoggedIn(bool value);
-    void setBuffer(const std::string &data);
+    void setIrcOperator(bool value);
     bool checkPassword(const std::string &inputPassword, const std::string &correctPassword);
     void registerUser();
-    void clearBuffer();
-    void addChannelInvite(const std::string &chname);
-    void removeChannelInvite(const std::string &chname);
+    bool hasPendingInput() const;
+    size_t getInputSize() const;
+    bool isRecvqFull() const;
+    void stashInput(const char *data, size_t len);
+    void takeInput(std::string &data);
+    bool isRemote() const;
+    int getUplink() const;
+    const std::string &getServer() const;
+    void setUplink(int linkFd);
+    void setServer(const std::string &serverName);
+    bool isVirtual() const;
+    Client *getBridge() const;
+    unsigned int getTag() const;
+    void setBridge(Client *host, unsigned int userTag);
+    bool isBridgeHost() const;
+    void setBridgeHost(bool value);
+    unsigned char getCaps() const;
+    bool hasCap(unsigned char cap) const;
+    void setCaps(unsigned char value);
+    bool isNegotiating() const;
+    void setNegotiating(bool value);
+    void setConnClass(size_t index, size_t sendq, size_t recvq);
+    size_t getConnClass() const;
+    bool isSendqExceeded() const;
+    void queue(const SharedBuffer &line);
+    char *extendOutput(size_t len);
+    void queueTagged(const std::string &tags, const SharedBuffer &line);
+    void queueReplay(const SharedBuffer &line);
+    bool hasPendingOutput() const;
+    bool hasPendingReplay() const;
+    size_t getSendQueueSize() const;
+    void feedReplay(size_t maxLines);
+    void prepareSend(SendRequest &request) const;
+    int completeSend(const SendRequest &request);
+    int flush(Transport &transport);
+    size_t memoryUsage() const;
+    static size_t pooledOutputMemory();
+};
+
+/*
+** Hands one line to many recipients, each in the variant its capabilities
+** call for. Virtual clients are gathered per bridge and variant, and each
+** group gets the line once, tagged with all of its users it is meant for,
+** when send() is called.
+*/
+struct FanoutGroup {
+    Client *host;
+    const SharedBuffer *line;
+    std::string tags;
+};
+
+class Fanout {
+private:
+    TaggedLine &line;
+    std::vector<FanoutGroup> bridges;
+
+    Fanout(const Fanout &other);
+    Fanout &operator=(const Fanout &other);
+public:
+    explicit Fanout(TaggedLine &line);
+    void add(Client *recipient);
+    void send();
 };
 
 #endif
@@ -0,0 +1,37 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ConnClass.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/24 09:40:12 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/24 09:40:12 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef CONNCLASS_HPP
+#define CONNCLASS_HPP
+
+#include <string>
+
+/*
+** A connection class, configured with -class. Clients whose address starts
+** with mask (any address when the mask is empty) get its send and receive
+** queue limits; a class named by a -listen is only given to clients of that
+** listener. The peaks and counters are reported by STATS q.
+*/
+struct ConnClass {
+    std::string name;
+    std::string mask;
+    bool listenerOnly;
+    size_t sendq;
+    size_t recvq;
+    size_t clients;
+    size_t sendqPeak;
+    size_t recvqPeak;
+    unsigned long sendqExceeded;
+    unsigned long recvqExceeded;
+};
+
+#endif
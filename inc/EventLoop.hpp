@@ -0,0 +1,104 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventLoop.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/26 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/26 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef EVENTLOOP_HPP
+#define EVENTLOOP_HPP
+
+#include <string>
+#include <vector>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+
+#define FLUSH_IOV 64
+
+enum IoEventType {
+    IO_READY,
+    IO_ACCEPT,
+    IO_RECV
+};
+
+/*
+** One event returned by EventLoop::wait(). Readiness backends only report
+** IO_READY with poll(2) style revents. Completion backends also hand over
+** accepted sockets (result is the new fd or -errno) and received data
+** (result is the byte count, 0 on EOF, -errno on error); data stays valid
+** until the next call to wait().
+*/
+struct IoEvent {
+    int type;
+    int fd;
+    short revents;
+    int result;
+    const char *data;
+};
+
+/*
+** One client's share of a per-tick flush: up to FLUSH_IOV queued lines for a
+** single sendmsg(). result is what sendmsg() returned, or -errno.
+*/
+struct SendRequest {
+    int fd;
+    struct iovec iov[FLUSH_IOV];
+    size_t count;
+    size_t total;
+    ssize_t result;
+};
+
+/*
+** The readiness/completion source behind Server::run(). setEvents() takes
+** POLLIN/POLLOUT masks for every backend and is cheap to call with an
+** unchanged mask. Completion backends may take over accept() and recv() for
+** the sockets passed to acceptMultishot() and recvMultishot(); readiness
+** backends return false there and keep reporting IO_READY instead.
+*/
+class EventLoop {
+public:
+    virtual ~EventLoop();
+    virtual const char *getName() const = 0;
+    virtual void setEvents(int fd, short events) = 0;
+    virtual void remove(int fd) = 0;
+    virtual int wait(std::vector<IoEvent> &events, int timeout) = 0;
+    virtual bool acceptMultishot(int fd);
+    virtual bool recvMultishot(int fd);
+    virtual void sendBatch(std::vector<SendRequest> &batch);
+    static EventLoop *create(const std::string &backend);
+};
+
+class PollLoop : public EventLoop {
+private:
+    std::vector<struct pollfd> pfds;
+    std::vector<size_t> slots;
+public:
+    PollLoop();
+    const char *getName() const;
+    void setEvents(int fd, short events);
+    void remove(int fd);
+    int wait(std::vector<IoEvent> &events, int timeout);
+};
+
+class EpollLoop : public EventLoop {
+private:
+    int epfd;
+    std::vector<short> interest;
+    std::vector<struct epoll_event> ready;
+public:
+    EpollLoop();
+    ~EpollLoop();
+    const char *getName() const;
+    void setEvents(int fd, short events);
+    void remove(int fd);
+    int wait(std::vector<IoEvent> &events, int timeout);
+};
+
+#endif
@@ -0,0 +1,104 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   IrcName.hpp                                        :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/19 14:02:27 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/21 11:37:50 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef IRCNAME_HPP
+#define IRCNAME_HPP
+
+#include <string>
+#include <cstring>
+
+#define NICKLEN 9
+#define USERLEN 10
+#define CHANNELLEN 50
+
+/*
+** A nickname or channel name with its RFC 1459 casefolded form and hash
+** computed once, when the name is set. Both forms are stored inline, so a
+** name never touches the heap. Names order by hash first, so map lookups
+** and equality checks rarely compare the folded bytes at all.
+**
+** A value longer than Size is kept as an invalid name that compares equal
+** to nothing, so lookups of over-long input never match a truncated entry.
+*/
+template <size_t Size>
+class IrcName {
+private:
+    unsigned int hash;
+    unsigned char length;
+    char name[Size + 1];
+    char folded[Size + 1];
+public:
+    IrcName() : hash(2166136261u), length(0) {
+        name[0] = '\0';
+        folded[0] = '\0';
+    }
+
+    IrcName(const std::string &value) : hash(2166136261u), length(0) {
+        for (size_t i = 0; i < value.size(); ++i)
+            hash = (hash ^ (unsigned char)foldChar(value[i])) * 16777619u;
+        if (value.size() > Size) {
+            length = Size + 1;
+            name[0] = '\0';
+            folded[0] = '\0';
+            return;
+        }
+        length = value.size();
+        for (size_t i = 0; i < length; ++i) {
+            name[i] = value[i];
+            folded[i] = foldChar(value[i]);
+        }
+        name[length] = '\0';
+        folded[length] = '\0';
+    }
+
+    std::string str() const { return std::string(name, valid() ? length : 0); }
+
+    const char *c_str() const { return name; }
+
+    size_t size() const { return valid() ? length : 0; }
+
+    bool empty() const { return size() == 0; }
+
+    bool valid() const { return length <= Size; }
+
+    unsigned int getHash() const { return hash; }
+
+    bool operator==(const IrcName &other) const {
+        return hash == other.hash && length == other.length && valid()
+            && memcmp(folded, other.folded, length) == 0;
+    }
+
+    bool operator!=(const IrcName &other) const { return !(*this == other); }
+
+    bool operator<(const IrcName &other) const {
+        if (hash != other.hash)
+            return hash < other.hash;
+        if (length != other.length)
+            return length < other.length;
+        return memcmp(folded, other.folded, valid() ? length : 0) < 0;
+    }
+
+    /*
+    ** rfc1459 casemapping: A-Z are lowercased and []\^ are the uppercase
+    ** forms of {}|~.
+    */
+    static char foldChar(char c) {
+        if (c >= 'A' && c <= '^')
+            return c + ('a' - 'A');
+        return c;
+    }
+};
+
+typedef IrcName<NICKLEN> NickName;
+typedef IrcName<CHANNELLEN> ChannelName;
+
+#endif
@@ -0,0 +1,63 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Link.hpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/14 10:12:41 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/14 10:12:41 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LINK_HPP
+#define LINK_HPP
+
+#include <string>
+#include <ctime>
+
+/*
+** A connection to a neighbouring ircserv. Lines written to a link are
+** appended to its output buffer and flushed once per poll tick, so a burst
+** of fan-out costs one send() per link instead of one per message.
+*/
+class Link {
+private:
+    int fd;
+    bool outgoing;
+    bool connecting;
+    bool registered;
+    std::string name;
+    std::string inbuf;
+    std::string outbuf;
+public:
+    Link(int fd, bool outgoing, bool connecting);
+    ~Link();
+    int getSocket() const;
+    bool isOutgoing() const;
+    bool isConnecting() const;
+    bool isRegistered() const;
+    std::string getName() const;
+    std::string &getInBuffer();
+    std::string &getOutBuffer();
+    bool hasPendingOutput() const;
+    void setConnecting(bool value);
+    void setRegistered(bool value);
+    void setName(const std::string &serverName);
+    void queue(const std::string &line);
+    size_t memoryUsage() const;
+};
+
+/*
+** An outbound link configured with -connect. The server retries it every
+** LINK_RETRY seconds while it is down. Both ends present secret.
+*/
+struct LinkTarget {
+    std::string host;
+    std::string port;
+    std::string secret;
+    int fd;
+    time_t nextAttempt;
+};
+
+#endif
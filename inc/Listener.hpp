@@ -0,0 +1,36 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Listener.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/27 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/27 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LISTENER_HPP
+#define LISTENER_HPP
+
+#include <string>
+
+/*
+** A socket clients connect to: the port given on the command line, plus one
+** per -listen. Clients accepted on a listener with a class (connClass >= 0)
+** get that class instead of one matched by address. path is set for Unix
+** domain sockets and unlinked on shutdown. Clients of a tls or websocket
+** listener are handed to the TlsTransport and/or the WebSocketTransport as
+** they are accepted.
+*/
+struct Listener {
+    std::string address;
+    std::string path;
+    int fd;
+    int family;
+    int connClass;
+    bool tls;
+    bool websocket;
+};
+
+#endif
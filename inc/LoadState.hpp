@@ -0,0 +1,52 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   LoadState.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/03 11:20:44 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/03 11:20:44 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef LOADSTATE_HPP
+#define LOADSTATE_HPP
+
+#include <string>
+#include <vector>
+
+/*
+** Load measured once per tick, the thresholds set with -overload and the
+** counters STATS o reports. Lag is the time one pass of the event loop
+** spent working, smoothed over the last few ticks.
+*/
+struct LoadState {
+    bool degraded;
+    long long lagLimit;
+    size_t sendqLimit;
+    size_t backlogLimit;
+    long long lag;
+    long long lagPeak;
+    size_t sendq;
+    size_t sendqPeak;
+    size_t backlog;
+    long long calmSince;
+    long long changedAt;
+    long long degradedMillis;
+    unsigned long transitions;
+    unsigned long deferredNames;
+    unsigned long coalescedNotices;
+};
+
+/*
+** A JOIN or PART held back in degraded mode, to be sent with the rest of
+** the tick's notices for the channel.
+*/
+struct PendingNotice {
+    int fd;
+    bool join;
+    std::string line;
+};
+
+#endif
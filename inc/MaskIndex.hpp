@@ -0,0 +1,62 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MaskIndex.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/31 09:26:13 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/31 09:26:13 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MASKINDEX_HPP
+#define MASKINDEX_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+struct MaskEntry {
+    std::string mask;
+    std::string setter;
+    long long time;
+};
+
+/*
+** A channel's +b, +e or +I list, compiled for matching. Masks of the form
+** *!*@host go into a table of exact hosts, or, when host is an IP address
+** or a CIDR range, into a binary trie over the 128-bit address (IPv4 as
+** ::ffff:a.b.c.d). Only the remaining masks are glob-matched one by one.
+** Everything is stored rfc1459-casefolded.
+*/
+class MaskIndex {
+private:
+    struct TrieNode {
+        int child[2];
+        unsigned int terminal;
+    };
+
+    std::vector<MaskEntry> entries;
+    std::map<std::string, unsigned int> hosts;
+    std::vector<TrieNode> trie;
+    std::vector<std::string> globs;
+
+    void compile(const std::string &mask, bool adding);
+    void updateTrie(const unsigned char *address, int bits, bool adding);
+    static bool parseAddress(const std::string &host, unsigned char *address, int &bits);
+    static bool glob(const char *pattern, const char *text);
+    static std::string fold(const std::string &text);
+public:
+    MaskIndex();
+    static std::string normalize(const std::string &mask);
+    static bool match(const std::string &pattern, const std::string &text);
+    bool add(const std::string &mask, const std::string &setter, long long when);
+    bool remove(const std::string &mask);
+    bool matches(const std::string &nickUserHost) const;
+    const std::vector<MaskEntry> &getEntries() const;
+    size_t size() const;
+    size_t memoryUsage() const;
+};
+
+#endif
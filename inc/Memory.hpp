@@ -0,0 +1,76 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Memory.hpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 10:14:26 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 10:14:26 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <deque>
+
+#define MEMORY_NODE 32
+#define MEMORY_CHUNK 16
+#define MEMORY_DEQUE_NODE 512
+
+/*
+** Bytes held by each owning structure, as counted by STATS z. buffers are
+** the shared line buffers, which send queues, replay queues and channel
+** history point into; sendq, recvq and history say how much of them (and
+** of the clients' receive buffers) each use accounts for. pools are freed
+** objects kept for reuse, bounded by OUTPUT_POOL and SHARED_POOL.
+*/
+struct MemoryStats {
+    size_t clients;
+    size_t channels;
+    size_t buffers;
+    size_t indexes;
+    size_t links;
+    size_t pools;
+    size_t sendq;
+    size_t recvq;
+    size_t history;
+    size_t bufferCount;
+};
+
+/*
+** Heap estimates for the standard containers as libstdc++ lays them out:
+** a tree node carries three pointers and a colour next to its value, a
+** deque allocates MEMORY_DEQUE_NODE bytes at a time plus a map of chunk
+** pointers, a string owns a heap block once it outgrows its inline
+** buffer, and malloc rounds every block up to MEMORY_CHUNK.
+*/
+class Memory {
+public:
+    static size_t block(size_t bytes);
+    static size_t string(const std::string &text);
+    static size_t node(size_t value);
+    static size_t deque(size_t count, size_t element);
+
+    template <typename K, typename V>
+    static size_t map(const std::map<K, V> &items) {
+        return items.size() * node(sizeof(std::pair<const K, V>));
+    }
+
+    template <typename T>
+    static size_t set(const std::set<T> &items) {
+        return items.size() * node(sizeof(T));
+    }
+
+    template <typename T>
+    static size_t vector(const std::vector<T> &items) {
+        return items.capacity() ? block(items.capacity() * sizeof(T)) : 0;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Reply.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/09 09:40:22 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/09 09:40:22 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef REPLY_HPP
+#define REPLY_HPP
+
+#include <string>
+#include <cstddef>
+#include "Client.hpp"
+
+/*
+** Every numeric the server sends. Several entries may share a code when the
+** text differs; the code and text of each live in the table in Reply.cpp,
+** which must list them in this order.
+*/
+enum ReplyId {
+    RPL_WELCOME,
+    RPL_PASSACCEPTED,
+    RPL_ISUPPORT,
+    RPL_ENDOFSTATS,
+    RPL_STATSDEBUG,
+    RPL_WHOISUSER,
+    RPL_WHOISSERVER,
+    RPL_WHOISOPERATOR,
+    RPL_ENDOFWHO,
+    RPL_ENDOFWHOIS,
+    RPL_WHOISCHANNELS,
+    RPL_LISTSTART,
+    RPL_LIST,
+    RPL_LISTEND,
+    RPL_CHANNELMODEIS,
+    RPL_INVITELIST,
+    RPL_ENDOFINVITELIST,
+    RPL_EXCEPTLIST,
+    RPL_ENDOFEXCEPTLIST,
+    RPL_NOTOPIC,
+    RPL_TOPIC,
+    RPL_INVITING,
+    RPL_WHOREPLY,
+    RPL_NAMREPLY,
+    RPL_ENDOFNAMES,
+    RPL_BANLIST,
+    RPL_ENDOFBANLIST,
+    RPL_YOUREOPER,
+    ERR_NOSUCHNICK,
+    ERR_CANNOTKICKSELF,
+    ERR_NOSUCHCHANNEL,
+    ERR_CANNOTSENDTOCHAN,
+    ERR_CANNOTSENDBANNED,
+    ERR_TOOMANYTARGETS,
+    ERR_INVALIDCAPCMD,
+    ERR_INPUTTOOLONG,
+    ERR_CHANNELNAMETOOLONG,
+    ERR_UNKNOWNCOMMAND,
+    ERR_NONICKNAMEGIVEN,
+    ERR_ERRONEUSNICKNAME,
+    ERR_NICKNAMETOOLONG,
+    ERR_NICKNAMEINUSE,
+    ERR_BANNICKCHANGE,
+    ERR_USERNOTINCHANNEL,
+    ERR_NOTONCHANNEL,
+    ERR_USERONCHANNEL,
+    ERR_NOTREGISTERED,
+    ERR_NEEDMOREPARAMS,
+    ERR_ALREADYREGISTERED,
+    ERR_PASSFIRST,
+    ERR_PASSWDMISMATCH,
+    ERR_CHANNELISFULL,
+    ERR_UNKNOWNMODE,
+    ERR_INVITEONLYCHAN,
+    ERR_BANNEDFROMCHAN,
+    ERR_MISSINGKEY,
+    ERR_BADCHANNELKEY,
+    ERR_BANLISTFULL,
+    ERR_NOPRIVILEGES,
+    ERR_CHANOPRIVSNEEDED,
+    ERR_UMODEUNKNOWNFLAG,
+    ERR_USERSDONTMATCH,
+    RPL_MONONLINE,
+    RPL_MONOFFLINE,
+    RPL_MONLIST,
+    RPL_ENDOFMONLIST,
+    ERR_MONLISTFULL,
+    REPLY_COUNT
+};
+
+/*
+** One argument of a numeric: a string, or a count formatted in place.
+** String arguments are referenced, not copied, so a ReplyArg must not
+** outlive the string it was made from.
+*/
+class ReplyArg {
+private:
+    const char *text;
+    size_t length;
+    char digits[24];
+public:
+    ReplyArg(const std::string &value);
+    ReplyArg(const NickName &value);
+    ReplyArg(const char *value);
+    ReplyArg(size_t value);
+    const char *data() const;
+    size_t size() const;
+};
+
+/*
+** Formats numerics straight into a client's send queue: the table entry's
+** text with each '%' replaced by the next argument, behind the
+** ":server NNN nick" prefix. The line is measured first and then written
+** once into the space Client::extendOutput() hands back, so no string is
+** built on the way.
+*/
+class Reply {
+public:
+    static bool send(Client &client, const std::string &server, ReplyId id, const ReplyArg *const *args, size_t count);
+    static const char *getCode(ReplyId id);
+};
+
+#endif
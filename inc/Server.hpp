@@ -24,39 +24,195 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <poll.h>
 #include <fstream>
 #include <csignal>
+#include <ctime>
+#include <cerrno>
+#include <fcntl.h>
+#include <set>
+#include <list>
+#include <deque>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/stat.h>
 #include "Client.hpp"
 #include "Channel.hpp"
+#include "Link.hpp"
+#include "IrcName.hpp"
+#include "ConnClass.hpp"
+#include "EventLoop.hpp"
+#include "Listener.hpp"
+#include "TextScan.hpp"
+#include "LoadState.hpp"
+#include "Trace.hpp"
+#include "Capture.hpp"
+#include "Transport.hpp"
+#include "TlsTransport.hpp"
+#include "WebSocketTransport.hpp"
+#include "Reply.hpp"
+#include "Bridge.hpp"
+#include "Memory.hpp"
+#include "BusyPoll.hpp"
+#include "Capability.hpp"
 
 #define DEBUG false
-#define BACKLOG 100
+#define BACKLOG SOMAXCONN
+#define ACCEPT_BATCH 64
+#define DEFER_ACCEPT 10
 #define BUFFER_SIZE 1024
+#define LINK_RETRY 5
+#define LINK_RECVQ (BUFFER_SIZE * 64)
+#define LINK_SENDQ (16 * 1024 * 1024)
+#define HISTORY_MEMORY (4 * 1024 * 1024)
+#define CHATHISTORY_MAX 100
+#define REPLAY_CHUNK 32
+#define REPLAY_WATERMARK 16384
+#define MAX_TARGETS 4
+#define SENDQ_DEFAULT (256 * 1024)
+#define RECVQ_DEFAULT 8192
+#define MAX_CLASSES 255
+#define LINES_PER_TICK 16
+#define SCAN_BATCH 64
+#define MAXLIST 2048
+#define MONITOR_MAX 100
+#define MODES_MAX 20
+#define MODE_LINE_MAX 512
+#define QUERY_ROWS 4096
+#define OVERLOAD_LAG 100
+#define OVERLOAD_SENDQ (64 * 1024 * 1024)
+#define OVERLOAD_BACKLOG 256
+#define OVERLOAD_HOLD 5000
+#define OVERLOAD_SHIFT 2
+#define OVERLOAD_CHANNEL 200
+#define TRACE_SECONDS 10
+#define BRIDGE_USERS 65536
+#define BRIDGE_LINES 1024
+#define BRIDGE_TAG_DIGITS 9
 
 class Channel;
+struct HistoryEntry;
+
+/*
+** A LIST, WHO or WHOIS in progress. resume is the last channel or nick
+** visited and member the last fd for WHO on a channel, so a cursor stays
+** valid while the tables change between ticks.
+*/
+struct QueryCursor {
+    enum Kind { LIST, WHO_CHANNEL, WHO_USERS, WHOIS, NAMES };
+    Kind kind;
+    std::string target;
+    std::vector<std::string> masks;
+    std::vector<std::string> excluded;
+    size_t minUsers;
+    size_t maxUsers;
+    bool opersOnly;
+    bool started;
+    std::string resume;
+    int member;
+    std::string pending;
+};
+
+/*
+** One channel mode change that took effect, as it is echoed back.
+*/
+struct ModeChange {
+    bool adding;
+    char mode;
+    std::string arg;
+};
 
 class Server {
 private:
-    int listener;
+    std::vector<Listener> listeners;
     std::map<int, Client *> clients;
     std::map<std::string, Client *> registeredUsers;
-    std::map<std::string, Channel *> channels;
-    std::vector<struct pollfd> pfds;
+    std::map<NickName, Client *> nicks;
+    std::map<ChannelName, Channel *> channels;
     std::string port;
     std::string password;
     bool running;
     std::ofstream logFile;
+    std::string serverName;
+    std::string linkPort;
+    std::string linkSecret;
+    int linkListener;
+    std::map<int, Link *> links;
+    std::vector<LinkTarget> linkTargets;
+    std::map<std::string, int> servers;
+    std::map<int, Client *> remoteClients;
+    int nextRemoteId;
+    std::list<Channel *> historyLru;
+    std::map<Channel *, std::list<Channel *>::iterator> historyLruPos;
+    size_t historyBytes;
+    size_t maxTargets;
+    std::vector<ConnClass> classes;
+    std::set<int> inputBacklog;
+    std::set<int> tickReaders;
+    Transport *transport;
+    TlsTransport *tls;
+    WebSocketTransport *websocket;
+    EventLoop *loop;
+    std::vector<IoEvent> events;
+    long long woke;
+    std::string ioBackend;
+    int spareFd;
+    bool acceptPaused;
+    size_t maxPerIp;
+    std::map<std::string, size_t> ipConnections;
+    int backlog;
+    int deferAccept;
+    std::map<NickName, std::set<Client *> > monitors;
+    std::map<Client *, std::set<NickName> > monitoring;
+    std::map<int, std::deque<QueryCursor> > queries;
+    bool queryBacklog;
+    LoadState load;
+    std::map<ChannelName, std::vector<PendingNotice> > notices;
+    std::map<std::string, std::string> operators;
+    std::ofstream capture;
+    std::map<int, unsigned int> captureIds;
+    unsigned int nextCaptureId;
+    long long captureStart;
+    std::map<std::string, BridgeAccount> bridgeAccounts;
+    std::map<int, Bridge> bridges;
+    BusyPollState busyPoll;
+    std::string messageTags;
+    unsigned long nextBatch;
 
-    void setupSocket();
-    void addClient(int newfd, const std::string &ip);
-    void removeClient(int fd);
-    void handleNewConnection();
+    bool openInetListener(Listener &listener);
+    bool openUnixListener(Listener &listener);
+    Listener *findListener(int fd);
+    void closeListeners();
+    void pauseAccept(bool paused);
+    Client *addClient(int newfd, const struct sockaddr *addr, int connClass);
+    void removeClient(int fd, const std::string &reason = "Connection closed");
+    void quitChannels(Client *client, const std::string &reason);
+    void startEventLoop();
+    void handleNewConnection(const Listener &listener);
+    void acceptClient(const Listener &listener, int newfd);
+    void admitConnection(int newfd, const struct sockaddr *addr, const Listener &listener);
+    void shedConnection(int listenerFd);
+    static std::string addressKey(const struct sockaddr *addr);
+    static std::string addressKey(const Client *client);
     void handleClientMessage(int client_fd);
+    void handleClientData(int client_fd, const char *data, int len);
+    bool processInput(Client *client, const char *data, size_t len);
+    void drainInput();
+    void assignConnClass(Client *client, int connClass);
     void parseCommand(Client *client, const std::string &message);
     void sendToClient(int client_fd, const std::string &message);
+    void sendNumeric(Client *client, ReplyId id);
+    void sendNumeric(Client *client, ReplyId id, const ReplyArg &a);
+    void sendNumeric(Client *client, ReplyId id, const ReplyArg &a, const ReplyArg &b);
+    void sendNumeric(Client *client, ReplyId id, const ReplyArg &a, const ReplyArg &b, const ReplyArg &c);
+    void sendNumeric(Client *client, ReplyId id, const ReplyArg *const *args, size_t count);
+    void flushClients();
+    void deleteChannel(std::map<ChannelName, Channel *>::iterator it);
+    void recordHistory(Channel *channel, const SharedBuffer &line);
+    static long long nowMillis();
     void broadcastMessage(const std::string &message, int exclude_fd = -1);
     void logMessage(const std::string &message);
     void handlePING(Client *client, const std::vector<std::string> &params);
@@ -64,20 +220,139 @@ private:
     void handleUSER(Client *client, const std::vector<std::string> &params);
     void handleNICK(Client *client, const std::vector<std::string> &params);
     void handleJOIN(Client *client, const std::vector<std::string> &params);
+    void joinChannel(Client *client, const std::string &channelName, const std::string &key);
     void handlePRIVMSG(Client *client, const std::vector<std::string> &params);
+    void handleNOTICE(Client *client, const std::vector<std::string> &params);
+    void deliverMessage(Client *client, const std::vector<std::string> &params, const std::string &command);
+    void sendWelcome(Client *client);
+    static std::vector<std::string> splitList(const std::string &list);
     void handleMODE(Client *client, const std::vector<std::string> &params);
+    void sendMaskList(Client *client, Channel *channel, char mode);
+    std::vector<ModeChange> applyChannelModes(Client *source, Channel *channel, const std::vector<std::string> &params);
+    bool applyChannelMode(Client *source, Channel *channel, ModeChange &change);
+    static std::string modeLine(const std::vector<ModeChange> &changes, size_t &next, size_t room);
+    static std::string modeLines(const std::string &head, const std::vector<ModeChange> &changes);
     void handleQUIT(Client *client, const std::vector<std::string> &params);
     void handlePART(Client *client, const std::vector<std::string> &params);
     void handleTOPIC(Client *client, const std::vector<std::string> &params);
     void handleKICK(Client *client, const std::vector<std::string> &params);
     void handleINVITE(Client *client, const std::vector<std::string> &params);
+    void handleCHATHISTORY(Client *client, const std::vector<std::string> &params);
+    void handleSTATS(Client *client, const std::vector<std::string> &params);
+    void handleOPER(Client *client, const std::vector<std::string> &params);
+    void captureEvent(CaptureType type, int fd, const char *data, size_t len);
+    void handleSPANS(Client *client, const std::vector<std::string> &params);
+    void handleBRIDGE(Client *client, const std::vector<std::string> &params);
+    void handleCAP(Client *client, const std::vector<std::string> &params);
+    void handleTAGMSG(Client *client, const std::vector<std::string> &params);
+    static std::string clientOnlyTags(const std::string &tags);
+    void replayHistory(Client *client, const std::string &target, const std::deque<HistoryEntry> &history,
+        size_t begin, size_t end);
+    void bridgeLine(Client *host, const std::string &line);
+    void closeBridge(Client *host);
+    void handleMONITOR(Client *client, const std::vector<std::string> &params);
+    void sendMonitorStatus(Client *client, const std::vector<NickName> &nicksToCheck);
+    void notifyOnline(Client *client);
+    void notifyOffline(const std::string &nick);
+    void unwatchNick(Client *client, const NickName &nick);
+    void clearMonitor(Client *client);
+    void handleLIST(Client *client, const std::vector<std::string> &params);
+    void handleWHO(Client *client, const std::vector<std::string> &params);
+    void handleWHOIS(Client *client, const std::vector<std::string> &params);
+    void startQuery(Client *client, QueryCursor &cursor);
+    void advanceQueries();
+    bool hasPendingQuery(int fd) const;
+    bool stepQuery(Client *client, QueryCursor &cursor, size_t &rows);
+    bool listMatches(const QueryCursor &cursor, Channel *channel) const;
+    void addName(Client *client, QueryCursor &cursor, const std::string &name);
+    void sendWhoReply(Client *client, const std::string &channel, Client *user, bool channelOp);
+    static long long monotonicMicros();
+    void measureLoad(long long busyMicros);
+    size_t budget(size_t normal) const;
+    void channelNotice(Channel *channel, Client *client, const std::string &line, bool join);
+    void flushNotices();
+    void flushNotices(Channel *channel);
+    bool dropNotices(Channel *channel, int fd);
+    void sendNotices(Channel *channel, const std::vector<PendingNotice> &pending);
+    void sendNames(Client *client, Channel *channel);
+    void sendLoadStats(Client *client);
+    void accountMemory(MemoryStats &stats) const;
+    void sendMemoryStats(Client *client);
+    void pinReactor();
+    void tuneSocket(int fd);
+    int waitEvents(int timeout);
+    void sendBusyPollStats(Client *client);
+    Client *findClientByNick(const NickName &nick);
+    void setClientNick(Client *client, const std::string &nick);
+    void setPollEvents(int fd, short events);
+    void removePollFd(int fd);
+
+    void setupLinkSocket();
+    void handleNewLink();
+    void connectLinks();
+    void handleLinkEvent(int link_fd, short revents);
+    void handleLinkMessage(Link *link);
+    void flushLinks();
+    void removeLink(int link_fd, const std::string &reason);
+    void parseLinkCommand(Link *link, const std::string &line);
+    void registerLink(Link *link, const std::string &name);
+    const std::string &linkSecretFor(const Link *link) const;
+    Client *findLinkClient(const Link *link, const std::string &nick);
+    void sendBurst(Link *link);
+    void introduceClient(Client *client);
+    void propagate(const std::string &line, int exclude_link = -1);
+    void routeToChannel(Channel *channel, const std::string &line, int exclude_link = -1);
+    void routeToClient(Client *target, const std::string &line);
+    void quitRemoteClient(Client *client, const std::string &reason);
+    void linkSERVER(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkSID(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkSQUIT(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkUID(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkSJOIN(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkSTOPIC(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkEOB(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkNICK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkJOIN(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkPART(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void relayMessage(Link *link, const std::string &source, const std::vector<std::string> &params,
+        const std::string &line, const std::string &command);
+    void linkNOTICE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkPRIVMSG(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkBMASK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkMODE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkTOPIC(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkKICK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkQUIT(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkKILL(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkINVITE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
+    void linkPING(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line);
 public:
-    Server(const std::string &port, const std::string &password);
+    Server(const std::string &port, const std::string &password, Transport *transport = NULL);
     ~Server();
     void shutdownServer();
     void run();
+    void start();
+    void tick();
+    void setServerName(const std::string &name);
+    void setLinkPort(const std::string &port, const std::string &secret);
+    void addLinkTarget(const std::string &host, const std::string &port, const std::string &secret);
+    void setMaxTargets(size_t targets);
+    bool setIoBackend(const std::string &backend);
+    void setBacklog(int backlog);
+    void setDeferAccept(int seconds);
+    void setMaxPerIp(size_t connections);
+    bool addListener(const std::string &spec);
+    bool setOverloadLimits(const std::string &spec);
+    bool addOperator(const std::string &spec);
+    bool setCapture(const std::string &path);
+    bool setTls(const std::string &spec);
+    bool addBridge(const std::string &spec);
+    bool setBusyPoll(const std::string &spec);
+    void addConnClass(const std::string &name, size_t sendq, size_t recvq, const std::string &mask);
 };
 
 typedef void (Server::*t_handlers)(Client *client, const std::vector<std::string> &params);
+typedef void (Server::*t_link_handlers)(Link *link, const std::string &source,
+    const std::vector<std::string> &params, const std::string &line);
 
 #endif
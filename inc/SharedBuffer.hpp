@@ -0,0 +1,65 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   SharedBuffer.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/17 09:41:03 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/17 09:41:03 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef SHAREDBUFFER_HPP
+#define SHAREDBUFFER_HPP
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+#define SHARED_BLOCK 2048
+#define SHARED_POOL 256
+
+/*
+** Immutable, reference-counted wire line. A channel message is serialized
+** once and the same bytes are handed to every recipient's send queue and to
+** the channel history; copying a SharedBuffer only bumps a counter.
+**
+** A writable buffer is the exception: it is filled in place by extend()
+** for as long as nobody else holds it and its capacity lasts, and its
+** block goes back to a pool when released, so replies written into one
+** cost no allocation once the pool is warm.
+*/
+class SharedBuffer {
+private:
+    struct Block {
+        int refs;
+        bool writable;
+        std::string bytes;
+    };
+    Block *block;
+    static std::vector<Block *> pool;
+    static size_t blocks;
+    static size_t bytes;
+
+    void release();
+    static size_t footprint(const Block *block);
+    static void destroy(Block *block);
+public:
+    SharedBuffer();
+    SharedBuffer(const std::string &bytes);
+    SharedBuffer(const SharedBuffer &other);
+    SharedBuffer &operator=(const SharedBuffer &other);
+    ~SharedBuffer();
+    const char *data() const;
+    size_t size() const;
+    bool empty() const;
+    const std::string &str() const;
+    char *extend(size_t len);
+    static SharedBuffer writable(size_t capacity);
+    static size_t getBlockCount();
+    static size_t getAllocated();
+    static size_t getPooled();
+};
+
+#endif
@@ -0,0 +1,55 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TextScan.hpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/28 10:17:44 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/28 10:17:44 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TEXTSCAN_HPP
+#define TEXTSCAN_HPP
+
+#include <string>
+#include <cstddef>
+
+/*
+** Bulk scans over received text. Each scan has a scalar, an SSE2 and an AVX2
+** version; the widest one the CPU supports is picked at startup, and select()
+** forces another (for benchmarks).
+**
+** findBreaks() stores the offsets of every CR, LF and NUL in data, at most
+** max of them, and returns how many it stored. When it returns max the
+** caller resumes after the last offset.
+**
+** unmask() copies len bytes of a WebSocket payload from src to dst, XORed
+** with the 4-byte masking key; phase is the payload offset of src, so a
+** payload split across reads is unmasked piece by piece. dst may be src.
+*/
+class TextScan {
+public:
+    static size_t findBreaks(const char *data, size_t len, size_t *positions, size_t max);
+    static bool isUtf8(const char *data, size_t len);
+    static void unmask(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase);
+    static const char *getName();
+    static bool select(const std::string &name);
+
+private:
+    struct Impl {
+        const char *name;
+        size_t (*findBreaks)(const char *data, size_t len, size_t *positions, size_t max);
+        bool (*isUtf8)(const char *data, size_t len);
+        void (*unmask)(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase);
+        bool (*supported)();
+    };
+
+    static const Impl impls[];
+    static const Impl *current;
+
+    static const Impl *detect();
+};
+
+#endif
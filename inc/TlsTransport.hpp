@@ -0,0 +1,84 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TlsTransport.hpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/10 09:21:36 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/10 09:21:36 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TLSTRANSPORT_HPP
+#define TLSTRANSPORT_HPP
+
+#include <string>
+#include <map>
+#include <openssl/ssl.h>
+#include "Transport.hpp"
+
+#define TLS_SESSION_CACHE 20480
+#define TLS_RECORD 16384
+
+/*
+** One connection accepted on a TLS listener. retry is the length of a
+** write OpenSSL could not finish; it has to be offered the same bytes again.
+** ktls is set when the kernel took over record encryption for sending.
+*/
+struct TlsSession {
+    SSL *ssl;
+    bool established;
+    bool broken;
+    bool ktls;
+    size_t retry;
+};
+
+struct TlsStats {
+    size_t handshakes;
+    size_t resumed;
+    size_t failed;
+    size_t ktls;
+};
+
+/*
+** TLS on top of another transport. Connections handed to accept() are
+** encrypted; every other descriptor goes straight to the inner transport.
+** Handshakes advance from receive() and send() without blocking. Once a
+** handshake is done and the kernel accepted kTLS for sending, writes go
+** through the inner transport and the event loop's batch like plain
+** sockets; otherwise they are encrypted here, one record per send().
+** Clients resume with a session ticket or from the server-side session
+** cache, both kept by the SSL_CTX.
+*/
+class TlsTransport : public Transport {
+private:
+    Transport *inner;
+    SSL_CTX *context;
+    std::map<int, TlsSession> sessions;
+    TlsStats stats;
+    std::string name;
+
+    ssize_t handshake(TlsSession &session);
+    ssize_t result(TlsSession &session, int ret);
+public:
+    TlsTransport(Transport *inner, const std::string &certificate, const std::string &key);
+    ~TlsTransport();
+    const char *getName() const;
+    ssize_t receive(int fd, char *buffer, size_t len);
+    ssize_t send(int fd, const struct iovec *iov, size_t count);
+    void release(int fd);
+    bool peerName(int fd, struct sockaddr *addr, socklen_t *len);
+    int openListener();
+    EventLoop *createLoop();
+    bool readsDirect(int fd);
+    size_t pending(int fd);
+    void sendBatch(EventLoop &loop, std::vector<SendRequest> &batch);
+
+    bool accept(int fd);
+    const TlsStats &getStats() const;
+    size_t getSessionCount() const;
+    size_t getCachedSessions() const;
+};
+
+#endif
@@ -0,0 +1,84 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Trace.hpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/04 09:51:36 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/04 09:51:36 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <string>
+#include <vector>
+
+#define TRACE_RING 65536
+
+struct TraceRecord {
+    const char *name;
+    const char *argName;
+    long long begin;
+    long long end;
+    long arg;
+};
+
+/*
+** Span tracing for tail-latency analysis. Each thread that records gets its
+** own ring of the last TRACE_RING spans, so recording never locks. Names are
+** string literals and are stored as pointers. dump() writes the spans of the
+** last few seconds in Chrome trace format, for chrome://tracing or Perfetto.
+*/
+class Trace {
+private:
+    struct Ring {
+        std::vector<TraceRecord> records;
+        size_t next;
+        size_t count;
+        int tid;
+    };
+    static std::vector<Ring *> rings;
+    static __thread Ring *local;
+    static bool enabled;
+
+    static Ring *threadRing();
+public:
+    static bool isEnabled() { return enabled; }
+    static void enable(bool on);
+    static long long now();
+    static void record(const char *name, long long begin, long long end, const char *argName, long arg);
+    static size_t dump(const std::string &path, int seconds);
+};
+
+/*
+** Records the enclosing scope. When tracing is off the constructor reads one
+** flag and nothing else happens.
+*/
+class TraceSpan {
+private:
+    const char *name;
+    const char *argName;
+    long long begin;
+    long arg;
+
+    TraceSpan(const TraceSpan &other);
+    TraceSpan &operator=(const TraceSpan &other);
+public:
+    explicit TraceSpan(const char *spanName) : name(spanName), argName(NULL), begin(0), arg(0) {
+        if (Trace::isEnabled())
+            begin = Trace::now();
+    }
+    ~TraceSpan() {
+        if (begin)
+            Trace::record(name, begin, Trace::now(), argName, arg);
+    }
+    void setArg(const char *key, long value) {
+        argName = key;
+        arg = value;
+    }
+};
+
+#endif
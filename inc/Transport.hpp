@@ -0,0 +1,129 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Transport.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/08 09:14:06 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/08 09:14:06 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef TRANSPORT_HPP
+#define TRANSPORT_HPP
+
+#include <string>
+#include <map>
+#include <deque>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "EventLoop.hpp"
+
+#define MEMORY_FD_BASE 0x40000000
+
+/*
+** Moves client bytes for the server: receive() and send() return the byte
+** count or -errno like the system calls they stand for, and release() ends
+** the connection. A transport that brings its own event source returns it
+** from createLoop(); NULL means the -io backend drives real sockets.
+** openListener() returns -1 when the transport has no "memory" listener.
+** A transport that keeps state of its own for a connection says so with
+** readsDirect() (false: the loop must not receive on fd itself), pending()
+** (bytes it already holds for the next receive()) and sendBatch().
+*/
+class Transport {
+public:
+    virtual ~Transport();
+    virtual const char *getName() const = 0;
+    virtual ssize_t receive(int fd, char *buffer, size_t len) = 0;
+    virtual ssize_t send(int fd, const struct iovec *iov, size_t count) = 0;
+    virtual void release(int fd) = 0;
+    virtual bool peerName(int fd, struct sockaddr *addr, socklen_t *len);
+    virtual int openListener();
+    virtual EventLoop *createLoop();
+    virtual bool readsDirect(int fd);
+    virtual size_t pending(int fd);
+    virtual void sendBatch(EventLoop &loop, std::vector<SendRequest> &batch);
+protected:
+    void splitBatch(Transport &inner, EventLoop &loop, std::vector<SendRequest> &batch, const std::vector<size_t> &own);
+};
+
+class SocketTransport : public Transport {
+public:
+    const char *getName() const;
+    ssize_t receive(int fd, char *buffer, size_t len);
+    ssize_t send(int fd, const struct iovec *iov, size_t count);
+    void release(int fd);
+    bool peerName(int fd, struct sockaddr *addr, socklen_t *len);
+};
+
+/*
+** One in-process connection: what the driver wrote and the server has not
+** read yet, and what the server sent and the driver has not read yet.
+*/
+struct MemoryEndpoint {
+    std::string toServer;
+    std::string fromServer;
+    bool hungUp;
+    bool released;
+};
+
+/*
+** Connections without a kernel in between, for driving the whole command
+** pipeline from a benchmark or a test. Descriptors start at MEMORY_FD_BASE
+** so they can never be mistaken for real ones. The driver side is
+** connect()/write()/read()/hangup(); a connection is accepted by the server
+** on its next tick. Nothing here depends on time, so the same script
+** produces the same output on every run.
+*/
+class MemoryTransport : public Transport {
+private:
+    std::map<int, MemoryEndpoint> endpoints;
+    std::deque<int> accepts;
+    int listenerFd;
+    int nextFd;
+    size_t sent;
+    size_t received;
+public:
+    MemoryTransport();
+    const char *getName() const;
+    ssize_t receive(int fd, char *buffer, size_t len);
+    ssize_t send(int fd, const struct iovec *iov, size_t count);
+    void release(int fd);
+    bool peerName(int fd, struct sockaddr *addr, socklen_t *len);
+    int openListener();
+    EventLoop *createLoop();
+
+    int connect();
+    void write(int fd, const std::string &data);
+    size_t read(int fd, std::string &data);
+    void hangup(int fd);
+    bool isReleased(int fd) const;
+    size_t getBytesSent() const;
+    size_t getBytesReceived() const;
+
+    void collect(const std::map<int, short> &interest, std::vector<IoEvent> &events);
+};
+
+/*
+** Event source for a MemoryTransport: pending connections come out as
+** IO_ACCEPT on the memory listener and readable endpoints as IO_READY, so
+** the server reads them through the transport like sockets. wait() never
+** blocks.
+*/
+class MemoryLoop : public EventLoop {
+private:
+    MemoryTransport &transport;
+    std::map<int, short> interest;
+public:
+    explicit MemoryLoop(MemoryTransport &transport);
+    const char *getName() const;
+    void setEvents(int fd, short events);
+    void remove(int fd);
+    int wait(std::vector<IoEvent> &events, int timeout);
+    void sendBatch(std::vector<SendRequest> &batch);
+};
+
+#endif
@@ -0,0 +1,102 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringLoop.hpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/26 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/26 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef URINGLOOP_HPP
+#define URINGLOOP_HPP
+
+#include "EventLoop.hpp"
+#include <linux/io_uring.h>
+
+#define URING_ENTRIES 1024
+#define URING_BUFFERS 1024
+#define URING_BUFFER_SIZE 2048
+
+/*
+** io_uring backend, driven through the raw syscalls. Listeners use one
+** multishot accept and clients one multishot recv that picks its buffers
+** from a ring of URING_BUFFERS provided buffers; a buffer is handed back to
+** the kernel on the wait() after it was delivered. Other fds and POLLOUT are
+** watched with one-shot polls that are re-armed as long as they are wanted.
+** sendBatch() submits a whole flush as SENDMSG operations with one
+** io_uring_enter().
+*/
+class UringLoop : public EventLoop {
+private:
+    enum {
+        OP_POLL = 1,
+        OP_ACCEPT,
+        OP_RECV,
+        OP_SEND,
+        OP_CANCEL
+    };
+    struct Watch {
+        unsigned int generation;
+        short wanted;
+        short polled;
+        bool active;
+        bool accept;
+        bool receive;
+        bool pollCancelled;
+        bool multishotArmed;
+        bool multishotCancelled;
+        bool dirty;
+    };
+    int ringFd;
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    struct io_uring_sqe *sqes;
+    size_t sqesSize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    struct io_uring_cqe *cqes;
+    struct io_uring_buf_ring *bufRing;
+    size_t bufRingSize;
+    char *buffers;
+    unsigned short bufTail;
+    std::vector<Watch> watches;
+    std::vector<int> dirty;
+    std::vector<unsigned short> delivered;
+    std::vector<struct io_uring_cqe> deferred;
+
+    UringLoop(const UringLoop &other);
+    UringLoop &operator=(const UringLoop &other);
+    Watch &watch(int fd);
+    void markDirty(int fd);
+    struct io_uring_sqe *getSqe();
+    int enter(unsigned minComplete, int timeout);
+    void cancel(unsigned long long userData);
+    void arm(int fd);
+    void recycleBuffers();
+    void handleCqe(const struct io_uring_cqe &cqe, std::vector<IoEvent> &events);
+    static unsigned long long userData(int op, int fd, unsigned int generation);
+public:
+    UringLoop();
+    ~UringLoop();
+    const char *getName() const;
+    void setEvents(int fd, short events);
+    void remove(int fd);
+    int wait(std::vector<IoEvent> &events, int timeout);
+    bool acceptMultishot(int fd);
+    bool recvMultishot(int fd);
+    void sendBatch(std::vector<SendRequest> &batch);
+};
+
+#endif
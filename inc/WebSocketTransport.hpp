@@ -0,0 +1,94 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   WebSocketTransport.hpp                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/11 09:44:08 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/11 09:44:08 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#ifndef WEBSOCKETTRANSPORT_HPP
+#define WEBSOCKETTRANSPORT_HPP
+
+#include <string>
+#include <map>
+#include "Transport.hpp"
+
+#define WS_REQUEST_MAX 4096
+#define WS_FRAME_MAX 16384
+#define WS_IOV 1024
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/*
+** One connection accepted on a WebSocket listener. Until the upgrade
+** request is complete, request collects it. header holds a frame header
+** split across reads; remaining and phase follow the payload of the frame
+** being read. control holds pong and close frames not sent yet, and partial
+** the bytes of the first queued frame the socket already took.
+*/
+struct WebSocketSession {
+    bool open;
+    bool binary;
+    bool closing;
+    std::string request;
+    unsigned char header[14];
+    size_t headerLen;
+    bool inPayload;
+    unsigned char opcode;
+    bool fin;
+    unsigned char key[4];
+    size_t remaining;
+    size_t phase;
+    std::string controlPayload;
+    std::string control;
+    size_t partial;
+};
+
+/*
+** RFC 6455 on top of another transport, for web clients. Connections
+** handed to accept() start with the HTTP upgrade; after it, receive()
+** returns the payload of every data frame followed by CRLF, unmasked with
+** TextScan::unmask(), so the server's line parser sees plain IRC lines.
+** send() turns every queued line into one unmasked frame: a header of a few
+** bytes next to the line itself, which stays in the shared buffer it was
+** queued in. The "binary.ircv3.net" and "text.ircv3.net" subprotocols
+** pick the frame type; text is the default. Other descriptors go straight
+** to the inner transport.
+*/
+class WebSocketTransport : public Transport {
+private:
+    Transport *inner;
+    std::map<int, WebSocketSession> sessions;
+    std::string name;
+    size_t upgrades;
+
+    ssize_t upgrade(int fd, WebSocketSession &session, char *buffer, size_t len);
+    ssize_t decode(WebSocketSession &session, const char *wire, size_t n, char *buffer);
+    static size_t headerSize(const WebSocketSession &session);
+    bool parseHeader(WebSocketSession &session);
+    void endFrame(WebSocketSession &session, char *buffer, size_t &out);
+    ssize_t flushControl(int fd, WebSocketSession &session);
+    static size_t frameHeader(unsigned char *header, unsigned char opcode, size_t len);
+public:
+    explicit WebSocketTransport(Transport *inner);
+    ~WebSocketTransport();
+    const char *getName() const;
+    ssize_t receive(int fd, char *buffer, size_t len);
+    ssize_t send(int fd, const struct iovec *iov, size_t count);
+    void release(int fd);
+    bool peerName(int fd, struct sockaddr *addr, socklen_t *len);
+    int openListener();
+    EventLoop *createLoop();
+    bool readsDirect(int fd);
+    size_t pending(int fd);
+    void sendBatch(EventLoop &loop, std::vector<SendRequest> &batch);
+
+    void accept(int fd);
+    size_t getSessionCount() const;
+    size_t getUpgrades() const;
+};
+
+#endif
@@ -0,0 +1,119 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Capability.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 16:05:47 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 16:05:47 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Capability.hpp"
+#include <cstdio>
+#include <ctime>
+
+/*
+** In the order CAP LS lists them; entry i is bit 1 << i.
+*/
+static const char *const capNames[CAP_COUNT] = {"server-time", "message-tags", "echo-message", "batch"};
+
+unsigned char Capability::parse(const std::string &name) {
+    for (size_t i = 0; i < CAP_COUNT; ++i)
+        if (name == capNames[i])
+            return 1 << i;
+    return 0;
+}
+
+std::string Capability::list(unsigned char caps) {
+    std::string names;
+
+    for (size_t i = 0; i < CAP_COUNT; ++i) {
+        if (!(caps & (1 << i)))
+            continue;
+        if (!names.empty())
+            names += ' ';
+        names += capNames[i];
+    }
+    return names;
+}
+
+long long ServerTime::millis = 0;
+long long ServerTime::formatted = -1;
+std::string ServerTime::text;
+
+void ServerTime::tick() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    millis = ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+long long ServerTime::now() { return millis; }
+
+const std::string &ServerTime::get() {
+    if (formatted != millis) {
+        text = format(millis);
+        formatted = millis;
+    }
+    return text;
+}
+
+/*
+** ISO 8601 in UTC with milliseconds, as server-time wants it.
+*/
+std::string ServerTime::format(long long when) {
+    time_t seconds = when / 1000;
+    struct tm utc;
+    char buffer[32];
+
+    gmtime_r(&seconds, &utc);
+    size_t len = strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &utc);
+    snprintf(buffer + len, sizeof(buffer) - len, ".%03dZ", static_cast<int>(when % 1000));
+    return buffer;
+}
+
+TaggedLine::TaggedLine(const SharedBuffer &plain, const std::string &clientTags)
+    : clientTags(clientTags), time(ServerTime::now()) {
+    variants[0] = plain;
+}
+
+size_t TaggedLine::variant(unsigned char caps) const {
+    return ((caps & CAP_SERVER_TIME) ? 1 : 0) | ((caps & CAP_MESSAGE_TAGS) && !clientTags.empty() ? 2 : 0);
+}
+
+const SharedBuffer &TaggedLine::forCaps(unsigned char caps) {
+    size_t index = variant(caps);
+
+    if (variants[index].empty()) {
+        std::string tags;
+        if (index & 1)
+            tags = "time=" + (time == ServerTime::now() ? ServerTime::get() : ServerTime::format(time));
+        if (index & 2)
+            tags += (tags.empty() ? "" : ";") + clientTags;
+        variants[index] = SharedBuffer(tagged(tags, variants[0]));
+    }
+    return variants[index];
+}
+
+const SharedBuffer &TaggedLine::plain() const { return variants[0]; }
+
+/*
+** Puts the tags in front of every line of the buffer; a coalesced buffer
+** of JOINs and PARTs holds several.
+*/
+std::string TaggedLine::tagged(const std::string &tags, const SharedBuffer &line) {
+    const std::string &text = line.str();
+    std::string out;
+    std::string::size_type start = 0;
+
+    out.reserve(tags.size() + text.size() + 2);
+    while (start < text.size()) {
+        std::string::size_type end = text.find('\n', start);
+        end = end == std::string::npos ? text.size() : end + 1;
+        out.append("@").append(tags).append(" ").append(text, start, end - start);
+        start = end;
+    }
+    return out;
+}
@@ -11,14 +11,15 @@
 /* ************************************************************************** */
 
 #include "../inc/Channel.hpp"
+#include "../inc/Memory.hpp"
 
-Channel::Channel(const std::string &channelName) : name(channelName) {
-    log("Channel created: " + name);
+Channel::Channel(const std::string &channelName) : name(channelName), userLimit(0), historyBytes(0) {
+    log("Channel created: " + name.str());
 }
 
 void Channel::log(const std::string &msg) const {
     if (DEBUG)
-        std::cout << "DEBUG: [Channel: " << name << "] " << msg << std::endl;
+        std::cout << "DEBUG: [Channel: " << name.str() << "] " << msg << std::endl;
 }
 
 void Channel::setTopic(const std::string &newTopic) {
@@ -32,9 +33,10 @@ std::string Channel::getTopic() const {
 
 void Channel::addUser(Client *client) {
     if (DEBUG)
-        std::cout << "DEBUG: Adding user: " << client->getNickName() << " (FD: " << client->getSocket() << ") to channel: " << name << std::endl;
+        std::cout << "DEBUG: Adding user: " << client->getNickName() << " (FD: " << client->getSocket() << ") to channel: " << name.str() << std::endl;
 
     users[client->getSocket()] = client;
+    invited.erase(client->getSocket());
     if (users.size() == 1) {
         if (DEBUG)
             std::cout << "DEBUG: First user in channel, making operator..." << std::endl;
@@ -43,12 +45,14 @@ void Channel::addUser(Client *client) {
 }
 
 void Channel::removeUser(int clientFd) {
+    invited.erase(clientFd);
     std::map<int, Client *>::iterator it = users.find(clientFd);
     if (it != users.end()) {
         std::string nickname = it->second ? it->second->getNickName() : "(unknown)";
         log(it->second->getNickName() + " left channel.");
         users.erase(it);
         operators.erase(clientFd);
+        banVerdicts.erase(clientFd);
     }
     if (DEBUG) {
         std::cout << "DEBUG: Remaining users in channel: ";
@@ -63,8 +67,9 @@ bool Channel::isUserInChannel(int clientFd) const {
     return users.find(clientFd) != users.end();
 }
 Client *Channel::getUserByNick(const std::string &nickname) const {
+    NickName key(nickname);
     for (std::map<int, Client *>::const_iterator it = users.begin(); it != users.end(); ++it) {
-        if (it->second->getNickName() == nickname) {
+        if (it->second->getNick() == key) {
             return it->second;
         }
     }
@@ -108,24 +113,41 @@ void Channel::removeOperator(int clientFd) {
 }
 
 void Channel::broadcastMessage(const std::string &message, int senderFd) {
+    broadcastMessage(SharedBuffer(message), senderFd);
+}
+
+void Channel::broadcastMessage(const SharedBuffer &message, int senderFd) {
+    TaggedLine line(message);
+    broadcastMessage(line, senderFd);
+}
+
+/*
+** With requiredCaps, members lacking any of them are skipped (TAGMSG only
+** goes to clients with message-tags).
+*/
+void Channel::broadcastMessage(TaggedLine &message, int senderFd, unsigned char requiredCaps) {
     std::map<int, Client *>::iterator senderIt = users.find(senderFd);
     if (senderIt == users.end()) {
         return;
-    }       
-    std::string joinMessage = message;
+    }
+    Fanout fanout(message);
     for (std::map<int, Client *>::iterator it = users.begin(); it != users.end(); ++it) {
-        if (it->first != senderFd)
-            if (send(it->first, joinMessage.c_str(), joinMessage.size(), 0) < 0)
-                log("Error sending message to " + it->second->getNickName());
+        if (it->first != senderFd && !it->second->isRemote()
+            && (it->second->getCaps() & requiredCaps) == requiredCaps)
+            fanout.add(it->second);
     }
+    fanout.send();
 }
 
 void Channel::broadcastToOps(const std::string &message) {
+    TaggedLine line((SharedBuffer(message)));
+    Fanout fanout(line);
     for (std::map<int, bool>::iterator it = operators.begin(); it != operators.end(); ++it) {
-        if (it->second) {
-            send(it->first, message.c_str(), message.size(), 0);
+        if (it->second && !users[it->first]->isRemote()) {
+            fanout.add(users[it->first]);
         }
     }
+    fanout.send();
 }
 
 std::vector<std::string> Channel::listUsers() const {
@@ -137,7 +159,11 @@ std::vector<std::string> Channel::listUsers() const {
     return userList;
 }
 
-std::string Channel::getName() const { return (name); }
+const std::map<int, Client *> &Channel::getUsers() const { return users; }
+
+std::string Channel::getName() const { return (name.str()); }
+
+const ChannelName &Channel::getKey() const { return (name); }
 
 bool Channel::hasMode(char mode) const {
     std::map<char, bool>::const_iterator it = modes.find(mode);
@@ -194,7 +220,7 @@ void Channel::kickUser(int operatorFd, const std::string &targetNick, const std:
     }
     int targetFd = targetClient->getSocket();
     std::string KickMessage = ":" + users[operatorFd]->getNickName() +
-        " KICK #" + name + " " + targetNick + " :" + reason + "\r\n";
+        " KICK #" + name.str() + " " + targetNick + " :" + reason + "\r\n";
 
     broadcastMessage(KickMessage, -1);
     removeUser(targetFd);
@@ -205,9 +231,17 @@ void Channel::inviteUser(Client *operatorClient, Client *targetClient) {
         log("Error: Only channel operators can invite users.");
         return;
     }
-    targetClient->addChannelInvite(name);
+    addInvite(targetClient->getSocket());
 }
 
+/*
+** Invites are kept on the channel, keyed by client id, rather than as a list
+** of names on every client. removeUser() clears them when the client leaves.
+*/
+void Channel::addInvite(int clientFd) { invited.insert(clientFd); }
+
+bool Channel::isInvited(int clientFd) const { return invited.find(clientFd) != invited.end(); }
+
 void Channel::setPassword(const std::string &pass) {
     if (!pass.empty()) {
         password = pass;
@@ -226,3 +260,107 @@ std::string Channel::getPassword() const {
     return (password);
 }
 
+
+/*
+** Appends a line to the history ring, dropping the oldest entry once the
+** ring holds HISTORY_LEN lines. Returns the change in bytes held.
+*/
+long Channel::addHistory(const SharedBuffer &line, long long when) {
+    long delta = line.size();
+    HistoryEntry entry;
+    entry.time = when;
+    entry.line = line;
+    history.push_back(entry);
+    historyBytes += line.size();
+    if (history.size() > HISTORY_LEN)
+        delta -= evictHistory();
+    return delta;
+}
+
+size_t Channel::evictHistory() {
+    if (history.empty())
+        return 0;
+    size_t freed = history.front().line.size();
+    history.pop_front();
+    historyBytes -= freed;
+    return freed;
+}
+
+void Channel::clearHistory() {
+    history.clear();
+    historyBytes = 0;
+}
+
+const std::deque<HistoryEntry> &Channel::getHistory() const { return history; }
+
+size_t Channel::getHistoryBytes() const { return historyBytes; }
+
+/*
+** The +b, +e and +I lists. Changing +b or +e drops every cached verdict.
+*/
+MaskIndex *Channel::getMaskList(char mode) {
+    if (mode == 'b')
+        return &bans;
+    if (mode == 'e')
+        return &exceptions;
+    if (mode == 'I')
+        return &inviteExceptions;
+    return NULL;
+}
+
+bool Channel::addMask(char mode, const std::string &mask, const std::string &setter, long long when) {
+    MaskIndex *list = getMaskList(mode);
+    if (!list || !list->add(mask, setter, when))
+        return false;
+    if (mode != 'I')
+        banVerdicts.clear();
+    return true;
+}
+
+bool Channel::removeMask(char mode, const std::string &mask) {
+    MaskIndex *list = getMaskList(mode);
+    if (!list || !list->remove(mask))
+        return false;
+    if (mode != 'I')
+        banVerdicts.clear();
+    return true;
+}
+
+/*
+** Banned means matched by +b and not by +e. The verdict is cached per
+** member until the lists change or the member changes nick, so a busy
+** channel pays for the match once per member, not once per message.
+*/
+bool Channel::isBanned(const Client *client) {
+    int fd = client->getSocket();
+    bool member = isUserInChannel(fd);
+
+    if (member) {
+        std::map<int, bool>::iterator it = banVerdicts.find(fd);
+        if (it != banVerdicts.end())
+            return it->second;
+    }
+    std::string mask = client->getHostname();
+    bool banned = bans.matches(mask) && !exceptions.matches(mask);
+    if (member)
+        banVerdicts[fd] = banned;
+    return banned;
+}
+
+bool Channel::isInviteExempt(const Client *client) const {
+    return inviteExceptions.matches(client->getHostname());
+}
+
+void Channel::forgetBanVerdict(int clientFd) {
+    banVerdicts.erase(clientFd);
+}
+
+/*
+** The history's lines are counted with the shared buffers.
+*/
+size_t Channel::memoryUsage() const {
+    return Memory::block(sizeof(Channel)) + Memory::string(topic) + Memory::string(password)
+        + Memory::map(users) + Memory::map(operators) + Memory::set(invited) + Memory::map(modes)
+        + Memory::map(banVerdicts) + Memory::deque(history.size(), sizeof(HistoryEntry))
+        + bans.memoryUsage() + exceptions.memoryUsage() + inviteExceptions.memoryUsage();
+}
@@ -6,80 +6,145 @@
 /*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
 /*                                                +#+#+#+#+#+   +#+           */
 /*   Created: 2025/02/27 10:25:59 by rtorres           #+#    #+#             */
-/*   Updated: 2025/03/11 10:05:28 by rtorres          ###   ########.fr       */
+/*   Updated: 2025/03/21 11:37:50 by rtorres          ###   ########.fr       */
 /*                                                                            */
 /* ************************************************************************** */
 
 #include "../inc/Client.hpp"
+#include "../inc/Memory.hpp"
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
 
 Client::Client() 
-    : fd(-1), isOperator(false), registered(false), authenticated(false), logedin(false) {}
+    : fd(-1), uplink(-1), bridge(NULL), tag(0), flags(0), caps(0), family(AF_UNSPEC), connClass(0), sendqLimit(0), recvqLimit(0),
+      input(NULL), output(NULL) {
+    memset(address, 0, sizeof(address));
+    username[0] = '\0';
+    updatePrefix("unknown.host");
+}
 
-Client::Client(int fd, const std::string &ip) 
-    : fd(fd), isOperator(false), registered(false), authenticated(false), logedin(false), ipadd(ip) {
-        if (ipadd.empty())
-            ipadd = "unknown.host";
-    }
+Client::Client(int fd, const struct sockaddr *addr)
+    : fd(fd), uplink(-1), bridge(NULL), tag(0), flags(0), caps(0), family(AF_UNSPEC), connClass(0), sendqLimit(0), recvqLimit(0),
+      input(NULL), output(NULL) {
+    char host[INET6_ADDRSTRLEN];
 
-Client::~Client() {}
+    memset(address, 0, sizeof(address));
+    username[0] = '\0';
+    if (addr && addr->sa_family == AF_INET) {
+        const struct sockaddr_in *in = reinterpret_cast<const struct sockaddr_in *>(addr);
+        family = AF_INET;
+        memcpy(address, &in->sin_addr, sizeof(in->sin_addr));
+    } else if (addr && addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = reinterpret_cast<const struct sockaddr_in6 *>(addr);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr)) {
+            family = AF_INET;
+            memcpy(address, in6->sin6_addr.s6_addr + 12, 4);
+        } else {
+            family = AF_INET6;
+            memcpy(address, &in6->sin6_addr, sizeof(in6->sin6_addr));
+        }
+    } else if (addr && addr->sa_family == AF_UNIX)
+        family = AF_UNIX;
+    if (family == AF_UNIX)
+        updatePrefix("localhost");
+    else if (family != AF_UNSPEC && inet_ntop(family, address, host, sizeof(host)))
+        updatePrefix(host);
+    else
+        updatePrefix("unknown.host");
+}
+
+Client::Client(int fd, const std::string &host)
+    : fd(fd), uplink(-1), bridge(NULL), tag(0), flags(0), caps(0), family(AF_UNSPEC), connClass(0), sendqLimit(0), recvqLimit(0),
+      input(NULL), output(NULL) {
+    memset(address, 0, sizeof(address));
+    username[0] = '\0';
+    updatePrefix(host.empty() ? "unknown.host" : host);
+}
+
+Client::~Client() {
+    delete input;
+    delete output;
+}
 
 int Client::getSocket() const { return fd; }
 
-std::string Client::getNickName() const { return nickname; }
+std::string Client::getNickName() const { return nickname.str(); }
+
+const NickName &Client::getNick() const { return nickname; }
 
 std::string Client::getUserName() const { return username; }
 
-std::string Client::getRealName() const { return realname; }
+const std::string &Client::getRealName() const { return realname; }
+
+std::string Client::getIpAddress() const { return prefix.substr(prefix.rfind('@') + 1); }
 
-std::string Client::getIpAddress() const { return ipadd; }
+int Client::getFamily() const { return family; }
 
-std::string &Client::getBuffer() { return buffer; }
+const unsigned char *Client::getAddress() const { return address; }
 
-bool Client::isAuthenticated() const { return authenticated; }
+bool Client::isAuthenticated() const { return flags & FLAG_AUTHENTICATED; }
 
-bool Client::isRegistered() const { return registered; }
+bool Client::isRegistered() const { return flags & FLAG_REGISTERED; }
 
-bool Client::isOperatorStatus() const { return isOperator; }
+bool Client::isOperatorStatus() const { return flags & FLAG_OPERATOR; }
 
-bool Client::isLoggedIn() const { return logedin; }
+bool Client::isLoggedIn() const { return flags & FLAG_LOGGEDIN; }
+
+bool Client::isIrcOperator() const { return flags & FLAG_IRCOP; }
 
 std::string Client::getHostname() const {
-    return nickname + "!" + username + "@" + (ipadd.empty() ? "unknown.host" : ipadd);
+    return prefix.substr(1);
 }
 
-bool Client::isInvitedToChannel(const std::string &chName) const {
-    for (size_t i = 0; i < ChannelsInvite.size(); i++) {
-        if (ChannelsInvite[i] == chName)
-            return true;
-    }
-    return false;
+/*
+** ":nick!user@host", built once whenever one of its parts changes instead of
+** being concatenated by every handler that sends on the client's behalf.
+*/
+const std::string &Client::getPrefix() const { return prefix; }
+
+void Client::updatePrefix(const std::string &host) {
+    std::string updated;
+    updated.reserve(nickname.size() + strlen(username) + host.size() + 3);
+    updated.append(":").append(nickname.c_str()).append("!").append(username).append("@").append(host);
+    prefix.swap(updated);
+}
+
+void Client::setFlag(unsigned char flag, bool value) {
+    if (value)
+        flags |= flag;
+    else
+        flags &= ~flag;
 }
 
 void Client::setNickName(const std::string &nick) {
-    nickname = nick;
-    if (!username.empty()) registerUser();
+    nickname = NickName(nick);
+    updatePrefix(getIpAddress());
+    if (username[0]) registerUser();
 }
 
 void Client::setUserName(const std::string &user) {
-    username = user;
+    size_t len = std::min(user.size(), (size_t)USERLEN);
+    memcpy(username, user.data(), len);
+    username[len] = '\0';
+    updatePrefix(getIpAddress());
     if (!nickname.empty()) registerUser();
 }
 
 void Client::setRealName(const std::string &real) { realname = real; }
 
-void Client::setPassword(const std::string &pass) { password = pass; }
+void Client::setOperator(bool value) { setFlag(FLAG_OPERATOR, value); }
 
-void Client::setIpAddress(const std::string &ip) { ipadd = ip; }
+void Client::setAuthenticated(bool value) { setFlag(FLAG_AUTHENTICATED, value); }
 
-void Client::setOperator(bool value) { isOperator = value; }
+void Client::setRegistered(bool value) { setFlag(FLAG_REGISTERED, value); }
 
-void Client::setAuthenticated(bool value) { authenticated = value; }
+void Client::setLoggedIn(bool value) { setFlag(FLAG_LOGGEDIN, value); }
 
-void Client::setRegistered(bool value) { registered = value; }
-
-void Client::setLoggedIn(bool value) { logedin = value; }
-
-void Client::setBuffer(const std::string &data) { buffer += data; }
+void Client::setIrcOperator(bool value) { setFlag(FLAG_IRCOP, value); }
 
 bool Client::checkPassword(const std::string &inputPassword, const std::string &correctPassword) {
     std::string trimmedPassword = inputPassword;
@@ -87,31 +152,344 @@ bool Client::checkPassword(const std::string &inputPassword, const std::string &
     trimmedPassword.erase(std::remove(trimmedPassword.begin(), trimmedPassword.end(), '\n'), trimmedPassword.end());
     trimmedPassword.erase(std::remove(trimmedPassword.begin(), trimmedPassword.end(), '\r'), trimmedPassword.end());
     if (trimmedPassword == correctPassword) {
-        authenticated = true;
+        setAuthenticated(true);
         return true;
     }
     return false;
 }
 
 void Client::registerUser() {
-    if (!nickname.empty() && !username.empty()) {
-        registered = true;
+    if (!nickname.empty() && username[0] && !isNegotiating()) {
+        setRegistered(true);
+    }
+}
+
+bool Client::hasPendingInput() const { return input != NULL; }
+
+size_t Client::getInputSize() const { return input ? input->size() : 0; }
+
+/*
+** A client whose receive queue is full is not polled for input until its
+** backlog has been parsed below the limit. A limit of zero means unlimited.
+*/
+bool Client::isRecvqFull() const { return recvqLimit && getInputSize() >= recvqLimit; }
+
+/*
+** Keeps the unterminated tail of a read until the rest of the line arrives.
+*/
+void Client::stashInput(const char *data, size_t len) {
+    if (!input)
+        input = new std::string;
+    input->append(data, len);
+}
+
+void Client::takeInput(std::string &data) {
+    if (!input)
+        return;
+    data.swap(*input);
+    delete input;
+    input = NULL;
+}
+
+bool Client::isRemote() const { return uplink >= 0; }
+
+int Client::getUplink() const { return uplink; }
+
+const std::string &Client::getServer() const { return server; }
+
+void Client::setUplink(int linkFd) { uplink = linkFd; }
+
+void Client::setServer(const std::string &serverName) { server = serverName; }
+
+bool Client::isVirtual() const { return bridge != NULL; }
+
+Client *Client::getBridge() const { return bridge; }
+
+unsigned int Client::getTag() const { return tag; }
+
+void Client::setBridge(Client *host, unsigned int userTag) {
+    bridge = host;
+    tag = userTag;
+}
+
+bool Client::isBridgeHost() const { return flags & FLAG_BRIDGE; }
+
+void Client::setBridgeHost(bool value) { setFlag(FLAG_BRIDGE, value); }
+
+unsigned char Client::getCaps() const { return caps; }
+
+bool Client::hasCap(unsigned char cap) const { return caps & cap; }
+
+void Client::setCaps(unsigned char value) { caps = value; }
+
+/*
+** Set by CAP LS or CAP REQ before registration, which then waits for CAP END.
+*/
+bool Client::isNegotiating() const { return flags & FLAG_NEGOTIATING; }
+
+void Client::setNegotiating(bool value) { setFlag(FLAG_NEGOTIATING, value); }
+
+static void appendTag(std::string &tags, unsigned int tag) {
+    char digits[16];
+    int len = snprintf(digits, sizeof(digits), "%u", tag);
+    tags.append(digits, len);
+}
+
+void Client::setConnClass(size_t index, size_t sendq, size_t recvq) {
+    connClass = index;
+    sendqLimit = sendq;
+    recvqLimit = recvq;
+}
+
+size_t Client::getConnClass() const { return connClass; }
+
+bool Client::isSendqExceeded() const { return flags & FLAG_SENDQ_EXCEEDED; }
+
+/*
+** Once a line would take the send queue past its limit the client is marked
+** as a slow consumer and nothing more is queued; the server disconnects it on
+** the next flush, so a stalled reader cannot grow without bound.
+*/
+void Client::queue(const SharedBuffer &line) {
+    if (bridge) {
+        std::string tags;
+        appendTag(tags, tag);
+        bridge->queueTagged(tags, line);
+        return;
+    }
+    if (line.empty() || isSendqExceeded())
+        return;
+    if (sendqLimit && getSendQueueSize() + line.size() > sendqLimit) {
+        setFlag(FLAG_SENDQ_EXCEEDED, true);
+        return;
+    }
+    openOutput();
+    output->sendq.push_back(line);
+    output->bytes += line.size();
+}
+
+/*
+** Makes room for len more bytes at the end of the send queue and returns
+** where to write them, or NULL once the send queue limit is hit.
+** Consecutive calls fill one writable block rather than queueing a buffer
+** each.
+*/
+char *Client::extendOutput(size_t len) {
+    if (bridge) {
+        char digits[16];
+        int tagLen = snprintf(digits, sizeof(digits), "%u ", tag);
+        char *tail = bridge->extendOutput(tagLen + len);
+        if (tail)
+            memcpy(tail, digits, tagLen);
+        return tail ? tail + tagLen : NULL;
+    }
+    if (isSendqExceeded())
+        return NULL;
+    if (sendqLimit && getSendQueueSize() + len > sendqLimit) {
+        setFlag(FLAG_SENDQ_EXCEEDED, true);
+        return NULL;
+    }
+    openOutput();
+    char *tail = output->sendq.empty() ? NULL : output->sendq.back().extend(len);
+    if (!tail) {
+        output->sendq.push_back(SharedBuffer::writable(len));
+        tail = output->sendq.back().extend(len);
+    }
+    output->bytes += len;
+    return tail;
+}
+
+/*
+** Output for virtual clients, on their bridge: every line of the buffer
+** goes out as "<tag>[,<tag>...] <line>". The lines are copied into the
+** writable block at the end of the queue, so a burst for many users packs
+** densely into a few iovecs instead of taking two each.
+*/
+void Client::queueTagged(const std::string &tags, const SharedBuffer &line) {
+    const char *data = line.data();
+    size_t start = 0;
+
+    while (start < line.size()) {
+        const char *end = static_cast<const char *>(memchr(data + start, '\n', line.size() - start));
+        size_t len = end ? end - (data + start) + 1 : line.size() - start;
+        char *out = extendOutput(tags.size() + 1 + len);
+        if (!out)
+            return;
+        memcpy(out, tags.data(), tags.size());
+        out[tags.size()] = ' ';
+        memcpy(out + tags.size() + 1, data + start, len);
+        start += len;
     }
 }
 
-void Client::clearBuffer() {
-    buffer.clear();
+void Client::queueReplay(const SharedBuffer &line) {
+    openOutput();
+    output->replay.push_back(line);
 }
 
-void Client::addChannelInvite(const std::string &chname) {
-    ChannelsInvite.push_back(chname);
+bool Client::hasPendingOutput() const { return output && !output->sendq.empty(); }
+
+bool Client::hasPendingReplay() const { return output && !output->replay.empty(); }
+
+size_t Client::getSendQueueSize() const { return output ? output->bytes - output->offset : 0; }
+
+void Client::feedReplay(size_t maxLines) {
+    while (maxLines-- > 0 && hasPendingReplay()) {
+        queue(output->replay.front());
+        output->replay.pop_front();
+    }
+}
+
+static std::vector<ClientOutput *> outputPool;
+
+void Client::openOutput() {
+    if (!output) {
+        if (outputPool.empty())
+            output = new ClientOutput;
+        else {
+            output = outputPool.back();
+            outputPool.pop_back();
+        }
+        output->offset = 0;
+        output->bytes = 0;
+    }
+}
+
+void Client::releaseOutput() {
+    if (output && output->sendq.empty() && output->replay.empty()) {
+        if (outputPool.size() < OUTPUT_POOL)
+            outputPool.push_back(output);
+        else
+            delete output;
+        output = NULL;
+    }
 }
 
-void Client::removeChannelInvite(const std::string &chname) {
-    for (size_t i = 0; i < ChannelsInvite.size(); i++) {
-        if (ChannelsInvite[i] == chname) {
-            ChannelsInvite.erase(ChannelsInvite.begin() + i);
+static size_t outputMemory(const ClientOutput *output) {
+    return Memory::block(sizeof(ClientOutput)) + Memory::deque(output->sendq.size(), sizeof(SharedBuffer))
+        + Memory::deque(output->replay.size(), sizeof(SharedBuffer));
+}
+
+/*
+** What the client itself holds; the lines in its queues belong to the
+** shared buffers.
+*/
+size_t Client::memoryUsage() const {
+    size_t total = Memory::block(sizeof(Client)) + Memory::string(prefix) + Memory::string(realname)
+        + Memory::string(server);
+
+    if (input)
+        total += Memory::block(sizeof(std::string)) + Memory::string(*input);
+    if (output)
+        total += outputMemory(output);
+    return total;
+}
+
+size_t Client::pooledOutputMemory() {
+    size_t total = 0;
+
+    for (size_t i = 0; i < outputPool.size(); ++i)
+        total += outputMemory(outputPool[i]);
+    return total;
+}
+
+/*
+** Gathers up to FLUSH_IOV queued lines into one sendmsg() request. The
+** request is either written right away by flush() or submitted with the
+** rest of the tick's output by EventLoop::sendBatch().
+*/
+void Client::prepareSend(SendRequest &request) const {
+    request.fd = fd;
+    request.count = 0;
+    request.total = 0;
+    request.result = 0;
+    if (!hasPendingOutput())
+        return;
+    const std::deque<SharedBuffer> &sendq = output->sendq;
+    for (std::deque<SharedBuffer>::const_iterator it = sendq.begin(); it != sendq.end() && request.count < FLUSH_IOV; ++it) {
+        size_t skip = (request.count == 0) ? output->offset : 0;
+        request.iov[request.count].iov_base = const_cast<char *>(it->data() + skip);
+        request.iov[request.count].iov_len = it->size() - skip;
+        request.total += request.iov[request.count].iov_len;
+        request.count++;
+    }
+}
+
+/*
+** Drops what the request managed to write from the send queue. Returns -1
+** when the connection is dead, 1 when the whole request went out and more
+** output is queued, and 0 otherwise.
+*/
+int Client::completeSend(const SendRequest &request) {
+    if (request.result < 0) {
+        int err = -request.result;
+        return (err == EAGAIN || err == EWOULDBLOCK || err == EINTR) ? 0 : -1;
+    }
+    if (!output)
+        return 0;
+    std::deque<SharedBuffer> &sendq = output->sendq;
+    size_t left = request.result;
+    while (left > 0 && !sendq.empty()) {
+        size_t chunk = sendq.front().size() - output->offset;
+        if (left < chunk) {
+            output->offset += left;
+            break;
+        }
+        left -= chunk;
+        output->bytes -= sendq.front().size();
+        sendq.pop_front();
+        output->offset = 0;
+    }
+    if ((size_t)request.result < request.total)
+        return 0;
+    if (hasPendingOutput())
+        return 1;
+    releaseOutput();
+    return 0;
+}
+
+/*
+** Writes as much of the send queue as the transport accepts without
+** blocking. Returns -1 when the connection is dead.
+*/
+int Client::flush(Transport &transport) {
+    SendRequest request;
+    int status = 1;
+
+    while (status > 0 && hasPendingOutput()) {
+        prepareSend(request);
+        request.result = transport.send(fd, request.iov, request.count);
+        status = completeSend(request);
+    }
+    if (status < 0)
+        return -1;
+    releaseOutput();
+    return 0;
+}
+
+Fanout::Fanout(TaggedLine &line) : line(line) {}
+
+void Fanout::add(Client *recipient) {
+    Client *host = recipient->getBridge();
+    const SharedBuffer &variant = line.forCaps(recipient->getCaps());
+    if (!host) {
+        recipient->queue(variant);
+        return;
+    }
+    for (size_t i = 0; i < bridges.size(); ++i) {
+        if (bridges[i].host == host && bridges[i].line == &variant) {
+            bridges[i].tags += ',';
+            appendTag(bridges[i].tags, recipient->getTag());
             return;
         }
     }
+    FanoutGroup group = {host, &variant, std::string()};
+    bridges.push_back(group);
+    appendTag(bridges.back().tags, recipient->getTag());
+}
+
+void Fanout::send() {
+    for (size_t i = 0; i < bridges.size(); ++i)
+        bridges[i].host->queueTagged(bridges[i].tags, *bridges[i].line);
+    bridges.clear();
 }
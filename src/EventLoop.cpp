@@ -0,0 +1,181 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   EventLoop.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/26 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/26 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/EventLoop.hpp"
+#include "../inc/UringLoop.hpp"
+#include <sys/socket.h>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+EventLoop::~EventLoop() {}
+
+bool EventLoop::acceptMultishot(int fd) {
+    (void)fd;
+    return false;
+}
+
+bool EventLoop::recvMultishot(int fd) {
+    (void)fd;
+    return false;
+}
+
+/*
+** Readiness backends write each request with its own sendmsg().
+*/
+void EventLoop::sendBatch(std::vector<SendRequest> &batch) {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = batch[i].iov;
+        msg.msg_iovlen = batch[i].count;
+        batch[i].result = sendmsg(batch[i].fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (batch[i].result < 0)
+            batch[i].result = -errno;
+    }
+}
+
+/*
+** "uring" falls back to epoll when the kernel refuses io_uring or lacks one
+** of the features it needs. Returns NULL for an unknown backend name.
+*/
+EventLoop *EventLoop::create(const std::string &backend) {
+    if (backend == "poll")
+        return new PollLoop();
+    if (backend == "epoll")
+        return new EpollLoop();
+    if (backend == "uring") {
+        try {
+            return new UringLoop();
+        } catch (const std::runtime_error &) {
+            return new EpollLoop();
+        }
+    }
+    return NULL;
+}
+
+PollLoop::PollLoop() {}
+
+const char *PollLoop::getName() const { return "poll"; }
+
+void PollLoop::setEvents(int fd, short events) {
+    if ((size_t)fd >= slots.size())
+        slots.resize(fd + 1, 0);
+    if (slots[fd]) {
+        pfds[slots[fd] - 1].events = events;
+        return;
+    }
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    pfd.revents = 0;
+    pfds.push_back(pfd);
+    slots[fd] = pfds.size();
+}
+
+void PollLoop::remove(int fd) {
+    if ((size_t)fd >= slots.size() || !slots[fd])
+        return;
+    size_t index = slots[fd] - 1;
+    pfds[index] = pfds.back();
+    slots[pfds[index].fd] = index + 1;
+    pfds.pop_back();
+    slots[fd] = 0;
+}
+
+int PollLoop::wait(std::vector<IoEvent> &events, int timeout) {
+    events.clear();
+    int count = poll(pfds.empty() ? NULL : &pfds[0], pfds.size(), timeout);
+    if (count < 0)
+        return errno == EINTR ? 0 : -1;
+    for (size_t i = 0; i < pfds.size() && (int)events.size() < count; ++i) {
+        if (!pfds[i].revents)
+            continue;
+        IoEvent event;
+        event.type = IO_READY;
+        event.fd = pfds[i].fd;
+        event.revents = pfds[i].revents;
+        event.result = 0;
+        event.data = NULL;
+        events.push_back(event);
+    }
+    return events.size();
+}
+
+EpollLoop::EpollLoop() : epfd(epoll_create1(EPOLL_CLOEXEC)), ready(256) {
+    if (epfd < 0)
+        throw std::runtime_error("Error: epoll_create1 failed");
+}
+
+EpollLoop::~EpollLoop() {
+    close(epfd);
+}
+
+const char *EpollLoop::getName() const { return "epoll"; }
+
+/*
+** The registered mask is cached per fd so that the per-tick event refresh
+** only costs an epoll_ctl() when the mask actually changes.
+*/
+void EpollLoop::setEvents(int fd, short events) {
+    if ((size_t)fd >= interest.size())
+        interest.resize(fd + 1, -1);
+    if (interest[fd] == events)
+        return;
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = 0;
+    if (events & POLLIN)
+        ev.events |= EPOLLIN;
+    if (events & POLLOUT)
+        ev.events |= EPOLLOUT;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, interest[fd] < 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) < 0
+        && errno == EEXIST)
+        epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev);
+    interest[fd] = events;
+}
+
+void EpollLoop::remove(int fd) {
+    if ((size_t)fd >= interest.size() || interest[fd] < 0)
+        return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+    interest[fd] = -1;
+}
+
+int EpollLoop::wait(std::vector<IoEvent> &events, int timeout) {
+    events.clear();
+    int count = epoll_wait(epfd, &ready[0], ready.size(), timeout);
+    if (count < 0)
+        return errno == EINTR ? 0 : -1;
+    for (int i = 0; i < count; ++i) {
+        IoEvent event;
+        event.type = IO_READY;
+        event.fd = ready[i].data.fd;
+        event.revents = 0;
+        if (ready[i].events & EPOLLIN)
+            event.revents |= POLLIN;
+        if (ready[i].events & EPOLLOUT)
+            event.revents |= POLLOUT;
+        if (ready[i].events & EPOLLERR)
+            event.revents |= POLLERR;
+        if (ready[i].events & EPOLLHUP)
+            event.revents |= POLLHUP;
+        event.result = 0;
+        event.data = NULL;
+        events.push_back(event);
+    }
+    if ((size_t)count == ready.size())
+        ready.resize(ready.size() * 2);
+    return count;
+}
@@ -0,0 +1,50 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Link.cpp                                           :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/14 10:12:41 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/14 10:12:41 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Link.hpp"
+#include "../inc/Memory.hpp"
+
+Link::Link(int fd, bool outgoing, bool connecting)
+    : fd(fd), outgoing(outgoing), connecting(connecting), registered(false) {}
+
+Link::~Link() {}
+
+int Link::getSocket() const { return fd; }
+
+bool Link::isOutgoing() const { return outgoing; }
+
+bool Link::isConnecting() const { return connecting; }
+
+bool Link::isRegistered() const { return registered; }
+
+std::string Link::getName() const { return name; }
+
+std::string &Link::getInBuffer() { return inbuf; }
+
+std::string &Link::getOutBuffer() { return outbuf; }
+
+bool Link::hasPendingOutput() const { return !outbuf.empty(); }
+
+void Link::setConnecting(bool value) { connecting = value; }
+
+void Link::setRegistered(bool value) { registered = value; }
+
+void Link::setName(const std::string &serverName) { name = serverName; }
+
+void Link::queue(const std::string &line) {
+    outbuf += line;
+    outbuf += "\r\n";
+}
+
+size_t Link::memoryUsage() const {
+    return Memory::block(sizeof(Link)) + Memory::string(name) + Memory::string(inbuf) + Memory::string(outbuf);
+}
@@ -0,0 +1,247 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   MaskIndex.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/31 09:26:20 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/31 09:26:20 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/MaskIndex.hpp"
+#include "../inc/IrcName.hpp"
+#include "../inc/Memory.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <arpa/inet.h>
+
+MaskIndex::MaskIndex() {
+    TrieNode root = {{-1, -1}, 0};
+    trie.push_back(root);
+}
+
+/*
+** Completes a mask the way it was most likely meant: "nick" is nick!*@*,
+** "user@host" is *!user@host and anything with a dot or colon is a host.
+*/
+std::string MaskIndex::normalize(const std::string &mask) {
+    std::string::size_type bang = mask.find('!');
+    std::string::size_type at = mask.find('@');
+
+    if (mask.empty())
+        return mask;
+    if (bang != std::string::npos && at != std::string::npos && bang < at)
+        return mask;
+    if (at != std::string::npos)
+        return "*!" + mask;
+    if (bang != std::string::npos)
+        return mask + "@*";
+    if (mask.find_first_of(".:/") != std::string::npos)
+        return "*!*@" + mask;
+    return mask + "!*@*";
+}
+
+/*
+** Casefolded glob match of a single pattern, for LIST and WHO filters.
+*/
+bool MaskIndex::match(const std::string &pattern, const std::string &text) {
+    return glob(fold(pattern).c_str(), fold(text).c_str());
+}
+
+bool MaskIndex::add(const std::string &mask, const std::string &setter, long long when) {
+    std::string folded = fold(mask);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (fold(entries[i].mask) == folded)
+            return false;
+    }
+    MaskEntry entry;
+    entry.mask = mask;
+    entry.setter = setter;
+    entry.time = when;
+    entries.push_back(entry);
+    compile(mask, true);
+    return true;
+}
+
+bool MaskIndex::remove(const std::string &mask) {
+    std::string folded = fold(mask);
+
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (fold(entries[i].mask) == folded) {
+            compile(entries[i].mask, false);
+            entries.erase(entries.begin() + i);
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+** One host lookup, at most 128 trie steps, then the glob masks.
+*/
+bool MaskIndex::matches(const std::string &nickUserHost) const {
+    unsigned char address[16];
+    int bits;
+
+    if (entries.empty())
+        return false;
+    std::string folded = fold(nickUserHost);
+    std::string::size_type at = folded.rfind('@');
+    std::string host = at == std::string::npos ? "" : folded.substr(at + 1);
+    if (!hosts.empty() && hosts.find(host) != hosts.end())
+        return true;
+    if ((trie.size() > 1 || trie[0].terminal) && parseAddress(host, address, bits)) {
+        int node = 0;
+        for (int i = 0; node >= 0; ++i) {
+            if (trie[node].terminal)
+                return true;
+            if (i == bits)
+                break;
+            node = trie[node].child[(address[i / 8] >> (7 - i % 8)) & 1];
+        }
+    }
+    for (size_t i = 0; i < globs.size(); ++i) {
+        if (glob(globs[i].c_str(), folded.c_str()))
+            return true;
+    }
+    return false;
+}
+
+const std::vector<MaskEntry> &MaskIndex::getEntries() const {
+    return entries;
+}
+
+size_t MaskIndex::size() const {
+    return entries.size();
+}
+
+/*
+** Heap held by the lists, not counting the index object itself.
+*/
+size_t MaskIndex::memoryUsage() const {
+    size_t total = Memory::vector(entries) + Memory::map(hosts) + Memory::vector(trie) + Memory::vector(globs);
+
+    for (size_t i = 0; i < entries.size(); ++i)
+        total += Memory::string(entries[i].mask) + Memory::string(entries[i].setter);
+    for (std::map<std::string, unsigned int>::const_iterator it = hosts.begin(); it != hosts.end(); ++it)
+        total += Memory::string(it->first);
+    for (size_t i = 0; i < globs.size(); ++i)
+        total += Memory::string(globs[i]);
+    return total;
+}
+
+void MaskIndex::compile(const std::string &mask, bool adding) {
+    std::string folded = fold(mask);
+    unsigned char address[16];
+    int bits;
+
+    if (folded.compare(0, 4, "*!*@") == 0) {
+        std::string host = folded.substr(4);
+        if (parseAddress(host, address, bits)) {
+            updateTrie(address, bits, adding);
+            return;
+        }
+        if (host.find_first_of("*?") == std::string::npos) {
+            if (adding)
+                hosts[host]++;
+            else if (hosts.count(host) && --hosts[host] == 0)
+                hosts.erase(host);
+            return;
+        }
+    }
+    if (adding) {
+        globs.push_back(folded);
+        return;
+    }
+    for (size_t i = 0; i < globs.size(); ++i) {
+        if (globs[i] == folded) {
+            globs.erase(globs.begin() + i);
+            return;
+        }
+    }
+}
+
+void MaskIndex::updateTrie(const unsigned char *address, int bits, bool adding) {
+    int node = 0;
+
+    for (int i = 0; i < bits; ++i) {
+        int bit = (address[i / 8] >> (7 - i % 8)) & 1;
+        if (trie[node].child[bit] < 0) {
+            if (!adding)
+                return;
+            TrieNode fresh = {{-1, -1}, 0};
+            trie.push_back(fresh);
+            trie[node].child[bit] = trie.size() - 1;
+        }
+        node = trie[node].child[bit];
+    }
+    if (adding)
+        trie[node].terminal++;
+    else if (trie[node].terminal)
+        trie[node].terminal--;
+}
+
+/*
+** "a.b.c.d", "a.b.c.d/len", an IPv6 address or an IPv6 range, as a 128-bit
+** address and a prefix length in bits.
+*/
+bool MaskIndex::parseAddress(const std::string &host, unsigned char *address, int &bits) {
+    std::string::size_type slash = host.find('/');
+    std::string ip = host.substr(0, slash);
+    struct in_addr in;
+    int offset = 0;
+
+    memset(address, 0, 16);
+    if (inet_pton(AF_INET, ip.c_str(), &in) == 1) {
+        address[10] = 0xff;
+        address[11] = 0xff;
+        memcpy(address + 12, &in, 4);
+        offset = 96;
+    } else if (inet_pton(AF_INET6, ip.c_str(), address) != 1)
+        return false;
+    bits = 128;
+    if (slash == std::string::npos)
+        return true;
+    std::string length = host.substr(slash + 1);
+    if (length.empty() || length.size() > 3 || length.find_first_not_of("0123456789") != std::string::npos
+        || atoi(length.c_str()) > 128 - offset)
+        return false;
+    bits = offset + atoi(length.c_str());
+    return true;
+}
+
+/*
+** '*' matches any run of characters and '?' any single one.
+*/
+bool MaskIndex::glob(const char *pattern, const char *text) {
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*text) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = text;
+        } else if (*pattern == '?' || *pattern == *text) {
+            ++pattern;
+            ++text;
+        } else if (star) {
+            pattern = star + 1;
+            text = ++resume;
+        } else
+            return false;
+    }
+    while (*pattern == '*')
+        ++pattern;
+    return !*pattern;
+}
+
+std::string MaskIndex::fold(const std::string &text) {
+    std::string folded(text);
+
+    for (size_t i = 0; i < folded.size(); ++i)
+        folded[i] = NickName::foldChar(folded[i]);
+    return folded;
+}
@@ -0,0 +1,36 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Memory.cpp                                         :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 10:14:40 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 10:14:40 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Memory.hpp"
+#include <algorithm>
+
+size_t Memory::block(size_t bytes) {
+    return (bytes + sizeof(size_t) + MEMORY_CHUNK - 1) / MEMORY_CHUNK * MEMORY_CHUNK;
+}
+
+size_t Memory::string(const std::string &text) {
+    return text.capacity() > 15 ? block(text.capacity() + 1) : 0;
+}
+
+size_t Memory::node(size_t value) {
+    return block(MEMORY_NODE + value);
+}
+
+/*
+** An empty deque still holds its map and one chunk.
+*/
+size_t Memory::deque(size_t count, size_t element) {
+    size_t perChunk = element < MEMORY_DEQUE_NODE ? MEMORY_DEQUE_NODE / element : 1;
+    size_t chunks = count / perChunk + 1;
+    return block(std::max(static_cast<size_t>(8), chunks + 2) * sizeof(void *))
+        + chunks * block(perChunk * element);
+}
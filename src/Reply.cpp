@@ -0,0 +1,162 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Reply.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/09 09:40:31 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/09 09:40:31 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Reply.hpp"
+#include <cstring>
+
+struct ReplyTemplate {
+    char code[4];
+    const char *text;
+};
+
+/*
+** Indexed by ReplyId.
+*/
+static const ReplyTemplate replies[] = {
+    {"001", ":Welcome to the IRC server"},
+    {"001", ":Password accepted, proceed to register"},
+    {"005", "% :are supported by this server"},
+    {"219", "% :End of STATS report"},
+    {"249", ":%"},
+    {"311", "% % % * :%"},
+    {"312", "% % :ft_irc"},
+    {"313", "% :is an IRC operator"},
+    {"315", "% :End of /WHO list"},
+    {"318", "% :End of /WHOIS list"},
+    {"319", "% :%"},
+    {"321", "Channel :Users Name"},
+    {"322", "% % :%"},
+    {"323", ":End of /LIST"},
+    {"324", "% %"},
+    {"346", "% % % %"},
+    {"347", "% :End of channel invite list"},
+    {"348", "% % % %"},
+    {"349", "% :End of channel exception list"},
+    {"331", "% :No topic is set"},
+    {"332", "% :%"},
+    {"341", "% %"},
+    {"352", "% % % % % % :% %"},
+    {"353", "% % :%"},
+    {"366", "% :End of /NAMES list"},
+    {"367", "% % % %"},
+    {"368", "% :End of channel ban list"},
+    {"381", ":You are now an IRC operator"},
+    {"401", "% :No such nick/channel"},
+    {"401", "% :You cannot kick yourself"},
+    {"403", "% :No such channel"},
+    {"404", "% :Cannot send to channel"},
+    {"404", "% :Cannot send to channel (+b)"},
+    {"407", "% :Too many recipients"},
+    {"410", "% :Invalid CAP command"},
+    {"417", "% :Message too long (max 256 characters)"},
+    {"417", "% :channelname must not exceed 50 characters"},
+    {"421", "% :Unknown command"},
+    {"431", ":No nickname given"},
+    {"432", "% :Invalid nickname format"},
+    {"432", "% :Nickname must not exceed 9 characters"},
+    {"433", "% :Nickname already in use"},
+    {"435", "% % :Cannot change nickname while banned on channel"},
+    {"441", "% % :They aren't on that channel"},
+    {"442", "% :You're not on that channel"},
+    {"443", "% % :is already on channel"},
+    {"451", "% :You have not registered"},
+    {"461", "% :Not enough parameters"},
+    {"462", ":You may not reregister"},
+    {"462", ":You must provide the correct PASS before registering"},
+    {"464", ":Password incorrect"},
+    {"471", "% :Cannot join channel (+l) - channel is full"},
+    {"472", "% :is unknown mode char to me"},
+    {"473", "% :Cannot join channel (+i)"},
+    {"474", "% :Cannot join channel (+b)"},
+    {"475", "% :Cannot join channel (+k) - Missing password"},
+    {"475", "% :Cannot join channel (+k) - Incorrect password"},
+    {"478", "% % :Channel list is full"},
+    {"481", ":Permission Denied- You're not an IRC operator"},
+    {"482", "% :You're not channel operator"},
+    {"501", "% :Unknown mode flag"},
+    {"502", "% :You can't change modes for other users"},
+    {"730", ":%"},
+    {"731", ":%"},
+    {"732", ":%"},
+    {"733", ":End of MONITOR list"},
+    {"734", "% % :Monitor list is full"}
+};
+
+typedef char replyTableComplete[sizeof(replies) / sizeof(replies[0]) == REPLY_COUNT ? 1 : -1];
+
+ReplyArg::ReplyArg(const std::string &value) : text(value.data()), length(value.size()) {}
+
+ReplyArg::ReplyArg(const NickName &value) : text(value.c_str()), length(value.size()) {}
+
+ReplyArg::ReplyArg(const char *value) : text(value), length(strlen(value)) {}
+
+ReplyArg::ReplyArg(size_t value) : text(NULL), length(0) {
+    char reversed[sizeof(digits)];
+
+    do {
+        reversed[length++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    for (size_t i = 0; i < length; ++i)
+        digits[i] = reversed[length - 1 - i];
+}
+
+const char *ReplyArg::data() const { return text ? text : digits; }
+
+size_t ReplyArg::size() const { return length; }
+
+const char *Reply::getCode(ReplyId id) {
+    return replies[id].code;
+}
+
+/*
+** A '%' without a matching argument expands to nothing. Returns false when
+** the client's send queue limit stopped the reply.
+*/
+bool Reply::send(Client &client, const std::string &server, ReplyId id, const ReplyArg *const *args, size_t count) {
+    const ReplyTemplate &entry = replies[id];
+    const NickName &nick = client.getNick();
+    size_t text = 0;
+    size_t used = 0;
+
+    for (const char *p = entry.text; *p; ++p)
+        text += *p != '%' ? 1 : used < count ? args[used++]->size() : 0;
+    size_t len = 1 + server.size() + 5 + (nick.empty() ? 1 : nick.size()) + (text ? 1 + text : 0) + 2;
+    char *out = client.extendOutput(len);
+    if (!out)
+        return false;
+    *out++ = ':';
+    memcpy(out, server.data(), server.size());
+    out += server.size();
+    *out++ = ' ';
+    memcpy(out, entry.code, 3);
+    out += 3;
+    *out++ = ' ';
+    if (nick.empty())
+        *out++ = '*';
+    memcpy(out, nick.c_str(), nick.size());
+    out += nick.size();
+    if (text)
+        *out++ = ' ';
+    used = 0;
+    for (const char *p = entry.text; *p; ++p) {
+        if (*p != '%')
+            *out++ = *p;
+        else if (used < count) {
+            memcpy(out, args[used]->data(), args[used]->size());
+            out += args[used++]->size();
+        }
+    }
+    *out++ = '\r';
+    *out = '\n';
+    return true;
+}
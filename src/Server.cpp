@@ -12,200 +12,919 @@
 
 #include "../inc/Server.hpp"
 
-Server::Server(const std::string &port, const std::string &password) 
-    : port(port), password(password), running(true) {
-    setupSocket();
+/*
+** The server owns the transport; without one it talks to sockets. A
+** MemoryTransport takes "memory" as its port.
+*/
+Server::Server(const std::string &port, const std::string &password, Transport *transport) 
+    : port(port), password(password), running(true), serverName("irc.local"),
+      linkListener(-1), nextRemoteId(-2), historyBytes(0), maxTargets(MAX_TARGETS),
+      transport(transport ? transport : new SocketTransport), tls(NULL), websocket(NULL), loop(NULL), woke(0), ioBackend("epoll"), spareFd(open("/dev/null", O_RDONLY | O_CLOEXEC)), acceptPaused(false),
+      maxPerIp(0), backlog(BACKLOG), deferAccept(DEFER_ACCEPT), queryBacklog(false), nextCaptureId(1),
+      captureStart(0), nextBatch(1) {
     logFile.open("server.log", std::ios::app);
+    addConnClass("default", SENDQ_DEFAULT, RECVQ_DEFAULT, "");
+    memset(&load, 0, sizeof(load));
+    memset(&busyPoll, 0, sizeof(busyPoll));
+    busyPoll.cpu = -1;
+    load.lagLimit = OVERLOAD_LAG;
+    load.sendqLimit = OVERLOAD_SENDQ;
+    load.backlogLimit = OVERLOAD_BACKLOG;
+    load.changedAt = nowMillis();
+    if (!addListener(port))
+        throw std::runtime_error("Error: invalid port " + port);
+    logMessage("Server started on port " + port);
 }
 
 Server::~Server() {
     logFile.close();
-    if (listener >= 0) {
-        close(listener);
-        listener = -1;
-    }
+    delete loop;
+    if (spareFd >= 0)
+        close(spareFd);
+    closeListeners();
+    if (linkListener >= 0)
+        close(linkListener);
+    for (std::map<int, Link *>::iterator lit = links.begin(); lit != links.end(); ++lit) {
+        close(lit->first);
+        delete lit->second;
+    }
+    links.clear();
+    for (std::map<int, Client *>::iterator rit = remoteClients.begin(); rit != remoteClients.end(); ++rit)
+        delete rit->second;
+    remoteClients.clear();
     std::map<int, Client *>::iterator it;
     for (it = clients.begin(); it != clients.end(); ++it) {
         Client *client = it->second;
         if (client) {
             if (client->getSocket() >= 0) {
-                close(client->getSocket());
+                transport->release(client->getSocket());
             }
             delete client;
         }
     }
     clients.clear();
+    delete transport;
+}
+
+/*
+** "-listen <address>[,<class>]". The address is a port, "host:port",
+** "[ipv6]:port" or "unix:/path"; clients accepted on it are put in the
+** named class. A "tls:", "ws:" or "wss:" prefix puts TLS, WebSocket
+** framing or both in front of the clients of that listener. Returns false
+** for a malformed address or an unknown class.
+*/
+bool Server::addListener(const std::string &spec) {
+    std::string::size_type comma = spec.find(',');
+    Listener listener;
+
+    listener.address = spec.substr(0, comma);
+    listener.fd = -1;
+    listener.family = AF_UNSPEC;
+    listener.connClass = -1;
+    std::string scheme = listener.address.substr(0, listener.address.find(':'));
+    listener.tls = scheme == "tls" || scheme == "wss";
+    listener.websocket = scheme == "ws" || scheme == "wss";
+    if (listener.tls || listener.websocket)
+        listener.address.erase(0, scheme.size() + 1);
+    if (comma != std::string::npos) {
+        for (size_t i = 0; i < classes.size(); ++i)
+            if (classes[i].name == spec.substr(comma + 1))
+                listener.connClass = i;
+        if (listener.connClass < 0)
+            return false;
+        classes[listener.connClass].listenerOnly = true;
+    }
+    if (listener.address == "memory" && listener.tls)
+        return false;
+    if (listener.address == "memory") {
+        if ((listener.fd = transport->openListener()) < 0)
+            return false;
+        listeners.push_back(listener);
+        logMessage("Listening on memory transport");
+        return true;
+    }
+    if (listener.address.compare(0, 5, "unix:") == 0) {
+        if (!openUnixListener(listener))
+            return false;
+    } else if (!openInetListener(listener))
+        return false;
+    if (listen(listener.fd, backlog) < 0)
+        throw std::runtime_error("Error: listen failed on " + listener.address);
+    fcntl(listener.fd, F_SETFL, O_NONBLOCK);
+    if (listener.family != AF_UNIX)
+        setsockopt(listener.fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &deferAccept, sizeof(deferAccept));
+    listeners.push_back(listener);
+    if (DEBUG)
+        std::cout << "DEBUG: Listener socket created: " << listener.fd << std::endl;
+    logMessage("Listening on " + listener.address + (listener.tls ? " (tls)" : "") + (listener.websocket ? " (websocket)" : ""));
+    return true;
 }
 
-void Server::setupSocket() {
+/*
+** "6667" and "*:6667" listen on every address with one dual-stack IPv6
+** socket (plain IPv4 when the host has no IPv6). "host:6667" binds a single
+** address; "[addr]:6667" is IPv6 only, so it can sit next to "0.0.0.0:6667".
+*/
+bool Server::openInetListener(Listener &listener) {
+    const std::string &address = listener.address;
+    std::string host;
+    std::string service = address;
+    std::string::size_type colon = address.rfind(':');
+    bool bracketed = !address.empty() && address[0] == '[';
     struct addrinfo hints, *res;
     int yes = 1;
+    int v6only = bracketed;
 
+    if (bracketed) {
+        std::string::size_type close = address.find("]:");
+        if (close == std::string::npos)
+            return false;
+        host = address.substr(1, close - 1);
+        service = address.substr(close + 2);
+    } else if (colon != std::string::npos) {
+        host = address.substr(0, colon);
+        service = address.substr(colon + 1);
+    }
+    if (host == "*")
+        host.clear();
+    if (service.empty() || service.find_first_not_of("0123456789") != std::string::npos)
+        return false;
     memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET;
+    hints.ai_family = host.empty() ? AF_INET6 : AF_UNSPEC;
     hints.ai_socktype = SOCK_STREAM;
-    hints.ai_flags = AI_PASSIVE;
-
-    if (getaddrinfo(NULL, port.c_str(), &hints, &res) != 0)
-        throw std::runtime_error("Error: getaddrinfo failed");
-    listener = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-    if (listener < 0)
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICSERV;
+    if (getaddrinfo(host.empty() ? NULL : host.c_str(), service.c_str(), &hints, &res) != 0)
+        return false;
+    listener.fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener.fd < 0 && host.empty()) {
+        freeaddrinfo(res);
+        hints.ai_family = AF_INET;
+        if (getaddrinfo(NULL, service.c_str(), &hints, &res) != 0)
+            return false;
+        listener.fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    }
+    if (listener.fd < 0)
         throw std::runtime_error("Error: socket creation failed");
-    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
-    if (bind(listener, res->ai_addr, res->ai_addrlen) < 0)
-        throw std::runtime_error("Error: bind failed");
-    if (listen(listener, BACKLOG) < 0)
-        throw std::runtime_error("Error: listen failed");
+    listener.family = res->ai_family;
+    setsockopt(listener.fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    if (listener.family == AF_INET6)
+        setsockopt(listener.fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+    if (bind(listener.fd, res->ai_addr, res->ai_addrlen) < 0)
+        throw std::runtime_error("Error: bind failed on " + address);
     freeaddrinfo(res);
-    if (DEBUG)
-        std::cout << "DEBUG: Listener socket created: " << listener << std::endl;
-    struct pollfd pfd;
-    pfd.fd = listener;
-    pfd.events = POLLIN;
-    pfds.push_back(pfd);
-    logMessage("Server started on port " + port);
+    return true;
+}
+
+/*
+** A stale socket file left by a previous run is replaced; anything else at
+** the path is an error.
+*/
+bool Server::openUnixListener(Listener &listener) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    listener.path = listener.address.substr(5);
+    if (listener.path.empty() || listener.path.size() >= sizeof(addr.sun_path))
+        return false;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, listener.path.c_str(), listener.path.size());
+    if (lstat(listener.path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        unlink(listener.path.c_str());
+    listener.fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener.fd < 0)
+        throw std::runtime_error("Error: socket creation failed");
+    listener.family = AF_UNIX;
+    if (bind(listener.fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        throw std::runtime_error("Error: bind failed on " + listener.address);
+    return true;
+}
+
+Listener *Server::findListener(int fd) {
+    for (size_t i = 0; i < listeners.size(); ++i)
+        if (listeners[i].fd == fd)
+            return &listeners[i];
+    return NULL;
+}
+
+void Server::closeListeners() {
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        if (listeners[i].address == "memory")
+            transport->release(listeners[i].fd);
+        else
+            close(listeners[i].fd);
+        if (!listeners[i].path.empty())
+            unlink(listeners[i].path.c_str());
+    }
+    listeners.clear();
 }
 
 void Server::shutdownServer() {
     std::cout << "Shutting down server..." << std::endl;
     running = false;
+    if (capture.is_open())
+        capture.close();
 
     for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
-        send(it->first, "Server shutting down. Goodbye!\r\n", 32, 0);
-        close(it->first);
+        it->second->queue(SharedBuffer("Server shutting down. Goodbye!\r\n"));
+        if (!it->second->isVirtual()) {
+            it->second->flush(*transport);
+            transport->release(it->first);
+        }
         delete it->second;
     }
     clients.clear();
-    for (std::map<std::string, Channel *>::iterator it = channels.begin(); it != channels.end(); ++it) {
+    for (std::map<ChannelName, Channel *>::iterator it = channels.begin(); it != channels.end(); ++it) {
         delete it->second;
     }
     channels.clear();
-    close(listener);
+    for (std::map<int, Link *>::iterator it = links.begin(); it != links.end(); ++it) {
+        close(it->first);
+        delete it->second;
+    }
+    links.clear();
+    for (std::map<int, Client *>::iterator it = remoteClients.begin(); it != remoteClients.end(); ++it)
+        delete it->second;
+    remoteClients.clear();
+    if (linkListener >= 0)
+        close(linkListener);
+    linkListener = -1;
+    closeListeners();
     logMessage("Server is shutting down.");
 }
 
+/*
+** Sockets created before run() (the listeners) are registered here, once
+** the backend chosen with -io exists.
+*/
+void Server::startEventLoop() {
+    loop = transport->createLoop();
+    if (!loop)
+        loop = EventLoop::create(ioBackend);
+    else
+        ioBackend = loop->getName();
+    if (ioBackend == "uring" && std::string(loop->getName()) != "io_uring")
+        logMessage("io_uring unavailable, falling back to " + std::string(loop->getName()));
+    logMessage("Transport: " + std::string(transport->getName()));
+    logMessage("Event loop: " + std::string(loop->getName()));
+    logMessage("Text scanner: " + std::string(TextScan::getName()));
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        setPollEvents(listeners[i].fd, POLLIN);
+        loop->acceptMultishot(listeners[i].fd);
+    }
+    if (linkListener >= 0)
+        setPollEvents(linkListener, POLLIN);
+}
+
+bool Server::setIoBackend(const std::string &backend) {
+    if (backend != "poll" && backend != "epoll" && backend != "uring")
+        return false;
+    ioBackend = backend;
+    return true;
+}
+
 void Server::run() {
+    start();
     std::cout << "IRC server is running..." << std::endl;
-    while (running) {
-        int poll_count = poll(&pfds[0], pfds.size(), -1);
-        if (poll_count < 0)
-            throw std::runtime_error("Error: poll failed");
-        for (size_t i = 0; i < pfds.size(); ++i) {
-            if (pfds[i].revents & POLLIN) {
-                if (pfds[i].fd == listener)
-                    handleNewConnection();
-                else
-                    handleClientMessage(pfds[i].fd);
-            }
+    while (running)
+        tick();
+    shutdownServer();
+}
+
+void Server::start() {
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        if (listeners[i].tls && !tls)
+            throw std::runtime_error("Error: tls listener " + listeners[i].address + " needs -tls");
+        if (listeners[i].websocket && !websocket) {
+            websocket = new WebSocketTransport(transport);
+            transport = websocket;
         }
     }
-    shutdownServer();
+    startEventLoop();
+    pinReactor();
+    woke = monotonicMicros();
+    ServerTime::tick();
+}
+
+/*
+** One pass of the event loop: the deferred work of the previous wakeup,
+** then one wait() and the dispatch of what it returned. run() calls this
+** until shutdown; a driver over a MemoryTransport calls it directly.
+*/
+void Server::tick() {
+    {
+        TraceSpan span("connectLinks");
+        connectLinks();
+    }
+    {
+        TraceSpan span("flushLinks");
+        flushLinks();
+    }
+    {
+        TraceSpan span("drainInput");
+        span.setArg("clients", inputBacklog.size());
+        drainInput();
+    }
+    {
+        TraceSpan span("flushClients");
+        flushClients();
+    }
+    measureLoad(monotonicMicros() - woke);
+    int timeout = linkTargets.empty() ? -1 : LINK_RETRY * 1000;
+    if (load.degraded && (timeout < 0 || timeout > 1000))
+        timeout = 1000;
+    if (!inputBacklog.empty() || queryBacklog)
+        timeout = 0;
+    tickReaders.clear();
+    {
+        TraceSpan span("wait");
+        if (waitEvents(timeout) < 0)
+            throw std::runtime_error("Error: event loop wait failed");
+        span.setArg("events", events.size());
+    }
+    woke = monotonicMicros();
+    ServerTime::tick();
+    TraceSpan dispatch("dispatch");
+    dispatch.setArg("events", events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        const IoEvent &event = events[i];
+        Listener *listener;
+        if (event.type == IO_ACCEPT && (listener = findListener(event.fd)))
+            acceptClient(*listener, event.result);
+        else if (event.type == IO_RECV)
+            handleClientData(event.fd, event.data, event.result);
+        else if (links.find(event.fd) != links.end())
+            handleLinkEvent(event.fd, event.revents);
+        else if (!(event.revents & POLLIN))
+            continue;
+        else if (event.fd == linkListener)
+            handleNewLink();
+        else if (clients.find(event.fd) != clients.end())
+            handleClientMessage(event.fd);
+        else if ((listener = findListener(event.fd)))
+            handleNewConnection(*listener);
+    }
 }
 
 void Server::handlePING(Client *client, const std::vector<std::string> &params) {
     if (params.empty())
     {
-        sendToClient(client->getSocket(), "461 PING :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "PING");
         return;
     }
     std::string response = "PONG :" + params[0] + "\r\n";
     sendToClient(client->getSocket(), response);
 }
 
-void Server::handleNewConnection() {
-    struct sockaddr_in client_addr;
+/*
+** Drains the listener with accept4() until it would block or ACCEPT_BATCH
+** connections have been taken this tick, so a reconnect storm empties the
+** backlog quickly without starving established clients.
+*/
+void Server::handleNewConnection(const Listener &listener) {
+    TraceSpan span("accept");
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        struct sockaddr_storage client_addr;
+        socklen_t addr_len = sizeof(client_addr);
+        int newfd = accept4(listener.fd, (struct sockaddr *)&client_addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newfd >= 0)
+            admitConnection(newfd, (struct sockaddr *)&client_addr, listener);
+        else if (errno == EMFILE || errno == ENFILE)
+            shedConnection(listener.fd);
+        else if (errno != EINTR && errno != ECONNABORTED)
+            return;
+    }
+}
+
+/*
+** A socket accepted by the event loop itself (multishot accept); a negative
+** value is the accept error. A completion backend fails an accept as soon as
+** the descriptor table is full, pending connection or not, so the listeners
+** are also paused until a client leaves.
+*/
+void Server::acceptClient(const Listener &listener, int newfd) {
+    TraceSpan span("accept");
+    struct sockaddr_storage client_addr;
     socklen_t addr_len = sizeof(client_addr);
-    int newfd = accept(listener, (struct sockaddr *)&client_addr, &addr_len);
 
+    if (newfd == -EMFILE || newfd == -ENFILE) {
+        shedConnection(listener.fd);
+        pauseAccept(true);
+    }
     if (newfd < 0)
         return;
-    std::string ip = inet_ntoa(client_addr.sin_addr);
-    addClient(newfd, ip);
-    logMessage("New connection from " + ip);
+    memset(&client_addr, 0, sizeof(client_addr));
+    transport->peerName(newfd, (struct sockaddr *)&client_addr, &addr_len);
+    admitConnection(newfd, (struct sockaddr *)&client_addr, listener);
+}
+
+void Server::pauseAccept(bool paused) {
+    for (size_t i = 0; i < listeners.size(); ++i)
+        setPollEvents(listeners[i].fd, paused ? 0 : POLLIN);
+    acceptPaused = paused;
+}
+
+/*
+** The per-address limit is checked before anything is allocated for the
+** connection, so a flood from one host costs an accept and a close.
+*/
+void Server::admitConnection(int newfd, const struct sockaddr *addr, const Listener &listener) {
+    std::string key = addressKey(addr);
+    std::map<std::string, size_t>::iterator it = ipConnections.find(key);
+
+    if (maxPerIp && !key.empty() && it != ipConnections.end() && it->second >= maxPerIp) {
+        struct iovec error;
+        error.iov_base = const_cast<char *>("ERROR :Too many connections from your host\r\n");
+        error.iov_len = strlen(static_cast<char *>(error.iov_base));
+        transport->send(newfd, &error, 1);
+        transport->release(newfd);
+        return;
+    }
+    if (listener.tls && !tls->accept(newfd)) {
+        transport->release(newfd);
+        return;
+    }
+    if (listener.websocket)
+        websocket->accept(newfd);
+    Client *client = addClient(newfd, addr, listener.connClass);
+    logMessage("New connection from " + client->getIpAddress() + " on " + listener.address);
+}
+
+/*
+** Out of descriptors: the spare descriptor is given up just long enough to
+** accept and close one pending connection, so the listener does not stay
+** readable and spin the loop.
+*/
+void Server::shedConnection(int listenerFd) {
+    if (spareFd >= 0)
+        close(spareFd);
+    int fd = accept(listenerFd, NULL, NULL);
+    if (fd >= 0)
+        close(fd);
+    spareFd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    logMessage("Out of file descriptors, pending connection dropped");
+}
+
+/*
+** IPv4 clients of a dual-stack listener arrive as ::ffff:a.b.c.d and are
+** keyed (and shown) as plain IPv4. Unix domain clients have no key.
+*/
+std::string Server::addressKey(const struct sockaddr *addr) {
+    if (addr && addr->sa_family == AF_INET) {
+        const struct sockaddr_in *in = reinterpret_cast<const struct sockaddr_in *>(addr);
+        return std::string(reinterpret_cast<const char *>(&in->sin_addr), sizeof(in->sin_addr));
+    }
+    if (addr && addr->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *in6 = reinterpret_cast<const struct sockaddr_in6 *>(addr);
+        const char *bytes = reinterpret_cast<const char *>(&in6->sin6_addr);
+        if (IN6_IS_ADDR_V4MAPPED(&in6->sin6_addr))
+            return std::string(bytes + 12, 4);
+        return std::string(bytes, sizeof(in6->sin6_addr));
+    }
+    return "";
+}
+
+std::string Server::addressKey(const Client *client) {
+    const char *address = reinterpret_cast<const char *>(client->getAddress());
+    if (client->getFamily() == AF_INET)
+        return std::string(address, 4);
+    if (client->getFamily() == AF_INET6)
+        return std::string(address, 16);
+    return "";
+}
+
+void Server::setBacklog(int length) {
+    if (length <= 0)
+        return;
+    backlog = length;
+    for (size_t i = 0; i < listeners.size(); ++i)
+        listen(listeners[i].fd, backlog);
 }
 
-void Server::addClient(int newfd, const std::string &ip) {
+/*
+** With TCP_DEFER_ACCEPT the kernel only reports a connection once the client
+** has sent something, so idle or half-open sockets never wake the loop.
+*/
+void Server::setDeferAccept(int seconds) {
+    deferAccept = seconds;
+    for (size_t i = 0; i < listeners.size(); ++i)
+        if (listeners[i].family != AF_UNIX)
+            setsockopt(listeners[i].fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds, sizeof(seconds));
+}
+
+void Server::setMaxPerIp(size_t connections) {
+    maxPerIp = connections;
+}
+
+bool Server::addOperator(const std::string &spec) {
+    std::string::size_type comma = spec.find(',');
+
+    if (comma == std::string::npos || comma == 0 || comma + 1 == spec.size())
+        return false;
+    operators[spec.substr(0, comma)] = spec.substr(comma + 1);
+    return true;
+}
+
+/*
+** "-tls <certificate>,<key>" (PEM files) wraps the transport in TLS for the
+** clients of "-listen tls:..." listeners; everyone else is unaffected.
+*/
+bool Server::setTls(const std::string &spec) {
+    std::string::size_type comma = spec.find(',');
+
+    if (tls || comma == std::string::npos || comma == 0 || comma + 1 == spec.size())
+        return false;
+    tls = new TlsTransport(transport, spec.substr(0, comma), spec.substr(comma + 1));
+    transport = tls;
+    return true;
+}
+
+/*
+** Output is already written once per tick, so Nagle's algorithm only adds a
+** delayed-ACK stall to the replies of a pipelining client.
+*/
+Client *Server::addClient(int newfd, const struct sockaddr *addr, int connClass) {
+    int yes = 1;
+
     if (clients.find(newfd) != clients.end())
         delete clients[newfd];
-    Client *client = new Client(newfd, ip);
+    Client *client = new Client(newfd, addr);
     clients[newfd] = client;
-
-    struct pollfd pfd;
-    pfd.fd = newfd;
-    pfd.events = POLLIN;
-    pfd.revents = 0;
-    pfds.push_back(pfd);
-    std::cout << "New client connected from " << ip << " on socket " << newfd << std::endl;
+    if (client->getFamily() != AF_UNIX) {
+        setsockopt(newfd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+        tuneSocket(newfd);
+    }
+    if (!addressKey(client).empty())
+        ipConnections[addressKey(client)]++;
+    assignConnClass(client, connClass);
+    if (capture.is_open())
+        captureEvent(CAPTURE_OPEN, newfd, NULL, 0);
+    removePollFd(newfd);
+    setPollEvents(newfd, POLLIN);
+    if (transport->readsDirect(newfd))
+        loop->recvMultishot(newfd);
+    std::cout << "New client connected from " << client->getIpAddress() << " on socket " << newfd << std::endl;
+    return client;
 }
 
+/*
+** Complete lines are parsed straight out of the receive buffer on the stack.
+** Only an unterminated tail is copied into the client, and that copy is
+** released as soon as the line is completed by the next read. Data the
+** transport already holds (a decrypted TLS record) will not make the socket
+** readable again, so it is taken now and left to drainInput().
+*/
 void Server::handleClientMessage(int client_fd) {
     char buffer[BUFFER_SIZE];
-    memset(buffer, 0, BUFFER_SIZE);
-    int bytes_received = recv(client_fd, buffer, BUFFER_SIZE - 1, 0);
+    int bytes_received;
 
-    if (bytes_received <= 0) {
+    do {
+        bytes_received = transport->receive(client_fd, buffer, BUFFER_SIZE);
+        if (bytes_received == -EAGAIN || bytes_received == -EWOULDBLOCK || bytes_received == -EINTR)
+            return;
+        handleClientData(client_fd, buffer, bytes_received);
+    } while (bytes_received > 0 && clients.count(client_fd) && transport->pending(client_fd));
+}
+
+/*
+** Data read by handleClientMessage() or delivered by a completion backend;
+** len is 0 on EOF and negative on error. A completion backend can deliver
+** several reads for one client per tick; only the first is parsed right
+** away, the rest is queued for drainInput() so the line budget holds.
+*/
+void Server::handleClientData(int client_fd, const char *data, int len) {
+    TraceSpan span("recv");
+    span.setArg("bytes", len);
+    std::map<int, Client *>::iterator it = clients.find(client_fd);
+    if (it == clients.end())
+        return;
+    if (len <= 0) {
         removeClient(client_fd);
         return;
     }
-    Client *client = clients[client_fd];
-    client->setBuffer(client->getBuffer() + std::string(buffer, bytes_received));
-    std::string &message = client->getBuffer();
-    size_t pos;
-    while ((pos = message.find_first_of("\r\n")) != std::string::npos) {
-        std::string command = message.substr(0, pos);
-        if (message[pos] == '\r' && pos + 1 < message.size() && message[pos + 1] == '\n')
-            message.erase(0, pos + 2);
-        else
-            message.erase(0, pos + 1);
+    Client *client = it->second;
+    if (inputBacklog.count(client_fd) || !tickReaders.insert(client_fd).second) {
+        client->stashInput(data, len);
+        inputBacklog.insert(client_fd);
+        return;
+    }
+    if (!client->hasPendingInput()) {
+        processInput(client, data, len);
+        return;
+    }
+    std::string pending;
+    client->takeInput(pending);
+    pending.append(data, len);
+    processInput(client, pending.data(), pending.size());
+}
+
+/*
+** Parses at most LINES_PER_TICK lines (fewer when overloaded) and leaves the rest in the client's
+** receive queue, so a flooding client gets the same share of a tick as
+** everybody else. A queue that reaches the class recvq limit stops the
+** client from being polled for input until drainInput() has caught up; one
+** that fills up without a single complete line is disconnected. Returns
+** false when the client is gone.
+**
+** Line ends are found SCAN_BATCH at a time by TextScan. A line containing
+** a NUL is dropped.
+*/
+bool Server::processInput(Client *client, const char *data, size_t len) {
+    int client_fd = client->getSocket();
+    size_t start = 0;
+    size_t lines = 0;
+    size_t breaks[SCAN_BATCH];
+    size_t found = 0;
+    size_t next = 0;
+    size_t base = 0;
+    size_t scanned = 0;
+    bool nul = false;
+
+    size_t maxLines = budget(client->isBridgeHost() ? BRIDGE_LINES : LINES_PER_TICK);
+
+    while (lines < maxLines) {
+        if (next == found) {
+            if (scanned >= len)
+                break;
+            base = scanned;
+            found = TextScan::findBreaks(data + base, len - base, breaks, SCAN_BATCH);
+            next = 0;
+            scanned = found < SCAN_BATCH ? len : base + breaks[found - 1] + 1;
+            continue;
+        }
+        size_t i = base + breaks[next++];
+        if (data[i] == '\0') {
+            nul = true;
+            continue;
+        }
+        std::string command(data + start, i - start);
+        start = i + 1;
+        if (nul || command.empty()) {
+            nul = false;
+            continue;
+        }
+        lines++;
+        if (capture.is_open())
+            captureEvent(CAPTURE_LINE, client_fd, command.data(), command.size());
         if (DEBUG)
             std::cout << "DEBUG: Raw Command Received: " << command << std::endl;
-        if (!command.empty() && command[0] == ':') {
+        if (client->isBridgeHost() && isdigit(static_cast<unsigned char>(command[0]))) {
+            bridgeLine(client, command);
+            if (clients.find(client_fd) == clients.end())
+                return false;
+            continue;
+        }
+        if (command[0] == ':') {
             if (DEBUG)
                 std::cout << "DEBUG: Ignored server message: " << command << std::endl;
             continue;
         }
         parseCommand(client, command);
+        if (clients.find(client_fd) == clients.end())
+            return false;
+    }
+    if (start >= len)
+        return true;
+    client->stashInput(data + start, len - start);
+    ConnClass &cls = classes[client->getConnClass()];
+    cls.recvqPeak = std::max(cls.recvqPeak, client->getInputSize());
+    if (lines == maxLines)
+        inputBacklog.insert(client_fd);
+    else if (client->isRecvqFull()) {
+        cls.recvqExceeded++;
+        removeClient(client_fd, "RecvQ exceeded");
+        return false;
+    }
+    return true;
+}
+
+/*
+** Parses the next batch of lines for every client left with a backlog by
+** the previous tick. While any backlog remains poll() does not block.
+*/
+void Server::drainInput() {
+    std::set<int> backlog;
+
+    backlog.swap(inputBacklog);
+    for (std::set<int>::iterator it = backlog.begin(); it != backlog.end(); ++it) {
+        std::map<int, Client *>::iterator clientIt = clients.find(*it);
+        if (clientIt == clients.end() || !clientIt->second->hasPendingInput())
+            continue;
+        std::string pending;
+        clientIt->second->takeInput(pending);
+        processInput(clientIt->second, pending.data(), pending.size());
     }
-    client->setBuffer(message);
 }
 
-void Server::removeClient(int fd) {
+/*
+** Tells the client why it is being dropped, lets everyone who shares a
+** channel with it see the QUIT, and releases the connection. The ERROR is
+** queued behind the client's pending output, so a layered transport sees
+** every byte go through the queue. A bridge takes its virtual users with
+** it; a virtual user only leaves its bridge.
+*/
+void Server::removeClient(int fd, const std::string &reason) {
     std::map<int, Client *>::iterator it = clients.find(fd);
     if (it != clients.end()) {
-        logMessage("Client disconnected: " + it->second->getIpAddress());
-        for (std::map<std::string, Channel *>::iterator chanIt = channels.begin(); chanIt != channels.end(); ++chanIt)
-            chanIt->second->removeUser(fd);
-        close(fd);
-        delete it->second;
+        Client *client = it->second;
+        if (client->isBridgeHost())
+            closeBridge(client);
+        logMessage("Client disconnected: " + client->getIpAddress() + " (" + reason + ")");
+        if (capture.is_open())
+            captureEvent(CAPTURE_CLOSE, fd, NULL, 0);
+        if (client->isRegistered())
+            propagate(":" + client->getNickName() + " QUIT :" + reason);
+        quitChannels(client, reason);
+        clearMonitor(client);
+        if (client->isRegistered())
+            notifyOffline(client->getNickName());
+        client->queue(SharedBuffer("ERROR :Closing Link: " + client->getIpAddress() + " (" + reason + ")\r\n"));
+        client->flush(*transport);
+        std::map<NickName, Client *>::iterator nickIt = nicks.find(client->getNick());
+        if (nickIt != nicks.end() && nickIt->second == client)
+            nicks.erase(nickIt);
+        classes[client->getConnClass()].clients--;
+        std::map<std::string, size_t>::iterator ipIt = ipConnections.find(addressKey(client));
+        if (ipIt != ipConnections.end() && --ipIt->second == 0)
+            ipConnections.erase(ipIt);
+        if (client->isVirtual())
+            bridges[client->getBridge()->getSocket()].users.erase(client->getTag());
+        else
+            transport->release(fd);
+        delete client;
         clients.erase(it);
     }    
-    for (std::vector<struct pollfd>::iterator pfdIt = pfds.begin(); pfdIt != pfds.end(); ++pfdIt) {
-        if (pfdIt->fd == fd) {
-            pfds.erase(pfdIt);
+    inputBacklog.erase(fd);
+    queries.erase(fd);
+    if (fd >= 0)
+        removePollFd(fd);
+    if (acceptPaused && !load.degraded)
+        pauseAccept(false);
+}
+
+/*
+** Removes a local or remote client from all of its channels. Every local
+** member who shared at least one of them receives the QUIT exactly once.
+*/
+void Server::quitChannels(Client *client, const std::string &reason) {
+    TaggedLine quitMessage(SharedBuffer(client->getPrefix() + " QUIT :" + reason + "\r\n"));
+    Fanout fanout(quitMessage);
+    std::set<Client *> notified;
+    std::map<ChannelName, Channel *>::iterator it = channels.begin();
+
+    while (it != channels.end()) {
+        Channel *channel = it->second;
+        bool unannounced = dropNotices(channel, client->getSocket());
+        if (!channel->isUserInChannel(client->getSocket())) {
+            channel->removeUser(client->getSocket());
+            ++it;
+            continue;
+        }
+        flushNotices(channel);
+        const std::map<int, Client *> &users = channel->getUsers();
+        for (std::map<int, Client *>::const_iterator user = users.begin(); !unannounced && user != users.end(); ++user) {
+            if (user->second != client && !user->second->isRemote() && notified.insert(user->second).second)
+                fanout.add(user->second);
+        }
+        channel->removeUser(client->getSocket());
+        if (channel->listUsers().empty()) {
+            std::map<ChannelName, Channel *>::iterator temp = it;
+            ++it;
+            deleteChannel(temp);
+            continue;
+        }
+        ++it;
+    }
+    fanout.send();
+}
+
+/*
+** Classes are matched in the order they were configured, the default class
+** last. An existing class is updated in place so "-class default,..." can
+** change the default limits.
+*/
+void Server::addConnClass(const std::string &name, size_t sendq, size_t recvq, const std::string &mask) {
+    for (size_t i = 0; i < classes.size(); ++i) {
+        if (classes[i].name == name) {
+            classes[i].sendq = sendq;
+            classes[i].recvq = recvq;
+            classes[i].mask = mask;
+            return;
+        }
+    }
+    if (classes.size() >= MAX_CLASSES)
+        throw std::runtime_error("Error: too many connection classes");
+    ConnClass cls;
+    cls.name = name;
+    cls.mask = mask;
+    cls.listenerOnly = false;
+    cls.sendq = sendq;
+    cls.recvq = recvq;
+    cls.clients = 0;
+    cls.sendqPeak = 0;
+    cls.recvqPeak = 0;
+    cls.sendqExceeded = 0;
+    cls.recvqExceeded = 0;
+    classes.push_back(cls);
+}
+
+/*
+** The class of the listener the client came in on, if it has one, otherwise
+** the first class whose mask matches the address.
+*/
+void Server::assignConnClass(Client *client, int connClass) {
+    std::string address = client->getIpAddress();
+    size_t index = connClass >= 0 ? connClass : 0;
+
+    for (size_t i = 1; i < classes.size() && connClass < 0; ++i) {
+        if (!classes[i].listenerOnly && address.compare(0, classes[i].mask.size(), classes[i].mask) == 0) {
+            index = i;
             break;
         }
     }
+    client->setConnClass(index, classes[index].sendq, classes[index].recvq);
+    classes[index].clients++;
+}
+
+std::vector<std::string> Server::splitList(const std::string &list) {
+    std::vector<std::string> items;
+    std::string::size_type start = 0;
+    std::string::size_type comma;
+
+    while ((comma = list.find(',', start)) != std::string::npos) {
+        items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    items.push_back(list.substr(start));
+    return items;
+}
+
+void Server::setMaxTargets(size_t targets) {
+    if (targets > 0)
+        maxTargets = targets;
+}
+
+void Server::setPollEvents(int fd, short events) {
+    if (loop)
+        loop->setEvents(fd, events);
+}
+
+void Server::removePollFd(int fd) {
+    if (loop)
+        loop->remove(fd);
+}
+
+Client *Server::findClientByNick(const NickName &nick) {
+    std::map<NickName, Client *>::iterator it = nicks.find(nick);
+    return it == nicks.end() ? NULL : it->second;
+}
+
+/*
+** Renames a local or remote client and keeps the casefolded nick index in
+** step. The client's cached prefix is rebuilt by setNickName().
+*/
+void Server::setClientNick(Client *client, const std::string &nick) {
+    std::map<NickName, Client *>::iterator it = nicks.find(client->getNick());
+    if (it != nicks.end() && it->second == client)
+        nicks.erase(it);
+    client->setNickName(nick);
+    nicks[client->getNick()] = client;
+    for (std::map<ChannelName, Channel *>::iterator cit = channels.begin(); cit != channels.end(); ++cit)
+        cit->second->forgetBanVerdict(client->getSocket());
 }
 
 void Server::parseCommand(Client *client, const std::string &message) {
     if (message.empty())
         return;
 
-    std::istringstream iss(message);
     std::vector<std::string> params;
     std::string command;
-    iss >> command;
-
-    std::string param;
-    while (iss >> param) {
-        if (!param.empty() && param[0] == ':') {  
-            std::string rest;
-            std::getline(iss, rest);
-            param = param.substr(1) + (rest.empty() ? "" : " " + rest);  
-            params.push_back(param);
+    std::string::size_type pos = 0;
+    messageTags.clear();
+    if (message[0] == '@') {
+        pos = message.find(' ');
+        if (pos == std::string::npos)
+            return;
+        if (client->hasCap(CAP_MESSAGE_TAGS))
+            messageTags = clientOnlyTags(message.substr(1, pos - 1));
+    }
+    while (pos < message.size()) {
+        if (message[pos] == ' ') {
+            ++pos;
+            continue;
+        }
+        if (!command.empty() && message[pos] == ':') {
+            params.push_back(message.substr(pos + 1));
             break;
         }
-        params.push_back(param);
+        std::string::size_type end = message.find(' ', pos);
+        if (end == std::string::npos)
+            end = message.size();
+        if (command.empty())
+            command = message.substr(pos, end - pos);
+        else
+            params.push_back(message.substr(pos, end - pos));
+        pos = end;
     }
     if (DEBUG) {
         std::cout << "DEBUG: Command = \"" << command << "\"\n";
@@ -215,30 +934,185 @@ void Server::parseCommand(Client *client, const std::string &message) {
     }
     std::transform(command.begin(), command.end(), command.begin(), static_cast<int(*)(int)>(std::toupper));
     
-    std::string commands[] = {"PING", "PASS", "USER", "NICK", "JOIN", "PRIVMSG", "MODE", "QUIT", "PART", "TOPIC", "KICK", "INVITE"};
+    static const char *const commands[] = {"PING", "PASS", "USER", "NICK", "JOIN", "PRIVMSG", "MODE", "QUIT", "PART",
+        "TOPIC", "KICK", "INVITE", "CHATHISTORY", "NOTICE", "STATS", "MONITOR", "LIST", "WHO", "WHOIS", "OPER", "SPANS",
+        "BRIDGE", "CAP", "TAGMSG"};
     t_handlers handlers[] = {&Server::handlePING, &Server::handlePASS, &Server::handleUSER, &Server::handleNICK,
         &Server::handleJOIN, &Server::handlePRIVMSG, &Server::handleMODE, &Server::handleQUIT,
-        &Server::handlePART, &Server::handleTOPIC, &Server::handleKICK, &Server::handleINVITE}; 
+        &Server::handlePART, &Server::handleTOPIC, &Server::handleKICK, &Server::handleINVITE,
+        &Server::handleCHATHISTORY, &Server::handleNOTICE, &Server::handleSTATS,
+        &Server::handleMONITOR, &Server::handleLIST, &Server::handleWHO, &Server::handleWHOIS, &Server::handleOPER,
+        &Server::handleSPANS, &Server::handleBRIDGE, &Server::handleCAP, &Server::handleTAGMSG};
     
     for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
         if (command == commands[i]) {
-           (this->*handlers[i])(client, params);
+            TraceSpan span(commands[i]);
+            (this->*handlers[i])(client, params);
             return;
         }
     }
-    if (command == "CAP" || command == "WHOIS" || command == "WHO") {
-        if (DEBUG)
-            std::cout << "DEBUG: Raw Command Ignored: " << command << "\r\n";
-    } else
-        sendToClient(client->getSocket(), "421 " + command + " :Unknown command\r\n");
+    sendNumeric(client, ERR_UNKNOWNCOMMAND, command);
 }
 
 void Server::sendToClient(int client_fd, const std::string &message) {
-    if (send(client_fd, message.c_str(), message.length(), 0) < 0) {
+    std::map<int, Client *>::iterator it = clients.find(client_fd);
+    if (it == clients.end()) {
         std::ostringstream oss;
         oss << "Error sending to client " << client_fd;
         logMessage(oss.str());
+        return;
+    }
+    it->second->queue(SharedBuffer(message));
+}
+
+/*
+** Numerics go through Reply, straight into the client's send queue.
+*/
+void Server::sendNumeric(Client *client, ReplyId id) {
+    Reply::send(*client, serverName, id, NULL, 0);
+}
+
+void Server::sendNumeric(Client *client, ReplyId id, const ReplyArg &a) {
+    const ReplyArg *args[] = {&a};
+    Reply::send(*client, serverName, id, args, 1);
+}
+
+void Server::sendNumeric(Client *client, ReplyId id, const ReplyArg &a, const ReplyArg &b) {
+    const ReplyArg *args[] = {&a, &b};
+    Reply::send(*client, serverName, id, args, 2);
+}
+
+void Server::sendNumeric(Client *client, ReplyId id, const ReplyArg &a, const ReplyArg &b, const ReplyArg &c) {
+    const ReplyArg *args[] = {&a, &b, &c};
+    Reply::send(*client, serverName, id, args, 3);
+}
+
+void Server::sendNumeric(Client *client, ReplyId id, const ReplyArg *const *args, size_t count) {
+    Reply::send(*client, serverName, id, args, count);
+}
+
+/*
+** Called once per poll tick. Pending CHATHISTORY replay is moved into the
+** send queue REPLAY_CHUNK lines at a time while the queue is short, so a
+** large catch-up is spread over several ticks instead of stalling the loop.
+** Every client with queued output then contributes one SendRequest and the
+** event loop writes the whole batch, repeating for clients that had more
+** than FLUSH_IOV lines queued. Poll interest is refreshed last; the
+** backends ignore unchanged masks. Virtual clients queue into their bridge,
+** which also stands in for them when it comes to polling; their negative
+** fds come first in the map.
+*/
+void Server::flushClients() {
+    std::vector<int> dead;
+    std::vector<int> slow;
+    std::vector<Client *> pending;
+    std::vector<SendRequest> batch;
+    std::set<Client *> busyBridges;
+
+    {
+        TraceSpan span("flushNotices");
+        span.setArg("channels", notices.size());
+        flushNotices();
+    }
+    {
+        TraceSpan span("advanceQueries");
+        span.setArg("cursors", queries.size());
+        advanceQueries();
+    }
+    load.sendq = 0;
+    for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        Client *client = it->second;
+        ConnClass &cls = classes[client->getConnClass()];
+        if (client->isSendqExceeded()) {
+            cls.sendqExceeded++;
+            slow.push_back(it->first);
+            continue;
+        }
+        cls.sendqPeak = std::max(cls.sendqPeak, client->getSendQueueSize());
+        Client *sink = client->isVirtual() ? client->getBridge() : client;
+        if (client->hasPendingReplay() && sink->getSendQueueSize() < REPLAY_WATERMARK)
+            client->feedReplay(budget(REPLAY_CHUNK));
+        load.sendq += client->getSendQueueSize();
+        if (client->hasPendingOutput())
+            pending.push_back(client);
+    }
+    while (!pending.empty()) {
+        batch.resize(pending.size());
+        for (size_t i = 0; i < pending.size(); ++i)
+            pending[i]->prepareSend(batch[i]);
+        TraceSpan span("sendBatch");
+        span.setArg("clients", batch.size());
+        transport->sendBatch(*loop, batch);
+        std::vector<Client *> more;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            int status = pending[i]->completeSend(batch[i]);
+            if (status < 0)
+                dead.push_back(pending[i]->getSocket());
+            else if (status > 0)
+                more.push_back(pending[i]);
+        }
+        pending.swap(more);
     }
+    for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        Client *client = it->second;
+        bool busy = client->hasPendingReplay() || hasPendingQuery(it->first);
+        if (client->isVirtual()) {
+            if (busy)
+                busyBridges.insert(client->getBridge());
+            continue;
+        }
+        short events = client->isRecvqFull() ? 0 : POLLIN;
+        if (client->hasPendingOutput() || busy || busyBridges.count(client))
+            events |= POLLOUT;
+        setPollEvents(it->first, events);
+    }
+    for (size_t i = 0; i < dead.size(); ++i)
+        removeClient(dead[i]);
+    for (size_t i = 0; i < slow.size(); ++i)
+        removeClient(slow[i], "SendQ exceeded");
+}
+
+void Server::deleteChannel(std::map<ChannelName, Channel *>::iterator it) {
+    Channel *channel = it->second;
+    std::map<Channel *, std::list<Channel *>::iterator>::iterator lru = historyLruPos.find(channel);
+    if (lru != historyLruPos.end()) {
+        historyLru.erase(lru->second);
+        historyLruPos.erase(lru);
+    }
+    historyBytes -= channel->getHistoryBytes();
+    notices.erase(channel->getKey());
+    delete channel;
+    channels.erase(it);
+}
+
+/*
+** Stores a channel message that was just fanned out. The history shares the
+** fan-out buffer, so recording it costs no copy. When all channels together
+** hold more than HISTORY_MEMORY bytes, the oldest lines of the least recently
+** active channels are evicted first.
+*/
+void Server::recordHistory(Channel *channel, const SharedBuffer &line) {
+    historyBytes += channel->addHistory(line, ServerTime::now());
+    std::map<Channel *, std::list<Channel *>::iterator>::iterator lru = historyLruPos.find(channel);
+    if (lru != historyLruPos.end())
+        historyLru.erase(lru->second);
+    historyLru.push_back(channel);
+    historyLruPos[channel] = --historyLru.end();
+
+    while (historyBytes > HISTORY_MEMORY && !historyLru.empty()) {
+        Channel *oldest = historyLru.front();
+        historyBytes -= oldest->evictHistory();
+        if (oldest->getHistory().empty()) {
+            historyLru.pop_front();
+            historyLruPos.erase(oldest);
+        }
+    }
+}
+
+long long Server::nowMillis() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
 void Server::broadcastMessage(const std::string &message, int exclude_fd) {
@@ -249,78 +1123,100 @@ void Server::broadcastMessage(const std::string &message, int exclude_fd) {
 }
 
 void Server::logMessage(const std::string &message) {
+    TraceSpan span("log");
     logFile << message << std::endl;
     logFile.flush();
 }
 
 void Server::handlePASS(Client *client, const std::vector<std::string> &params) {
     if (params.empty()) {
-        sendToClient(client->getSocket(), ":server 461 PASS :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "PASS");
         return;
     }
-    if (client->isRegistered())
+    if (client->isRegistered() || client->isVirtual())
     {
-        sendToClient(client->getSocket(), ":server 462 :You may not reregister\r\n");
+        sendNumeric(client, ERR_ALREADYREGISTERED);
         return ;
     }
     std::string receivedPassword = params[0];
     if (client->checkPassword(receivedPassword, this->password)) {
         client->setAuthenticated(true);
-        std::string nick = client->getNickName();
-        if (nick.empty())
-            nick = "*";
-        sendToClient(client->getSocket(), ":server 001 " + nick + " :Password accepted, proceed to register\r\n");
-        usleep(1000);
+        sendNumeric(client, RPL_PASSACCEPTED);
     } else {
-        sendToClient(client->getSocket(), ":server 464 :Password incorrect\r\n");
-        close(client->getSocket());
-        clients.erase(client->getSocket());
-        delete client;
+        sendNumeric(client, ERR_PASSWDMISMATCH);
+        removeClient(client->getSocket(), "Password incorrect");
     }
 }
 
 void Server::handleNICK(Client *client, const std::vector<std::string> &params) {
     if (!this->password.empty() && !client->isAuthenticated()) {
-        sendToClient(client->getSocket(), "462 :You must provide the correct PASS before registering\r\n");
+        sendNumeric(client, ERR_PASSFIRST);
         return ;
     }
     if (params.empty()) {
-        sendToClient(client->getSocket(), "431 :No nickname given\r\n");
+        sendNumeric(client, ERR_NONICKNAMEGIVEN);
         return;
     }
     std::string newNick = params[0];
     if (newNick.length() > 9)
     {
-        sendToClient(client->getSocket(), "432 " + newNick + " :Nickname must not exceed 9 characters\r\n");
+        sendNumeric(client, ERR_NICKNAMETOOLONG, newNick);
         return ;
     }
     if (!isalpha(newNick[0])) {
-        sendToClient(client->getSocket(), "432 " + newNick + " :Invalid nickname format\r\n");
+        sendNumeric(client, ERR_ERRONEUSNICKNAME, newNick);
         return;
     }
     for (size_t i = 1; i < newNick.length(); ++i) {
         if (!isalnum(newNick[i]) && newNick[i] != '-' && newNick[i] != '_') {
-            sendToClient(client->getSocket(), "432 " + newNick + " :Invalid nickname format\r\n");
+            sendNumeric(client, ERR_ERRONEUSNICKNAME, newNick);
             return;
         }
     }
-    std::map<int, Client *>::iterator it;
-    for (it = clients.begin(); it != clients.end(); ++it) {
-        if (it->second->getNickName() == newNick) {
-            sendToClient(client->getSocket(), "433 " + client->getNickName() + " " + newNick + " :Nickname already in use\r\n");
+    Client *holder = findClientByNick(newNick);
+    if (holder && holder != client) {
+        sendNumeric(client, ERR_NICKNAMEINUSE, newNick);
+        return;
+    }
+    for (std::map<ChannelName, Channel *>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        Channel *channel = it->second;
+        if (channel->isUserInChannel(client->getSocket()) && !channel->isOperator(client->getSocket())
+            && channel->isBanned(client)) {
+            sendNumeric(client, ERR_BANNICKCHANGE, newNick, channel->getName());
             return;
         }
     }
     std::string oldNick = client->getNickName();
-    client->setNickName(newNick);
-    sendToClient(client->getSocket(), ":" + oldNick + "!" + client->getUserName() + "@" + client->getIpAddress() + " NICK " + newNick + "\r\n");
-    if (!client->getUserName().empty()) {
+    std::string oldPrefix = client->getPrefix();
+    bool wasRegistered = client->isRegistered();
+    setClientNick(client, newNick);
+    sendToClient(client->getSocket(), oldPrefix + " NICK " + newNick + "\r\n");
+    if (!client->getUserName().empty() && !client->isNegotiating()) {
         client->setRegistered(true);
-        sendToClient(client->getSocket(), "001 " + newNick + " :Welcome to the IRC server\r\n");
+        if (wasRegistered) {
+            propagate(":" + oldNick + " NICK " + newNick);
+            if (NickName(oldNick) != client->getNick())
+                notifyOffline(oldNick);
+            notifyOnline(client);
+        } else
+            sendWelcome(client);
     }
 }
 
 
+void Server::sendWelcome(Client *client) {
+    std::ostringstream isupport;
+    isupport << "TARGMAX=PRIVMSG:" << maxTargets << ",NOTICE:" << maxTargets
+        << ",JOIN:,PART: CHANTYPES=#&!+ CASEMAPPING=rfc1459 CHATHISTORY=" << CHATHISTORY_MAX << " UTF8ONLY"
+        << " CHANMODES=beI,k,l,it EXCEPTS INVEX MAXLIST=beI:" << MAXLIST
+        << " MONITOR=" << MONITOR_MAX << " MODES=" << MODES_MAX
+        << " SAFELIST ELIST=MNU";
+    sendNumeric(client, RPL_WELCOME);
+    sendNumeric(client, RPL_ISUPPORT, isupport.str());
+    introduceClient(client);
+    notifyOnline(client);
+}
+
 void Server::handleUSER(Client *client, const std::vector<std::string> &params) {
     if (DEBUG) {
         std::cout << "DEBUG: params.size() = " << params.size() << std::endl;
@@ -329,11 +1225,11 @@ void Server::handleUSER(Client *client, const std::vector<std::string> &params)
         }
     }
     if (params.size() < 4) {
-        sendToClient(client->getSocket(), "461 USER :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "USER");
         return;
     }
     if (client->isRegistered()) {
-        sendToClient(client->getSocket(), "462 :You may not reregister\r\n");
+        sendNumeric(client, ERR_ALREADYREGISTERED);
         return;
     }
     client->setUserName(params[0]);
@@ -344,9 +1240,9 @@ void Server::handleUSER(Client *client, const std::vector<std::string> &params)
         realName += " " + params[i];
     }
     client->setRealName(realName);
-    if (!client->getNickName().empty()) {
+    if (!client->getNickName().empty() && !client->isNegotiating()) {
         client->setRegistered(true);
-        sendToClient(client->getSocket(), "001 " + client->getNickName() + " :Welcome to the IRC server\r\n");
+        sendWelcome(client);
     }
 }
 
@@ -354,46 +1250,39 @@ void Server::handleQUIT(Client *client, const std::vector<std::string> &params)
     if (!client)
         return;
     std::string quitMsg = params.empty() ? "Client Quit" : params[0];
-    std::map<std::string, Channel *>::iterator it = channels.begin();
-    while (it != channels.end()) {
-        Channel *channel = it->second;
-        if (channel->isUserInChannel(client->getSocket())) {
-            std::string quitMessage = ":" + client->getNickName() + " QUIT :" + quitMsg + "\r\n";
-            channel->broadcastMessage(quitMessage, client->getSocket());
-            channel->removeUser(client->getSocket());
-            if (channel->listUsers().empty()) {
-                delete channel; 
-                std::map<std::string, Channel *>::iterator temp = it; 
-                ++it;
-                channels.erase(temp);
-                continue;
-            }
-        }
-        ++it;
-    }
-    sendToClient(client->getSocket(), ":" + client->getNickName() + " QUIT :" + quitMsg + "\r\n");
-    close(client->getSocket());
+    sendToClient(client->getSocket(), client->getPrefix() + " QUIT :" + quitMsg + "\r\n");
+    removeClient(client->getSocket(), quitMsg);
 }
 
 void Server::handleJOIN(Client *client, const std::vector<std::string> &params) {
     if (params.empty()) {
-        sendToClient(client->getSocket(), "461 JOIN :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "JOIN");
         return;
     }
     if (!client->isRegistered()) {
-        sendToClient(client->getSocket(), "451 JOIN :You have not registered\r\n");
+        sendNumeric(client, ERR_NOTREGISTERED, "JOIN");
         return;
     }
-    std::string channelName = params[0];
+    std::vector<std::string> names = splitList(params[0]);
+    std::vector<std::string> keys;
+    if (params.size() > 1)
+        keys = splitList(params[1]);
+    for (size_t i = 0; i < names.size(); ++i)
+        joinChannel(client, names[i], i < keys.size() ? keys[i] : "");
+}
 
+/*
+** Joins one channel of a JOIN list.
+*/
+void Server::joinChannel(Client *client, const std::string &channelName, const std::string &key) {
     if (channelName.empty() || (channelName[0] != '#' && channelName[0] != '+' &&
         channelName[0] != '!' && channelName[0] != '&')) {
-        sendToClient(client->getSocket(), "403 " + channelName + " :No such channel\r\n");
+        sendNumeric(client, ERR_NOSUCHCHANNEL, channelName);
         return;
     }
     if (channelName.length() > 50)
     {
-        sendToClient(client->getSocket(), "417 " + channelName + " :channelname must not exceed 50 characters\r\n");
+        sendNumeric(client, ERR_CHANNELNAMETOOLONG, channelName);
         return ;
     }
     if (channels.find(channelName) == channels.end()) {
@@ -402,178 +1291,189 @@ void Server::handleJOIN(Client *client, const std::vector<std::string> &params)
     Channel *channel = channels[channelName];
     if (channel->hasMode('l') && channel->isFull())
     {
-        sendToClient(client->getSocket(), "471 " + client->getNickName() + " " + channelName + " :Cannot join channel (+l) - channel is full\r\n");
+        sendNumeric(client, ERR_CHANNELISFULL, channelName);
         return;
     }
-    if (channel->hasMode('i') && !client->isInvitedToChannel(channelName)) {
-        sendToClient(client->getSocket(), "473 " + client->getNickName() + " " + channelName + " :Cannot join channel (+i)\r\n");
+    if (channel->hasMode('i') && !channel->isInvited(client->getSocket()) && !channel->isInviteExempt(client)) {
+        sendNumeric(client, ERR_INVITEONLYCHAN, channelName);
+        return;
+    }
+    if (!channel->isInvited(client->getSocket()) && channel->isBanned(client)) {
+        sendNumeric(client, ERR_BANNEDFROMCHAN, channelName);
         return;
     }
     if (channel->hasMode('k')) {
-        if (params.size() < 2) {
-            sendToClient(client->getSocket(), "475 " + client->getNickName() + " " + channelName + " :Cannot join channel (+k) - Missing password\r\n");
+        if (key.empty()) {
+            sendNumeric(client, ERR_MISSINGKEY, channelName);
             return;
-        }        
-        std::string providedPassword = params[1];
-        if (!channel->checkPassword(providedPassword)) {
-            sendToClient(client->getSocket(), "475 " + client->getNickName() + " " + channelName + " :Cannot join channel (+k) - Incorrect password\r\n");
+        }
+        if (!channel->checkPassword(key)) {
+            sendNumeric(client, ERR_BADCHANNELKEY, channelName);
             return;
         }
     } 
     if (channel->isUserInChannel(client->getSocket())) {
-        sendToClient(client->getSocket(), "443 " + client->getNickName() + " " + channelName + " :You're already in the channel\r\n");
+        sendNumeric(client, ERR_USERONCHANNEL, client->getNick(), channelName);
         return;
     }
     channel->addUser(client);
-    std::string joinMessage = ":" + client->getNickName() + "!" + client->getUserName() + "@" + client->getIpAddress() + " JOIN " + channelName + "\r\n";
+    std::string joinMessage = client->getPrefix() + " JOIN " + channelName + "\r\n";
     sendToClient(client->getSocket(), joinMessage);
-    channel->broadcastMessage(joinMessage, client->getSocket());
+    channelNotice(channel, client, joinMessage, true);
+    propagate(":" + client->getNickName() + " JOIN " + channelName);
     if (!channel->getTopic().empty()) {
-        sendToClient(client->getSocket(), "332 " + client->getNickName() + " " + channelName + " :" + channel->getTopic() + "\r\n");
-    }
-    std::vector<std::string> users = channel->listUsers();
-    std::string userList = "353 " + client->getNickName() + " @ " + channelName + " :";
-    for (size_t i = 0; i < users.size(); i++) {
-        Client *userClient = channel->getUserByNick(users[i]);
-        if (userClient && channel->isOperator(userClient->getSocket()))
-            userList += "@" + users[i] + " ";
-        else
-            userList += users[i] + " ";
+        sendNumeric(client, RPL_TOPIC, channelName, channel->getTopic());
     }
-    userList += "\r\n";
-    sendToClient(client->getSocket(), userList);
-    sendToClient(client->getSocket(), "366 " + client->getNickName() + " " + channelName + " :End of /NAMES list\r\n");
+    sendNames(client, channel);
 }
-
 void Server::handlePRIVMSG(Client *client, const std::vector<std::string> &params) {
+    deliverMessage(client, params, "PRIVMSG");
+}
+
+void Server::handleNOTICE(Client *client, const std::vector<std::string> &params) {
+    deliverMessage(client, params, "NOTICE");
+}
+
+/*
+** Shared by PRIVMSG and NOTICE. The target list is comma separated and
+** capped at maxTargets. The source prefix and the " :text" tail are built
+** once and reused for every target. NOTICE never generates error replies.
+*/
+void Server::deliverMessage(Client *client, const std::vector<std::string> &params, const std::string &command) {
+    bool notice = command == "NOTICE";
     if (params.size() < 2) {
-        sendToClient(client->getSocket(), "461 PRIVMSG :Not enough parameters\r\n");
+        if (!notice)
+            sendNumeric(client, ERR_NEEDMOREPARAMS, command);
         return;
     }
-    std::string target = params[0];
     std::string message;
     for (size_t i = 1; i < params.size(); i++) {
         message += params[i] + " ";
     }
     message = message.substr(0, message.length() - 1);
     if (message.length() > 256) {
-        sendToClient(client->getSocket(), "417 PRIVMSG :Message too long (max 256 characters)\r\n");
+        if (!notice)
+            sendNumeric(client, ERR_INPUTTOOLONG, command);
         return;
     }
-    if (target[0] == '#' || target[0] == '!' || target[0] == '&' || target[0] == '+') { 
-        std::map<std::string, Channel*>::iterator channelIt = channels.find(target);
-        if (channelIt == channels.end()) {
-            sendToClient(client->getSocket(), "403 " + target + " :No such channel\r\n");
-            return;
-        }
-        Channel *channel = channelIt->second;
-        if (!channel->isUserInChannel(client->getSocket())) {
-            sendToClient(client->getSocket(), "404 " + target + " :Cannot send to channel\r\n");
-            return;
-        }
-        channel->broadcastMessage(":" + client->getNickName() + "!" + "~" + client->getUserName()
-            + "@localhost" + " PRIVMSG " + target + " :" + message + "\r\n", client->getSocket());
-    } 
-    else {
-        bool found = false;
-        for (std::map<int, Client*>::iterator it = clients.begin(); it != clients.end(); ++it) {
-            if (it->second->getNickName() == target) {
-                sendToClient(it->second->getSocket(), ":" + client->getNickName() + " PRIVMSG " + target + " :" + message + "\r\n");
-                found = true;
-                break;
+    if (!TextScan::isUtf8(message.data(), message.size())) {
+        if (!notice)
+            sendToClient(client->getSocket(), ":" + serverName + " FAIL " + command + " INVALID_UTF8 :Message is not valid UTF-8\r\n");
+        return;
+    }
+    std::vector<std::string> list = splitList(params[0]);
+    std::vector<std::string> targets;
+    std::set<ChannelName> seenChannels;
+    std::set<NickName> seenNicks;
+    for (size_t i = 0; i < list.size(); ++i) {
+        if (list[i].empty())
+            continue;
+        if (std::strchr("#!&+", list[i][0]) ? ChannelName(list[i]).valid() && !seenChannels.insert(list[i]).second
+            : NickName(list[i]).valid() && !seenNicks.insert(list[i]).second)
+            continue;
+        targets.push_back(list[i]);
+    }
+    if (targets.size() > maxTargets) {
+        if (!notice)
+            sendNumeric(client, ERR_TOOMANYTARGETS, params[0]);
+        return;
+    }
+
+    std::string prefix = client->getPrefix() + " " + command + " ";
+    std::string linkPrefix = ":" + client->getNickName() + " " + command + " ";
+    std::string linkTail = " :" + message;
+    std::string tail = linkTail + "\r\n";
+    std::string line;
+    for (size_t t = 0; t < targets.size(); ++t) {
+        const std::string &target = targets[t];
+        line.reserve(prefix.size() + target.size() + tail.size());
+        line.assign(prefix).append(target).append(tail);
+        if (target[0] == '#' || target[0] == '!' || target[0] == '&' || target[0] == '+') { 
+            std::map<ChannelName, Channel *>::iterator channelIt = channels.find(target);
+            if (channelIt == channels.end()) {
+                if (!notice)
+                    sendNumeric(client, ERR_NOSUCHCHANNEL, target);
+                continue;
+            }
+            Channel *channel = channelIt->second;
+            if (!channel->isUserInChannel(client->getSocket())) {
+                if (!notice)
+                    sendNumeric(client, ERR_CANNOTSENDTOCHAN, target);
+                continue;
             }
+            if (!channel->isOperator(client->getSocket()) && channel->isBanned(client)) {
+                if (!notice)
+                    sendNumeric(client, ERR_CANNOTSENDBANNED, target);
+                continue;
+            }
+            TaggedLine tagged(SharedBuffer(line), messageTags);
+            flushNotices(channel);
+            {
+                TraceSpan span("fanout");
+                span.setArg("recipients", channel->getUsers().size() - 1);
+                channel->broadcastMessage(tagged, client->getSocket());
+            }
+            recordHistory(channel, tagged.plain());
+            routeToChannel(channel, linkPrefix + target + linkTail);
+            if (client->hasCap(CAP_ECHO_MESSAGE))
+                client->queue(tagged.forCaps(client->getCaps()));
+            continue;
         }
-        if (!found) {
-            sendToClient(client->getSocket(), "401 " + target + " :No such nick\r\n");
+        Client *targetClient = findClientByNick(target);
+        if (!targetClient) {
+            if (!notice)
+                sendNumeric(client, ERR_NOSUCHNICK, target);
+            continue;
         }
+        TaggedLine tagged(SharedBuffer(line), messageTags);
+        if (targetClient->isRemote())
+            routeToClient(targetClient, linkPrefix + target + linkTail);
+        else
+            targetClient->queue(tagged.forCaps(targetClient->getCaps()));
+        if (client->hasCap(CAP_ECHO_MESSAGE))
+            client->queue(tagged.forCaps(client->getCaps()));
     }
 }
-
 void Server::handleMODE(Client *client, const std::vector<std::string> &params) {
     if (params.empty()) {
-        sendToClient(client->getSocket(), "461 MODE :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "MODE");
         return;
     }
     std::string target = params[0];
     if (!target.empty() && (target[0] == '#' || target[0] == '!' || target[0] == '&' || target[0] == '+')) {
-        std::map<std::string, Channel*>::iterator channelIt = channels.find(target);
+        std::map<ChannelName, Channel *>::iterator channelIt = channels.find(target);
         if (channelIt == channels.end()) {
-            sendToClient(client->getSocket(), "403 " + target + " :No such channel\r\n");
+            sendNumeric(client, ERR_NOSUCHCHANNEL, target);
             return;
         }
         Channel *channel = channelIt->second;
+        if (params.size() == 2 && params[1].find_first_not_of("+") == params[1].size() - 1
+            && channel->getMaskList(params[1][params[1].size() - 1])) {
+            sendMaskList(client, channel, params[1][params[1].size() - 1]);
+            return;
+        }
         if (params.size() < 2) {
-            std::stringstream ss;
-            ss << " Currents modes:" << " i->" << (channel->hasMode('i') ? "yes" : "no")
-                << " t->" << (channel->hasMode('t') ? "yes" : "no")
-                << " k->" << (channel->hasMode('k') ? "yes" : "no")
-                << " l->" <<(channel->hasMode('l') ? "yes" : "no") << "\r\n";
-            sendToClient(client->getSocket(), "482 " + target + ss.str());
+            std::string modes = "+";
+            for (const char *mode = "itkl"; *mode; ++mode)
+                if (channel->hasMode(*mode))
+                    modes += *mode;
+            sendNumeric(client, RPL_CHANNELMODEIS, target, modes);
             return;
         }
         if (!channel->isOperator(client->getSocket())) {
-            sendToClient(client->getSocket(), "482 " + target + " :You're not channel operator\r\n");
+            sendNumeric(client, ERR_CHANOPRIVSNEEDED, target);
             return;
         }
 
-        std::string mode = params[1];
-        bool adding = mode[0] == '+';
-        char modeChar = mode[1];
-        std::string modeArg = "";
-        if (params.size() >= 3)
-            modeArg = params[2];
-        else if (mode.length() > 2)
-            modeArg = mode.substr(2);
-        if (modeChar == 'i') {
-            if (adding)
-                channel->setMode('i');
-            else
-                channel->unsetMode('i');
-        } 
-        else if (modeChar == 't') {
-            if (adding) 
-                channel->setMode('t');
-            else
-                channel->unsetMode('t');
-        } 
-        else if (modeChar == 'k' && params.size() >= 3) {
-            if (adding) {
-                channel->setMode('k');
-                channel->setPassword(params[2]); 
-            } else {
-                channel->unsetMode('k');
-                channel->setPassword("");
-            }
-        } 
-        else if (modeChar == 'o' && params.size() >= 3) {
-            Client *targetClient = channel->getUserByNick(params[2]);
-            if (!targetClient) {
-                sendToClient(client->getSocket(), "401 " + params[2] + " :No such nick\r\n");
-                return;
-            }
-            if (adding)
-                channel->addOperator(targetClient->getSocket());
-            else
-                channel->removeOperator(targetClient->getSocket());
-        } 
-        else if (modeChar == 'l')
-        {
-            int limit = modeArg.empty() ? 0 : atoi(modeArg.c_str());
-            if (adding && limit > 0) {
-                channel->setMode('l');
-                channel->setUserLimit(limit);
-            } else {
-                channel->unsetMode('l');
-                channel->setUserLimit(0);
-            }
-        }
-        else {
-            sendToClient(client->getSocket(), "501 " + mode + " :Unknown mode flag\r\n");
+        std::vector<ModeChange> changes = applyChannelModes(client, channel, params);
+        if (changes.empty())
             return;
-        }
-        std::string modeMessage = ":" + client->getNickName() + "!" + client->getUserName() + "@127.0.0.1 MODE " + target + " " + mode + "\r\n";
+        std::string modeMessage = modeLines(client->getPrefix() + " MODE " + target, changes);
+        flushNotices(channel);
         channel->broadcastMessage(modeMessage, client->getSocket());
         sendToClient(client->getSocket(), modeMessage);
+        size_t next = 0;
+        propagate(":" + client->getNickName() + " MODE " + target + " " + modeLine(changes, next, std::string::npos));
     } 
     else {
         std::map<std::string, Client*>::iterator clientIt = registeredUsers.find(target);
@@ -581,11 +1481,11 @@ void Server::handleMODE(Client *client, const std::vector<std::string> &params)
             return;
         Client *targetClient = clientIt->second;
         if (client != targetClient) {
-            sendToClient(client->getSocket(), "502 " + target + " :You can't change modes for other users\r\n");
+            sendNumeric(client, ERR_USERSDONTMATCH, target);
             return;
         }
         if (params.size() < 2) {
-            sendToClient(client->getSocket(), "461 MODE :Not enough parameters\r\n");
+            sendNumeric(client, ERR_NEEDMOREPARAMS, "MODE");
             return;
         }
         std::string mode = params[1];
@@ -594,68 +1494,97 @@ void Server::handleMODE(Client *client, const std::vector<std::string> &params)
         } else if (mode == "-i") {
             targetClient->setOperator(false);
         } else {
-            sendToClient(client->getSocket(), "501 " + mode + " :Unknown mode flag\r\n");
+            sendNumeric(client, ERR_UMODEUNKNOWNFLAG, mode);
             return;
         }
-        std::string modeMessage = ":" + client->getNickName() + " MODE " + target + " " + mode + "\r\n";
+        std::string modeMessage = client->getPrefix() + " MODE " + target + " " + mode + "\r\n";
         sendToClient(targetClient->getSocket(), modeMessage);
     }
 }
 
+/*
+** MODE #channel b, e or I: RPL_BANLIST (367/368), RPL_EXCEPTLIST (348/349)
+** or RPL_INVITELIST (346/347). Only operators see the exception lists.
+*/
+void Server::sendMaskList(Client *client, Channel *channel, char mode) {
+    ReplyId item = mode == 'b' ? RPL_BANLIST : mode == 'e' ? RPL_EXCEPTLIST : RPL_INVITELIST;
+    ReplyId end = mode == 'b' ? RPL_ENDOFBANLIST : mode == 'e' ? RPL_ENDOFEXCEPTLIST : RPL_ENDOFINVITELIST;
+
+    if (mode != 'b' && !channel->isOperator(client->getSocket())) {
+        sendNumeric(client, ERR_CHANOPRIVSNEEDED, channel->getName());
+        return;
+    }
+    const std::vector<MaskEntry> &entries = channel->getMaskList(mode)->getEntries();
+    std::string channelName = channel->getName();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ReplyArg name(channelName);
+        ReplyArg mask(entries[i].mask);
+        ReplyArg setter(entries[i].setter);
+        ReplyArg time(static_cast<size_t>(entries[i].time));
+        const ReplyArg *args[] = {&name, &mask, &setter, &time};
+        sendNumeric(client, item, args, 4);
+    }
+    sendNumeric(client, end, channelName);
+}
+
 void Server::handlePART(Client *client, const std::vector<std::string> &params) {
     if (!client)
         return;
     if (params.empty()) {
-        sendToClient(client->getSocket(), "461 PART :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "PART");
         return;
     }
-    std::string channelName = params[0];
-    std::map<std::string, Channel *>::iterator it = channels.find(channelName);
-    if (it == channels.end()) {
-        sendToClient(client->getSocket(), "403 " + channelName + " :No such channel\r\n");
-        return;
-    }
-    Channel *channel = it->second;
-    if (!channel->isUserInChannel(client->getSocket())) {
-        sendToClient(client->getSocket(), "442 " + channelName + " :You're not in that channel\r\n");
-        return;
-    }
-    std::string partMessage = ":" + client->getNickName() + "!" + client->getUserName() + "@127.0.0.1 PART " + channelName + "\r\n";
-    channel->broadcastMessage(partMessage, client->getSocket());
-    sendToClient(client->getSocket(), partMessage);
-    channel->removeUser(client->getSocket());
-    if (channel->listUsers().empty()) {
-        delete channel; 
-        channels.erase(it);
+    std::vector<std::string> names = splitList(params[0]);
+    std::string reason = params.size() > 1 ? params[1] : "";
+    for (size_t i = 0; i < names.size(); ++i) {
+        std::string channelName = names[i];
+        std::map<ChannelName, Channel *>::iterator it = channels.find(channelName);
+        if (it == channels.end()) {
+            sendNumeric(client, ERR_NOSUCHCHANNEL, channelName);
+            continue;
+        }
+        Channel *channel = it->second;
+        if (!channel->isUserInChannel(client->getSocket())) {
+            sendNumeric(client, ERR_NOTONCHANNEL, channelName);
+            continue;
+        }
+        std::string suffix = reason.empty() ? "" : " :" + reason;
+        std::string partMessage = client->getPrefix() + " PART " + channelName + suffix + "\r\n";
+        channelNotice(channel, client, partMessage, false);
+        sendToClient(client->getSocket(), partMessage);
+        propagate(":" + client->getNickName() + " PART " + channelName + suffix);
+        channel->removeUser(client->getSocket());
+        if (channel->listUsers().empty()) {
+            deleteChannel(it);
+        }
     }
 }
-
 void Server::handleTOPIC(Client *client, const std::vector<std::string> &params) {
     if (params.empty()) {
-        sendToClient(client->getSocket(), "461 TOPIC :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "TOPIC");
         return;
     }
     std::string channelName = params[0];
-    std::map<std::string, Channel *>::iterator it = channels.find(channelName);
+    std::map<ChannelName, Channel *>::iterator it = channels.find(channelName);
     if (it == channels.end()) {
-        sendToClient(client->getSocket(), "403 " + channelName + " :No such channel\r\n");
+        sendNumeric(client, ERR_NOSUCHCHANNEL, channelName);
         return;
     }
     Channel *channel = it->second;
     if (!channel->isUserInChannel(client->getSocket())) {
-        sendToClient(client->getSocket(), "442 " + channelName + " :You're not in that channel\r\n");
+        sendNumeric(client, ERR_NOTONCHANNEL, channelName);
         return;
     }
     if (params.size() == 1) {
         if (channel->getTopic().empty()) {
-            sendToClient(client->getSocket(), "331 " + channelName + " :No topic is set\r\n");
+            sendNumeric(client, RPL_NOTOPIC, channelName);
         } else {
-            sendToClient(client->getSocket(), "332 " + channelName + " :" + channel->getTopic() + "\r\n");
+            sendNumeric(client, RPL_TOPIC, channelName, channel->getTopic());
         }
         return;
     }
     if (channel->hasMode('t') && !channel->isOperator(client->getSocket())) {
-        sendToClient(client->getSocket(), "482 " + channelName + " :You're not channel operator\r\n");
+        sendNumeric(client, ERR_CHANOPRIVSNEEDED, channelName);
         return;
     }
     std::string newTopic;
@@ -665,14 +1594,16 @@ void Server::handleTOPIC(Client *client, const std::vector<std::string> &params)
         newTopic += params[i];
     }
     channel->setTopic(newTopic);    
-    std::string topicChangeMsg = ":" + client->getHostname() + " TOPIC " + channelName + " :" + newTopic + "\r\n";
+    std::string topicChangeMsg = client->getPrefix() + " TOPIC " + channelName + " :" + newTopic + "\r\n";
+    flushNotices(channel);
     channel->broadcastMessage(topicChangeMsg, client->getSocket());
     sendToClient(client->getSocket(), topicChangeMsg);
+    propagate(":" + client->getNickName() + " TOPIC " + channelName + " :" + newTopic);
 }
 
 void Server::handleKICK(Client *client, const std::vector<std::string> &params) {
     if (params.size() < 2) {
-        sendToClient(client->getSocket(), "461 KICK :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "KICK");
         return;
     }
     std::string channelName = params[0];
@@ -680,69 +1611,263 @@ void Server::handleKICK(Client *client, const std::vector<std::string> &params)
     std::string reason = (params.size() > 2) ? params[2] : "Kicked by operator";
 
     if (channels.find(channelName) == channels.end()) {
-        sendToClient(client->getSocket(), "403 " + channelName + " :No such channel\r\n");
+        sendNumeric(client, ERR_NOSUCHCHANNEL, channelName);
         return;
     }
     Channel *channel = channels[channelName];
     if (!channel->isUserInChannel(client->getSocket())) {
-        sendToClient(client->getSocket(), "442 " + channelName + " :You're not on that channel\r\n");
+        sendNumeric(client, ERR_NOTONCHANNEL, channelName);
         return;
     }
     if (!channel->isOperator(client->getSocket())) {
-        sendToClient(client->getSocket(), "482 " + channelName + " :You're not a channel operator\r\n");
+        sendNumeric(client, ERR_CHANOPRIVSNEEDED, channelName);
         return;
     }
     Client *targetClient = channel->getUserByNick(targetNick);
     if (!targetClient) {
-        sendToClient(client->getSocket(), "441 " + targetNick + " " + channelName + " :They aren't on that channel\r\n");
+        sendNumeric(client, ERR_USERNOTINCHANNEL, targetNick, channelName);
         return;
     }
-    if (targetNick == client->getNickName()) {
-        sendToClient(client->getSocket(), "401" + targetNick + " : You cannot kick yourself\r\n");
+    if (targetClient == client) {
+        sendNumeric(client, ERR_CANNOTKICKSELF, targetNick);
         return;
     }
-    std::string kickMsg = ":" + client->getNickName() + " KICK " + channelName + " " + targetNick + " :" + reason + "\r\n";
-    channel->broadcastMessage(kickMsg, client->getSocket());
+    std::string kickMsg = client->getPrefix() + " KICK " + channelName + " " + targetNick + " :" + reason + "\r\n";
+    bool unannounced = dropNotices(channel, targetClient->getSocket());
+    flushNotices(channel);
+    if (unannounced)
+        sendToClient(targetClient->getSocket(), kickMsg);
+    else
+        channel->broadcastMessage(kickMsg, client->getSocket());
     sendToClient(client->getSocket(), kickMsg);
+    propagate(":" + client->getNickName() + " KICK " + channelName + " " + targetNick + " :" + reason);
     channel->removeUser(targetClient->getSocket());
 }
 
 void Server::handleINVITE(Client *client, const std::vector<std::string> &params) {
     if (params.size() < 2) {
-        sendToClient(client->getSocket(), "461 INVITE :Not enough parameters\r\n");
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "INVITE");
         return;
     }
     std::string targetNick = params[0];
     std::string channelName = params[1];
     if (channels.find(channelName) == channels.end()) {
-        sendToClient(client->getSocket(), "403 " + channelName + " :No such channel\r\n");
+        sendNumeric(client, ERR_NOSUCHCHANNEL, channelName);
         return;
     }
     Channel *channel = channels[channelName];
     if (!channel->isUserInChannel(client->getSocket())) {
-        sendToClient(client->getSocket(), "442 " + channelName + " :You're not on that channel\r\n");
+        sendNumeric(client, ERR_NOTONCHANNEL, channelName);
         return;
     }
     if (channel->hasMode('i') && !channel->isOperator(client->getSocket())) { 
-        sendToClient(client->getSocket(), "482 " + channelName + " :You're not a channel operator\r\n");
+        sendNumeric(client, ERR_CHANOPRIVSNEEDED, channelName);
         return;
     }
-    Client *targetClient = NULL;
-    for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
-        if (it->second->getNickName() == targetNick) {
-            targetClient = it->second;
-            break;
-        }
-    }
+    Client *targetClient = findClientByNick(targetNick);
     if (!targetClient) {
-        sendToClient(client->getSocket(), "401 " + targetNick + " :No such nick/channel\r\n");
+        sendNumeric(client, ERR_NOSUCHNICK, targetNick);
         return;
     }
     if (channel->isUserInChannel(targetClient->getSocket())) {
-        sendToClient(client->getSocket(), "443 " + targetNick + " " + channelName + " :is already on channel\r\n");
+        sendNumeric(client, ERR_USERONCHANNEL, targetNick, channelName);
         return;
     }
     channel->inviteUser(client, targetClient);
-    sendToClient(client->getSocket(), "341 " + client->getNickName() + " " + targetNick + " " + channelName + "\r\n");
-    sendToClient(targetClient->getSocket(), ":" + client->getNickName() + " INVITE " + targetNick + " :" + channelName + "\r\n");
+    sendNumeric(client, RPL_INVITING, targetNick, channelName);
+    if (targetClient->isRemote()) {
+        routeToClient(targetClient, ":" + client->getNickName() + " INVITE " + targetNick + " " + channelName);
+        return;
+    }
+    sendToClient(targetClient->getSocket(), client->getPrefix() + " INVITE " + targetNick + " :" + channelName + "\r\n");
+}
+
+/*
+** Parses a CHATHISTORY reference: "*" or "timestamp=YYYY-MM-DDThh:mm:ss.sssZ".
+** Returns -1 for "*" and -2 when the reference is invalid.
+*/
+static long long parseHistoryTimestamp(const std::string &ref) {
+    if (ref == "*")
+        return -1;
+    if (ref.compare(0, 10, "timestamp=") != 0)
+        return -2;
+    struct tm tm;
+    int millis = 0;
+    memset(&tm, 0, sizeof(tm));
+    if (sscanf(ref.c_str() + 10, "%4d-%2d-%2dT%2d:%2d:%2d.%3dZ", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+        &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &millis) < 6)
+        return -2;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    return (long long)timegm(&tm) * 1000 + millis;
+}
+
+void Server::handleCHATHISTORY(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "CHATHISTORY");
+        return;
+    }
+    if (params.size() < 4) {
+        sendToClient(client->getSocket(), ":" + serverName + " FAIL CHATHISTORY INVALID_PARAMS :Not enough parameters\r\n");
+        return;
+    }
+    std::string subcommand = params[0];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), static_cast<int(*)(int)>(std::toupper));
+    std::string target = params[1];
+    long long when = parseHistoryTimestamp(params[2]);
+    int limit = atoi(params[3].c_str());
+    if ((subcommand != "LATEST" && subcommand != "BEFORE" && subcommand != "AFTER")
+        || when == -2 || (when == -1 && subcommand != "LATEST") || limit <= 0) {
+        sendToClient(client->getSocket(), ":" + serverName + " FAIL CHATHISTORY INVALID_PARAMS " + subcommand + " :Invalid parameters\r\n");
+        return;
+    }
+    if (limit > CHATHISTORY_MAX)
+        limit = CHATHISTORY_MAX;
+    std::map<ChannelName, Channel *>::iterator it = channels.find(target);
+    if (it == channels.end() || !it->second->isUserInChannel(client->getSocket())) {
+        sendToClient(client->getSocket(), ":" + serverName + " FAIL CHATHISTORY INVALID_TARGET " + subcommand + " " + target
+            + " :Messages could not be retrieved\r\n");
+        return;
+    }
+
+    const std::deque<HistoryEntry> &history = it->second->getHistory();
+    size_t begin = 0;
+    size_t end = history.size();
+    if (subcommand == "BEFORE") {
+        while (end > 0 && history[end - 1].time >= when)
+            end--;
+    } else if (when >= 0) {
+        while (begin < end && history[begin].time <= when)
+            begin++;
+    }
+    if (subcommand == "AFTER") {
+        if (end - begin > (size_t)limit)
+            end = begin + limit;
+    } else if (end - begin > (size_t)limit) {
+        begin = end - limit;
+    }
+    replayHistory(client, target, history, begin, end);
+}
+
+/*
+** STATS q reports each connection class: its limits, the queue depth it is
+** holding right now, the high-water marks since startup and how many clients
+** were dropped for exceeding a limit. STATS P lists the listeners and the
+** class each one assigns. STATS o reports the overload state.
+*/
+void Server::handleSTATS(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "STATS");
+        return;
+    }
+    if (params.empty()) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "STATS");
+        return;
+    }
+    if (params[0] == "q") {
+        std::vector<size_t> sendq(classes.size(), 0);
+        std::vector<size_t> recvq(classes.size(), 0);
+        for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
+            sendq[it->second->getConnClass()] += it->second->getSendQueueSize();
+            recvq[it->second->getConnClass()] += it->second->getInputSize();
+        }
+        for (size_t i = 0; i < classes.size(); ++i) {
+            const ConnClass &cls = classes[i];
+            std::ostringstream oss;
+            oss << "class " << cls.name << " mask "
+                << (cls.listenerOnly ? "listener" : cls.mask.empty() ? "*" : cls.mask)
+                << " clients " << cls.clients
+                << " sendq " << sendq[i] << " peak " << cls.sendqPeak << " limit " << cls.sendq
+                << " exceeded " << cls.sendqExceeded
+                << " recvq " << recvq[i] << " peak " << cls.recvqPeak << " limit " << cls.recvq
+                << " exceeded " << cls.recvqExceeded;
+            sendNumeric(client, RPL_STATSDEBUG, oss.str());
+        }
+    }
+    if (params[0] == "o")
+        sendLoadStats(client);
+    if (params[0] == "z")
+        sendMemoryStats(client);
+    if (params[0] == "P") {
+        for (size_t i = 0; i < listeners.size(); ++i) {
+            const Listener &listener = listeners[i];
+            sendNumeric(client, RPL_STATSDEBUG, "listener " + listener.address + (listener.tls ? " tls" : "") + (listener.websocket ? " websocket" : "") + " class "
+                + (listener.connClass >= 0 ? classes[listener.connClass].name : "*"));
+        }
+    }
+    if (params[0] == "T" && tls) {
+        const TlsStats &stats = tls->getStats();
+        std::ostringstream oss;
+        oss << "tls sessions " << tls->getSessionCount() << " handshakes " << stats.handshakes
+            << " resumed " << stats.resumed << " failed " << stats.failed << " ktls " << stats.ktls
+            << " cached " << tls->getCachedSessions();
+        sendNumeric(client, RPL_STATSDEBUG, oss.str());
+    }
+    if (params[0] == "W" && websocket) {
+        std::ostringstream oss;
+        oss << "websocket sessions " << websocket->getSessionCount() << " upgrades " << websocket->getUpgrades();
+        sendNumeric(client, RPL_STATSDEBUG, oss.str());
+    }
+    if (params[0] == "B") {
+        for (std::map<int, Bridge>::iterator it = bridges.begin(); it != bridges.end(); ++it) {
+            std::ostringstream oss;
+            oss << "bridge " << it->second.name << " users " << it->second.users.size()
+                << " lines " << it->second.received;
+            sendNumeric(client, RPL_STATSDEBUG, oss.str());
+        }
+    }
+    sendNumeric(client, RPL_ENDOFSTATS, params[0]);
+}
+
+void Server::handleOPER(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "OPER");
+        return;
+    }
+    if (params.size() < 2) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "OPER");
+        return;
+    }
+    std::map<std::string, std::string>::iterator it = operators.find(params[0]);
+    if (it == operators.end() || it->second != params[1]) {
+        logMessage("Failed OPER attempt by " + client->getNickName() + " as " + params[0]);
+        sendNumeric(client, ERR_PASSWDMISMATCH);
+        return;
+    }
+    client->setIrcOperator(true);
+    logMessage(client->getNickName() + " is now an IRC operator (" + params[0] + ")");
+    sendNumeric(client, RPL_YOUREOPER);
+}
+
+/*
+** SPANS ON|OFF turns span tracing on or off; SPANS DUMP [seconds] writes
+** the spans of the last TRACE_SECONDS (or the given number of) seconds to
+** trace-<pid>-<time>.json next to server.log. Operators only.
+*/
+void Server::handleSPANS(Client *client, const std::vector<std::string> &params) {
+    std::string notice = ":" + serverName + " NOTICE " + client->getNickName() + " :";
+
+    if (!client->isIrcOperator()) {
+        sendNumeric(client, ERR_NOPRIVILEGES);
+        return;
+    }
+    std::string action = params.empty() ? "" : params[0];
+    std::transform(action.begin(), action.end(), action.begin(), static_cast<int(*)(int)>(std::toupper));
+    if (action == "ON" || action == "OFF") {
+        Trace::enable(action == "ON");
+        logMessage("Span tracing " + std::string(Trace::isEnabled() ? "enabled" : "disabled") + " by " + client->getNickName());
+    } else if (action == "DUMP") {
+        int seconds = params.size() > 1 && atoi(params[1].c_str()) > 0 ? atoi(params[1].c_str()) : TRACE_SECONDS;
+        std::ostringstream path;
+        path << "trace-" << getpid() << "-" << time(NULL) << ".json";
+        size_t spans = Trace::dump(path.str(), seconds);
+        std::ostringstream oss;
+        oss << notice << "Wrote " << spans << " spans to " << path.str() << "\r\n";
+        sendToClient(client->getSocket(), oss.str());
+        return;
+    } else if (!action.empty()) {
+        sendToClient(client->getSocket(), notice + "Usage: SPANS [ON|OFF|DUMP [seconds]]\r\n");
+        return;
+    }
+    sendToClient(client->getSocket(), notice + "Span tracing is " + (Trace::isEnabled() ? "on" : "off") + "\r\n");
 }
@@ -0,0 +1,137 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerBridge.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/11 15:02:51 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/11 15:02:51 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** Bridges: one connection carrying the users of a gateway to another chat
+** network, instead of a socket per user.
+**
+** The gateway authenticates with an account given by -bridge (after PASS
+** when the server has a password) and then prefixes each line with the tag
+** of the user it speaks for:
+**
+**   BRIDGE <name> <password>      answered with ":<server> BRIDGE <name>"
+**   <tag> NICK alice
+**   <tag> USER alice 0 * :Alice
+**   <tag> JOIN #room
+**
+** The first line with an unknown tag creates a virtual client, already past
+** PASS, which registers and behaves like any local user. Whatever the
+** server sends it comes back as "<tag> <line>"; a line for several users of
+** the same bridge, like a channel message, comes once as
+** "<tag>,<tag>,... <line>". Untagged lines are the bridge's own (PING,
+** QUIT). A user that quits gets its ERROR like a socket client would; when
+** the bridge goes away all of its users quit with "Bridge closed".
+*/
+
+/*
+** "-bridge <name>,<password>[,<class>]". A bridge queues the output of all
+** of its users, so it usually wants a class with a far larger sendq and
+** recvq than a single client; the class has to be defined first.
+*/
+bool Server::addBridge(const std::string &spec) {
+    std::vector<std::string> fields = splitList(spec);
+    BridgeAccount account;
+
+    if (fields.size() < 2 || fields.size() > 3 || fields[0].empty() || fields[1].empty())
+        return false;
+    account.password = fields[1];
+    account.connClass = -1;
+    for (size_t i = 0; fields.size() == 3 && i < classes.size(); ++i)
+        if (classes[i].name == fields[2])
+            account.connClass = i;
+    if (fields.size() == 3 && account.connClass < 0)
+        return false;
+    bridgeAccounts[fields[0]] = account;
+    return true;
+}
+
+void Server::handleBRIDGE(Client *client, const std::vector<std::string> &params) {
+    if (client->isRegistered() || client->isBridgeHost() || client->isVirtual()) {
+        sendNumeric(client, ERR_ALREADYREGISTERED);
+        return;
+    }
+    if (params.size() < 2) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "BRIDGE");
+        return;
+    }
+    if (!password.empty() && !client->isAuthenticated()) {
+        sendNumeric(client, ERR_PASSFIRST);
+        return;
+    }
+    std::map<std::string, BridgeAccount>::iterator it = bridgeAccounts.find(params[0]);
+    if (it == bridgeAccounts.end() || it->second.password != params[1]) {
+        logMessage("Failed BRIDGE attempt from " + client->getIpAddress() + " as " + params[0]);
+        sendNumeric(client, ERR_PASSWDMISMATCH);
+        return;
+    }
+    Bridge &bridge = bridges[client->getSocket()];
+    bridge.name = params[0];
+    bridge.received = 0;
+    client->setBridgeHost(true);
+    if (it->second.connClass >= 0) {
+        classes[client->getConnClass()].clients--;
+        assignConnClass(client, it->second.connClass);
+    }
+    logMessage("Bridge " + params[0] + " connected from " + client->getIpAddress());
+    sendToClient(client->getSocket(), ":" + serverName + " BRIDGE " + params[0] + "\r\n");
+}
+
+/*
+** A tagged line from a bridge. Tags are decimal numbers of up to
+** BRIDGE_TAG_DIGITS digits, 0 excluded; anything else is dropped like other
+** malformed input. A virtual client takes the bridge's connection class.
+*/
+void Server::bridgeLine(Client *host, const std::string &line) {
+    std::string::size_type space = line.find(' ');
+    if (space == std::string::npos || space > BRIDGE_TAG_DIGITS || line.find_first_not_of("0123456789") != space)
+        return;
+    std::string::size_type start = line.find_first_not_of(' ', space);
+    unsigned int tag = strtoul(line.c_str(), NULL, 10);
+    Bridge &bridge = bridges[host->getSocket()];
+
+    bridge.received++;
+    if (tag == 0 || start == std::string::npos || line[start] == ':')
+        return;
+    Client *user;
+    std::map<unsigned int, Client *>::iterator it = bridge.users.find(tag);
+    if (it != bridge.users.end())
+        user = it->second;
+    else {
+        if (bridge.users.size() >= BRIDGE_USERS) {
+            host->queueTagged(line.substr(0, space), SharedBuffer("ERROR :Too many users on this bridge\r\n"));
+            return;
+        }
+        user = new Client(nextRemoteId--, bridge.name);
+        user->setBridge(host, tag);
+        user->setAuthenticated(true);
+        assignConnClass(user, host->getConnClass());
+        clients[user->getSocket()] = user;
+        bridge.users[tag] = user;
+    }
+    parseCommand(user, line.substr(start));
+}
+
+void Server::closeBridge(Client *host) {
+    std::map<int, Bridge>::iterator it = bridges.find(host->getSocket());
+    if (it == bridges.end())
+        return;
+    std::vector<int> users;
+    for (std::map<unsigned int, Client *>::iterator user = it->second.users.begin(); user != it->second.users.end(); ++user)
+        users.push_back(user->second->getSocket());
+    for (size_t i = 0; i < users.size(); ++i)
+        removeClient(users[i], "Bridge closed");
+    logMessage("Bridge " + it->second.name + " closed");
+    bridges.erase(it);
+    host->setBridgeHost(false);
+}
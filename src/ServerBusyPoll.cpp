@@ -0,0 +1,117 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerBusyPoll.cpp                                 :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 14:22:10 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 14:22:10 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+#include <sched.h>
+
+/*
+** Low-latency mode.
+**
+** A blocking wait puts the thread to sleep, and waking it up again is most
+** of what a PING costs on an idle server. With -busypoll the loop first
+** polls without blocking for up to the configured number of microseconds
+** and only then sleeps, so a line arriving shortly after the last one is
+** picked up by a thread that is still running. The server has a single
+** reactor thread; it can be pinned to one core so it keeps its cache and
+** does not migrate while spinning. Client sockets get SO_BUSY_POLL (and
+** SO_PREFER_BUSY_POLL where the kernel has it), so receives on a NIC with
+** NAPI poll the device queue instead of waiting for its interrupt; raising
+** it needs CAP_NET_ADMIN, and refusals are only counted. TCP_NODELAY is on
+** in every mode.
+*/
+
+/*
+** "-busypoll <microseconds>[,<cpu>]". The cpu must be one the process is
+** allowed to run on.
+*/
+bool Server::setBusyPoll(const std::string &spec) {
+    std::vector<std::string> fields = splitList(spec);
+    cpu_set_t allowed;
+    char *end;
+
+    if (fields.empty() || fields.size() > 2)
+        return false;
+    long spin = strtol(fields[0].c_str(), &end, 10);
+    if (*end || spin <= 0 || spin > BUSYPOLL_MAX)
+        return false;
+    int cpu = -1;
+    if (fields.size() == 2) {
+        cpu = strtol(fields[1].c_str(), &end, 10);
+        if (*end || fields[1].empty() || cpu < 0 || cpu >= CPU_SETSIZE
+            || sched_getaffinity(0, sizeof(allowed), &allowed) < 0 || !CPU_ISSET(cpu, &allowed))
+            return false;
+    }
+    busyPoll.spin = spin;
+    busyPoll.cpu = cpu;
+    return true;
+}
+
+void Server::pinReactor() {
+    cpu_set_t cpus;
+    std::ostringstream oss;
+
+    if (!busyPoll.spin)
+        return;
+    oss << "Busy polling for " << busyPoll.spin << "us before sleeping";
+    if (busyPoll.cpu >= 0) {
+        CPU_ZERO(&cpus);
+        CPU_SET(busyPoll.cpu, &cpus);
+        oss << ", event loop pinned to cpu " << busyPoll.cpu;
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) < 0)
+            throw std::runtime_error("Error: cannot pin the event loop: " + std::string(strerror(errno)));
+    }
+    logMessage(oss.str());
+}
+
+void Server::tuneSocket(int fd) {
+    int usec = busyPoll.spin;
+
+    if (!busyPoll.spin)
+        return;
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0)
+        busyPoll.refused++;
+#ifdef SO_PREFER_BUSY_POLL
+    int yes = 1;
+    setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &yes, sizeof(yes));
+#endif
+}
+
+/*
+** The loop's wait(), preceded in low-latency mode by non-blocking checks
+** for up to busyPoll.spin microseconds. A wait that was not going to block
+** anyway is left alone.
+*/
+int Server::waitEvents(int timeout) {
+    if (busyPoll.spin && timeout != 0) {
+        long long until = monotonicMicros() + busyPoll.spin;
+        do {
+            if (loop->wait(events, 0) < 0)
+                return -1;
+            if (!events.empty()) {
+                busyPoll.spun++;
+                return events.size();
+            }
+        } while (monotonicMicros() < until);
+        busyPoll.slept++;
+    }
+    return loop->wait(events, timeout);
+}
+
+void Server::sendBusyPollStats(Client *client) {
+    std::ostringstream oss;
+
+    if (!busyPoll.spin)
+        return;
+    oss << "busypoll spin " << busyPoll.spin << "us cpu " << busyPoll.cpu << " spun " << busyPoll.spun
+        << " slept " << busyPoll.slept << " refused " << busyPoll.refused;
+    sendNumeric(client, RPL_STATSDEBUG, oss.str());
+}
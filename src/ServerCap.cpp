@@ -0,0 +1,174 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerCap.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 16:31:52 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 16:31:52 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** IRCv3 capability negotiation.
+**
+** CAP LS or CAP REQ before registration holds the welcome back until CAP
+** END. The capabilities change how lines are written to a client, never
+** what it is sent:
+**
+**   server-time   relayed messages start with @time=, the time of the loop
+**                 pass that handled them; history replays carry the time
+**                 each line was recorded;
+**   message-tags  client-only tags (+name=value) of PRIVMSG, NOTICE and
+**                 TAGMSG are passed on to recipients that have it;
+**   echo-message  the sender gets its own PRIVMSG, NOTICE and TAGMSG back;
+**   batch         a CHATHISTORY reply comes inside BATCH +id / -id.
+**
+** Channel messages go through TaggedLine, which writes each line at most
+** once per combination of tags present among the recipients.
+*/
+
+void Server::handleCAP(Client *client, const std::vector<std::string> &params) {
+    std::string prefix = ":" + serverName + " CAP " + (client->getNickName().empty() ? "*" : client->getNickName()) + " ";
+
+    if (params.empty()) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "CAP");
+        return;
+    }
+    std::string subcommand = params[0];
+    std::transform(subcommand.begin(), subcommand.end(), subcommand.begin(), static_cast<int(*)(int)>(std::toupper));
+    if ((subcommand == "LS" || subcommand == "REQ") && !client->isRegistered())
+        client->setNegotiating(true);
+    if (subcommand == "LS")
+        sendToClient(client->getSocket(), prefix + "LS :" + Capability::list((1 << CAP_COUNT) - 1) + "\r\n");
+    else if (subcommand == "LIST")
+        sendToClient(client->getSocket(), prefix + "LIST :" + Capability::list(client->getCaps()) + "\r\n");
+    else if (subcommand == "REQ") {
+        std::string requested;
+        for (size_t i = 1; i < params.size(); ++i)
+            requested += (i > 1 ? " " : "") + params[i];
+        std::istringstream names(requested);
+        std::string name;
+        unsigned char caps = client->getCaps();
+        bool known = !requested.empty();
+        while (known && names >> name) {
+            bool remove = name[0] == '-';
+            unsigned char cap = Capability::parse(remove ? name.substr(1) : name);
+            known = cap != 0;
+            caps = remove ? caps & ~cap : caps | cap;
+        }
+        if (known)
+            client->setCaps(caps);
+        sendToClient(client->getSocket(), prefix + (known ? "ACK :" : "NAK :") + requested + "\r\n");
+    } else if (subcommand == "END") {
+        if (!client->isNegotiating())
+            return;
+        client->setNegotiating(false);
+        if (!client->isRegistered() && !client->getNickName().empty() && !client->getUserName().empty()) {
+            client->setRegistered(true);
+            sendWelcome(client);
+        }
+    } else
+        sendNumeric(client, ERR_INVALIDCAPCMD, params[0]);
+}
+
+/*
+** The client-only tags (those starting with '+') of a line's tag section.
+** A section over CAP_TAGS_MAX bytes is ignored altogether.
+*/
+std::string Server::clientOnlyTags(const std::string &tags) {
+    std::string kept;
+    std::string::size_type start = 0;
+
+    if (tags.size() > CAP_TAGS_MAX)
+        return kept;
+    while (start < tags.size()) {
+        std::string::size_type end = tags.find(';', start);
+        if (end == std::string::npos)
+            end = tags.size();
+        if (tags[start] == '+' && end - start > 1)
+            kept.append(kept.empty() ? "" : ";").append(tags, start, end - start);
+        start = end + 1;
+    }
+    return kept;
+}
+
+/*
+** TAGMSG <target>: a message made only of client-only tags, for clients
+** with message-tags. It is not kept in the history nor relayed to linked
+** servers, which do not carry tags.
+*/
+void Server::handleTAGMSG(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "TAGMSG");
+        return;
+    }
+    if (params.empty()) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "TAGMSG");
+        return;
+    }
+    if (messageTags.empty())
+        return;
+    const std::string &target = params[0];
+    TaggedLine line(SharedBuffer(client->getPrefix() + " TAGMSG " + target + "\r\n"), messageTags);
+    if (target[0] == '#' || target[0] == '!' || target[0] == '&' || target[0] == '+') {
+        std::map<ChannelName, Channel *>::iterator it = channels.find(target);
+        if (it == channels.end()) {
+            sendNumeric(client, ERR_NOSUCHCHANNEL, target);
+            return;
+        }
+        if (!it->second->isUserInChannel(client->getSocket())) {
+            sendNumeric(client, ERR_CANNOTSENDTOCHAN, target);
+            return;
+        }
+        if (!it->second->isOperator(client->getSocket()) && it->second->isBanned(client)) {
+            sendNumeric(client, ERR_CANNOTSENDBANNED, target);
+            return;
+        }
+        flushNotices(it->second);
+        it->second->broadcastMessage(line, client->getSocket(), CAP_MESSAGE_TAGS);
+    } else {
+        Client *targetClient = findClientByNick(target);
+        if (!targetClient) {
+            sendNumeric(client, ERR_NOSUCHNICK, target);
+            return;
+        }
+        if (!targetClient->isRemote() && targetClient->hasCap(CAP_MESSAGE_TAGS))
+            targetClient->queue(line.forCaps(targetClient->getCaps()));
+    }
+    if (client->hasCap(CAP_ECHO_MESSAGE))
+        client->queue(line.forCaps(client->getCaps()));
+}
+
+/*
+** Queues history[begin, end) for replay. Without server-time or batch the
+** history's own buffers are queued; otherwise each line is copied behind
+** its tags.
+*/
+void Server::replayHistory(Client *client, const std::string &target, const std::deque<HistoryEntry> &history,
+    size_t begin, size_t end) {
+    bool batch = client->hasCap(CAP_BATCH);
+    bool time = client->hasCap(CAP_SERVER_TIME);
+    std::ostringstream id;
+
+    if (!batch && !time) {
+        for (size_t i = begin; i < end; ++i)
+            client->queueReplay(history[i].line);
+        return;
+    }
+    if (batch) {
+        id << nextBatch++;
+        client->queueReplay(SharedBuffer(":" + serverName + " BATCH +" + id.str() + " chathistory " + target + "\r\n"));
+    }
+    for (size_t i = begin; i < end; ++i) {
+        std::string tags = batch ? "batch=" + id.str() : "";
+        if (time)
+            tags += (batch ? ";time=" : "time=") + ServerTime::format(history[i].time);
+        client->queueReplay(SharedBuffer(TaggedLine::tagged(tags, history[i].line)));
+    }
+    if (batch)
+        client->queueReplay(SharedBuffer(":" + serverName + " BATCH -" + id.str() + "\r\n"));
+}
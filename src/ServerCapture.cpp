@@ -0,0 +1,82 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerCapture.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/07 10:20:14 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/07 10:20:14 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** Traffic capture for bench/replay. With -capture every connection, every
+** line a client sends (as processInput() frames it, on every event loop
+** backend) and every disconnect is appended to the capture file. The
+** stream is buffered, so recording a line is a memcpy unless the buffer is
+** full.
+*/
+
+bool Server::setCapture(const std::string &path) {
+    capture.open(path.c_str(), std::ios::binary | std::ios::trunc);
+    if (!capture)
+        return false;
+    capture.write(CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+    captureStart = Trace::now();
+    nextCaptureId = 1;
+    logMessage("Capturing client traffic to " + path);
+    return true;
+}
+
+/*
+** Passwords never reach the file: "PASS secret" is stored as "PASS *",
+** "OPER name secret" as "OPER name *" and "BRIDGE name secret" as
+** "BRIDGE name *", also behind the tag of a bridged user ("12 PASS *"),
+** message tags or a prefix ("@x=y :nick OPER name *").
+*/
+void Server::captureEvent(CaptureType type, int fd, const char *data, size_t len) {
+    CaptureRecord record;
+    std::string redacted;
+
+    if (type == CAPTURE_OPEN)
+        captureIds[fd] = nextCaptureId++;
+    std::map<int, unsigned int>::iterator it = captureIds.find(fd);
+    if (it == captureIds.end())
+        return;
+    size_t start = 0;
+    while (start < len && start <= BRIDGE_TAG_DIGITS && isdigit(static_cast<unsigned char>(data[start])))
+        ++start;
+    start = start > 0 && start <= BRIDGE_TAG_DIGITS && start < len && data[start] == ' ' ? start + 1 : 0;
+    for (bool word = true; start < len; ++start) {
+        if (data[start] == ' ')
+            word = true;
+        else if (word && (data[start] == '@' || data[start] == ':'))
+            word = false;
+        else if (word)
+            break;
+    }
+    const char *line = data + start;
+    size_t rest = len - start;
+    size_t command = rest > 5 && (strncasecmp(line, "PASS ", 5) == 0 || strncasecmp(line, "OPER ", 5) == 0) ? 5
+        : rest > 7 && strncasecmp(line, "BRIDGE ", 7) == 0 ? 7 : 0;
+    if (type == CAPTURE_LINE && command) {
+        redacted.assign(data, len);
+        std::string::size_type space = redacted.find(' ', start + command);
+        redacted = toupper(line[0]) == 'P' || space == std::string::npos
+            ? redacted.substr(0, start + command) + "*" : redacted.substr(0, space + 1) + "*";
+        data = redacted.data();
+        len = redacted.size();
+    }
+    record.type = type;
+    record.conn = it->second;
+    record.time = Trace::now() - captureStart;
+    record.length = std::min(len, static_cast<size_t>(0xFFFF));
+    capture.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    if (record.length)
+        capture.write(data, record.length);
+    if (type == CAPTURE_CLOSE)
+        captureIds.erase(it);
+}
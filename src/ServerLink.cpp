@@ -0,0 +1,799 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerLink.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/14 10:12:41 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/14 10:12:41 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** Server-to-server protocol.
+**
+** Servers form a spanning tree: a link is refused if the peer (or any
+** server behind it) is already known, so there is exactly one path between
+** any two nodes. State changes are flooded to every link except the one
+** they came from, channel messages only to links that have members of the
+** channel behind them, so each node sees a given message at most once.
+**
+** Each link has its own secret (-link, -connect), unrelated to the client
+** password; the accepting end answers SERVER only after checking it. A UID
+** for a nick a local user holds makes that user quit with "Nick collision"
+** (the peer does the same with ours, so neither keeps it); a UID for a nick
+** held behind another link is dropped. A :<nick> line whose nick is not
+** behind the link it came in on is dropped as well.
+**
+**   SERVER <name> <secret>                       handshake, both directions
+**   :<parent> SID <name>                         server behind a link
+**   SQUIT <name>                                 server left the network
+**   UID <nick> <user> <host> <server> :<real>    user introduction
+**   SJOIN <chan> <modes> <key> <limit> :<@nick nick ...>
+**   STOPIC <chan> :<topic>
+**   BMASK <chan> <b|e|I> :<mask> ...             channel lists
+**   EOB                                          end of burst
+**   :<nick> NICK|JOIN|PART|PRIVMSG|NOTICE|MODE|TOPIC|KICK|QUIT|INVITE ...
+**   KILL <nick> :<reason>                        a user behind the link killed
+*/
+
+static void splitLinkLine(const std::string &line, std::string &source,
+    std::string &command, std::vector<std::string> &params) {
+    std::istringstream iss(line);
+    std::string word;
+
+    if (!(iss >> word))
+        return;
+    if (word[0] == ':') {
+        source = word.substr(1);
+        if (!(iss >> word))
+            return;
+    }
+    command = word;
+    while (iss >> word) {
+        if (word[0] == ':') {
+            std::string rest;
+            std::getline(iss, rest);
+            params.push_back(word.substr(1) + rest);
+            break;
+        }
+        params.push_back(word);
+    }
+}
+
+void Server::setServerName(const std::string &name) { serverName = name; }
+
+void Server::setLinkPort(const std::string &port, const std::string &secret) {
+    linkPort = port;
+    linkSecret = secret;
+    setupLinkSocket();
+}
+
+void Server::addLinkTarget(const std::string &host, const std::string &port, const std::string &secret) {
+    LinkTarget target;
+    target.host = host;
+    target.port = port;
+    target.secret = secret;
+    target.fd = -1;
+    target.nextAttempt = 0;
+    linkTargets.push_back(target);
+}
+
+void Server::setupLinkSocket() {
+    struct addrinfo hints, *res;
+    int yes = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    if (getaddrinfo(NULL, linkPort.c_str(), &hints, &res) != 0)
+        throw std::runtime_error("Error: getaddrinfo failed for link port");
+    linkListener = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (linkListener < 0)
+        throw std::runtime_error("Error: link socket creation failed");
+    setsockopt(linkListener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(int));
+    if (bind(linkListener, res->ai_addr, res->ai_addrlen) < 0)
+        throw std::runtime_error("Error: link bind failed");
+    if (listen(linkListener, BACKLOG) < 0)
+        throw std::runtime_error("Error: link listen failed");
+    freeaddrinfo(res);
+    setPollEvents(linkListener, POLLIN);
+    logMessage("Accepting server links on port " + linkPort);
+}
+
+void Server::handleNewLink() {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    char host[INET_ADDRSTRLEN];
+    int newfd = accept4(linkListener, (struct sockaddr *)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+    if (newfd < 0)
+        return;
+    links[newfd] = new Link(newfd, false, false);
+    setPollEvents(newfd, POLLIN);
+    if (!inet_ntop(AF_INET, &addr.sin_addr, host, sizeof(host)))
+        strcpy(host, "unknown");
+    logMessage("Incoming server link from " + std::string(host));
+}
+
+void Server::connectLinks() {
+    time_t now = time(NULL);
+
+    for (size_t i = 0; i < linkTargets.size(); ++i) {
+        LinkTarget &target = linkTargets[i];
+        if (target.fd >= 0 && links.find(target.fd) != links.end())
+            continue;
+        target.fd = -1;
+        if (now < target.nextAttempt)
+            continue;
+        target.nextAttempt = now + LINK_RETRY;
+
+        struct addrinfo hints, *res;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(target.host.c_str(), target.port.c_str(), &hints, &res) != 0)
+            continue;
+        int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        if (fd < 0) {
+            freeaddrinfo(res);
+            continue;
+        }
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        if (connect(fd, res->ai_addr, res->ai_addrlen) < 0 && errno != EINPROGRESS) {
+            freeaddrinfo(res);
+            close(fd);
+            continue;
+        }
+        freeaddrinfo(res);
+        target.fd = fd;
+        links[fd] = new Link(fd, true, true);
+        setPollEvents(fd, POLLOUT);
+        if (DEBUG)
+            std::cout << "DEBUG: Connecting to " << target.host << ":" << target.port << std::endl;
+    }
+}
+
+void Server::handleLinkEvent(int link_fd, short revents) {
+    Link *link = links[link_fd];
+
+    if (link->isConnecting()) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(link_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err != 0) {
+            removeLink(link_fd, "Connection refused");
+            return;
+        }
+        link->setConnecting(false);
+        link->queue("SERVER " + serverName + " " + linkSecretFor(link));
+        setPollEvents(link_fd, POLLIN);
+        return;
+    }
+    if (revents & POLLIN) {
+        handleLinkMessage(link);
+        return;
+    }
+    if (revents & (POLLERR | POLLHUP)) {
+        removeLink(link_fd, "Connection reset");
+        return;
+    }
+    if (revents & POLLOUT)
+        flushLinks();
+}
+
+/*
+** Reads what the link sent and runs each complete line. A partial line
+** that grows past LINK_RECVQ, registered or not, drops the link.
+*/
+void Server::handleLinkMessage(Link *link) {
+    char buffer[BUFFER_SIZE];
+    int link_fd = link->getSocket();
+    int bytes_received = recv(link_fd, buffer, BUFFER_SIZE, 0);
+
+    if (bytes_received <= 0) {
+        removeLink(link_fd, "Connection closed");
+        return;
+    }
+    std::string &data = link->getInBuffer();
+    data.append(buffer, bytes_received);
+    std::string::size_type start = 0;
+    std::string::size_type pos;
+    while ((pos = data.find_first_of("\r\n", start)) != std::string::npos) {
+        std::string line = data.substr(start, pos - start);
+        start = std::min(data.find_first_not_of("\r\n", pos), data.size());
+        if (line.empty())
+            continue;
+        parseLinkCommand(link, line);
+        if (links.find(link_fd) == links.end())
+            return;
+    }
+    data.erase(0, start);
+    if (data.size() > LINK_RECVQ)
+        removeLink(link_fd, "RecvQ exceeded");
+}
+
+/*
+** Called once per poll tick: everything queued on a link since the last
+** tick goes out in as few send() calls as the socket allows. A link that
+** still has more than LINK_SENDQ bytes waiting is squit.
+*/
+void Server::flushLinks() {
+    std::vector<int> dead;
+    std::vector<int> slow;
+
+    for (std::map<int, Link *>::iterator it = links.begin(); it != links.end(); ++it) {
+        Link *link = it->second;
+        if (link->isConnecting())
+            continue;
+        std::string &out = link->getOutBuffer();
+        if (!out.empty()) {
+            ssize_t sent = send(it->first, out.data(), out.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+                dead.push_back(it->first);
+                continue;
+            }
+            if (sent > 0)
+                out.erase(0, sent);
+            if (out.size() > LINK_SENDQ) {
+                slow.push_back(it->first);
+                continue;
+            }
+        }
+        setPollEvents(it->first, out.empty() ? POLLIN : (POLLIN | POLLOUT));
+    }
+    for (size_t i = 0; i < dead.size(); ++i)
+        removeLink(dead[i], "Write error");
+    for (size_t i = 0; i < slow.size(); ++i)
+        removeLink(slow[i], "SendQ exceeded");
+}
+
+void Server::removeLink(int link_fd, const std::string &reason) {
+    std::map<int, Link *>::iterator it = links.find(link_fd);
+    if (it == links.end())
+        return;
+    Link *link = it->second;
+    logMessage("Server link " + (link->getName().empty() ? std::string("(unregistered)") : link->getName())
+        + " closed: " + reason);
+
+    std::vector<std::string> lost;
+    for (std::map<std::string, int>::iterator sit = servers.begin(); sit != servers.end(); ++sit) {
+        if (sit->second == link_fd)
+            lost.push_back(sit->first);
+    }
+    for (size_t i = 0; i < lost.size(); ++i) {
+        servers.erase(lost[i]);
+        propagate("SQUIT " + lost[i], link_fd);
+    }
+    std::vector<Client *> gone;
+    for (std::map<int, Client *>::iterator cit = remoteClients.begin(); cit != remoteClients.end(); ++cit) {
+        if (cit->second->getUplink() == link_fd)
+            gone.push_back(cit->second);
+    }
+    for (size_t i = 0; i < gone.size(); ++i)
+        quitRemoteClient(gone[i], serverName + " " + link->getName());
+
+    close(link_fd);
+    removePollFd(link_fd);
+    delete link;
+    links.erase(it);
+}
+
+void Server::parseLinkCommand(Link *link, const std::string &line) {
+    std::string source;
+    std::string command;
+    std::vector<std::string> params;
+
+    splitLinkLine(line, source, command, params);
+    if (DEBUG)
+        std::cout << "DEBUG: Link <" << link->getName() << "> " << line << std::endl;
+    if (command == "ERROR") {
+        removeLink(link->getSocket(), params.empty() ? "ERROR" : params[0]);
+        return;
+    }
+    if (!link->isRegistered()) {
+        if (command == "SERVER")
+            linkSERVER(link, source, params, line);
+        else
+            removeLink(link->getSocket(), "Not registered");
+        return;
+    }
+
+    std::string commands[] = {"SID", "SQUIT", "UID", "SJOIN", "STOPIC", "BMASK", "EOB", "NICK", "JOIN",
+        "PART", "PRIVMSG", "MODE", "TOPIC", "KICK", "QUIT", "KILL", "INVITE", "PING", "NOTICE"};
+    t_link_handlers handlers[] = {&Server::linkSID, &Server::linkSQUIT, &Server::linkUID,
+        &Server::linkSJOIN, &Server::linkSTOPIC, &Server::linkBMASK, &Server::linkEOB, &Server::linkNICK,
+        &Server::linkJOIN, &Server::linkPART, &Server::linkPRIVMSG, &Server::linkMODE,
+        &Server::linkTOPIC, &Server::linkKICK, &Server::linkQUIT, &Server::linkKILL,
+        &Server::linkINVITE, &Server::linkPING, &Server::linkNOTICE};
+
+    for (size_t i = 0; i < sizeof(commands) / sizeof(commands[0]); i++) {
+        if (command == commands[i]) {
+            (this->*handlers[i])(link, source, params, line);
+            return;
+        }
+    }
+    if (DEBUG)
+        std::cout << "DEBUG: Unknown link command: " << command << std::endl;
+}
+
+void Server::registerLink(Link *link, const std::string &name) {
+    link->setName(name);
+    link->setRegistered(true);
+    servers[name] = link->getSocket();
+    propagate(":" + serverName + " SID " + name, link->getSocket());
+    sendBurst(link);
+    logMessage("Server link established with " + name);
+}
+
+void Server::sendBurst(Link *link) {
+    int link_fd = link->getSocket();
+
+    for (std::map<std::string, int>::iterator it = servers.begin(); it != servers.end(); ++it) {
+        if (it->second != link_fd)
+            link->queue(":" + serverName + " SID " + it->first);
+    }
+    for (std::map<int, Client *>::iterator it = clients.begin(); it != clients.end(); ++it) {
+        if (it->second->isRegistered())
+            link->queue("UID " + it->second->getNickName() + " " + it->second->getUserName() + " "
+                + it->second->getIpAddress() + " " + serverName + " :" + it->second->getRealName());
+    }
+    for (std::map<int, Client *>::iterator it = remoteClients.begin(); it != remoteClients.end(); ++it) {
+        if (it->second->getUplink() != link_fd)
+            link->queue("UID " + it->second->getNickName() + " " + it->second->getUserName() + " "
+                + it->second->getIpAddress() + " " + it->second->getServer() + " :" + it->second->getRealName());
+    }
+    for (std::map<ChannelName, Channel *>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        Channel *channel = it->second;
+        const std::map<int, Client *> &users = channel->getUsers();
+        std::string members;
+        for (std::map<int, Client *>::const_iterator uit = users.begin(); uit != users.end(); ++uit) {
+            if (uit->second->getUplink() == link_fd)
+                continue;
+            if (!members.empty())
+                members += " ";
+            if (channel->isOperator(uit->first))
+                members += "@";
+            members += uit->second->getNickName();
+        }
+        if (members.empty())
+            continue;
+        std::ostringstream oss;
+        std::string modes = channel->getModes();
+        oss << "SJOIN " << channel->getName() << " " << (modes.empty() ? "+" : modes) << " "
+            << (channel->getPassword().empty() ? "*" : channel->getPassword()) << " "
+            << (channel->hasMode('l') ? channel->getUserLimit() : 0) << " :" << members;
+        link->queue(oss.str());
+        if (!channel->getTopic().empty())
+            link->queue("STOPIC " + channel->getName() + " :" + channel->getTopic());
+        const char lists[] = "beI";
+        for (int l = 0; l < 3; ++l) {
+            const std::vector<MaskEntry> &entries = channel->getMaskList(lists[l])->getEntries();
+            std::string masks;
+            for (size_t i = 0; i < entries.size(); ++i) {
+                masks += (masks.empty() ? "" : " ") + entries[i].mask;
+                if (masks.size() > 400 || i + 1 == entries.size()) {
+                    link->queue("BMASK " + channel->getName() + " " + lists[l] + " :" + masks);
+                    masks.clear();
+                }
+            }
+        }
+    }
+    link->queue("EOB");
+}
+
+void Server::introduceClient(Client *client) {
+    propagate("UID " + client->getNickName() + " " + client->getUserName() + " "
+        + client->getIpAddress() + " " + serverName + " :" + client->getRealName());
+}
+
+void Server::propagate(const std::string &line, int exclude_link) {
+    for (std::map<int, Link *>::iterator it = links.begin(); it != links.end(); ++it) {
+        if (it->first != exclude_link && it->second->isRegistered())
+            it->second->queue(line);
+    }
+}
+
+/*
+** Sends a channel message once to every link that has at least one member
+** of the channel behind it.
+*/
+void Server::routeToChannel(Channel *channel, const std::string &line, int exclude_link) {
+    std::set<int> targets;
+    const std::map<int, Client *> &users = channel->getUsers();
+
+    for (std::map<int, Client *>::const_iterator it = users.begin(); it != users.end(); ++it) {
+        int uplink = it->second->getUplink();
+        if (uplink >= 0 && uplink != exclude_link)
+            targets.insert(uplink);
+    }
+    for (std::set<int>::iterator it = targets.begin(); it != targets.end(); ++it) {
+        std::map<int, Link *>::iterator lit = links.find(*it);
+        if (lit != links.end())
+            lit->second->queue(line);
+    }
+}
+
+void Server::routeToClient(Client *target, const std::string &line) {
+    std::map<int, Link *>::iterator it = links.find(target->getUplink());
+    if (it != links.end())
+        it->second->queue(line);
+}
+
+/*
+** Removes a remote user from every channel, telling the local members, and
+** forgets it. Propagation is left to the caller.
+*/
+void Server::quitRemoteClient(Client *client, const std::string &reason) {
+    quitChannels(client, reason);
+    notifyOffline(client->getNickName());
+    std::map<NickName, Client *>::iterator nickIt = nicks.find(client->getNick());
+    if (nickIt != nicks.end() && nickIt->second == client)
+        nicks.erase(nickIt);
+    remoteClients.erase(client->getSocket());
+    delete client;
+}
+
+void Server::linkSERVER(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    (void)line;
+    if (link->isRegistered() || params.size() < 2) {
+        removeLink(link->getSocket(), "Bad SERVER");
+        return;
+    }
+    int link_fd = link->getSocket();
+    if (linkSecretFor(link).empty() || params[1] != linkSecretFor(link)) {
+        link->queue("ERROR :Bad link password");
+        flushLinks();
+        removeLink(link_fd, "Bad link password from " + params[0]);
+        return;
+    }
+    if (params[0] == serverName || servers.find(params[0]) != servers.end()) {
+        link->queue("ERROR :Server " + params[0] + " already exists");
+        flushLinks();
+        removeLink(link_fd, "Server " + params[0] + " already exists");
+        return;
+    }
+    if (!link->isOutgoing())
+        link->queue("SERVER " + serverName + " " + linkSecret);
+    registerLink(link, params[0]);
+}
+
+/*
+** The secret both ends of link present: the -connect one for a link this
+** server opened, the -link one for a link it accepted. An accepting server
+** sends its SERVER line only once the peer's secret matched.
+*/
+const std::string &Server::linkSecretFor(const Link *link) const {
+    if (link->isOutgoing()) {
+        for (size_t i = 0; i < linkTargets.size(); ++i) {
+            if (linkTargets[i].fd == link->getSocket())
+                return linkTargets[i].secret;
+        }
+    }
+    return linkSecret;
+}
+
+/*
+** A user introduced from behind link, the only ones it may speak for,
+** quit or kill.
+*/
+Client *Server::findLinkClient(const Link *link, const std::string &nick) {
+    Client *client = findClientByNick(nick);
+    if (!client || !client->isRemote() || client->getUplink() != link->getSocket())
+        return NULL;
+    return client;
+}
+
+void Server::linkSID(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.empty())
+        return;
+    if (params[0] == serverName || servers.find(params[0]) != servers.end()) {
+        int link_fd = link->getSocket();
+        link->queue("ERROR :Server " + params[0] + " already exists");
+        flushLinks();
+        removeLink(link_fd, "Loop detected via " + params[0]);
+        return;
+    }
+    servers[params[0]] = link->getSocket();
+    propagate(line, link->getSocket());
+}
+
+void Server::linkSQUIT(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.empty() || servers.find(params[0]) == servers.end())
+        return;
+    servers.erase(params[0]);
+    std::vector<Client *> gone;
+    for (std::map<int, Client *>::iterator it = remoteClients.begin(); it != remoteClients.end(); ++it) {
+        if (it->second->getServer() == params[0])
+            gone.push_back(it->second);
+    }
+    for (size_t i = 0; i < gone.size(); ++i)
+        quitRemoteClient(gone[i], "*.net *.split");
+    propagate(line, link->getSocket());
+}
+
+void Server::linkUID(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.size() < 5)
+        return;
+    Client *existing = findClientByNick(params[0]);
+    if (!NickName(params[0]).valid() || (existing && existing->isRemote()))
+        return;
+    if (existing)
+        removeClient(existing->getSocket(), "Nick collision");
+    Client *client = new Client(nextRemoteId--, params[2]);
+    client->setUplink(link->getSocket());
+    client->setServer(params[3]);
+    setClientNick(client, params[0]);
+    client->setUserName(params[1]);
+    client->setRealName(params[4]);
+    client->setAuthenticated(true);
+    remoteClients[client->getSocket()] = client;
+    notifyOnline(client);
+    propagate(line, link->getSocket());
+}
+
+void Server::linkSJOIN(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.size() < 5)
+        return;
+    std::string channelName = params[0];
+    bool created = channels.find(channelName) == channels.end();
+    if (created)
+        channels[channelName] = new Channel(channelName);
+    Channel *channel = channels[channelName];
+    if (created) {
+        for (size_t i = 1; i < params[1].size(); ++i)
+            channel->setMode(params[1][i]);
+        if (params[2] != "*")
+            channel->setPassword(params[2]);
+        if (channel->hasMode('l'))
+            channel->setUserLimit(atoi(params[3].c_str()));
+    }
+
+    std::istringstream iss(params[4]);
+    std::string nick;
+    while (iss >> nick) {
+        bool op = nick[0] == '@';
+        if (op)
+            nick = nick.substr(1);
+        Client *member = findClientByNick(nick);
+        if (!member || member->getUplink() != link->getSocket()
+            || channel->isUserInChannel(member->getSocket()))
+            continue;
+        channel->addUser(member);
+        if (op)
+            channel->addOperator(member->getSocket());
+        else
+            channel->removeOperator(member->getSocket());
+        flushNotices(channel);
+        channel->broadcastMessage(member->getPrefix() + " JOIN " + channelName + "\r\n", member->getSocket());
+    }
+    propagate(line, link->getSocket());
+}
+
+void Server::linkSTOPIC(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.size() < 2 || channels.find(params[0]) == channels.end())
+        return;
+    if (channels[params[0]]->getTopic().empty())
+        channels[params[0]]->setTopic(params[1]);
+    propagate(line, link->getSocket());
+}
+
+/*
+** BMASK <channel> <b|e|I> :<mask>..., one or more per list in a burst. The
+** masks are merged into the local list.
+*/
+void Server::linkBMASK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    if (params.size() < 3 || params[1].size() != 1 || channels.find(params[0]) == channels.end())
+        return;
+    std::istringstream masks(params[2]);
+    std::string mask;
+    while (masks >> mask)
+        channels[params[0]]->addMask(params[1][0], mask, link->getName(), time(NULL));
+    propagate(line, link->getSocket());
+}
+
+void Server::linkEOB(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    (void)params;
+    (void)line;
+    logMessage("End of burst from " + link->getName());
+}
+
+void Server::linkNICK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.empty())
+        return;
+    std::string nickMessage = client->getPrefix() + " NICK " + params[0] + "\r\n";
+    for (std::map<ChannelName, Channel *>::iterator it = channels.begin(); it != channels.end(); ++it) {
+        if (it->second->isUserInChannel(client->getSocket())) {
+            flushNotices(it->second);
+            it->second->broadcastMessage(nickMessage, client->getSocket());
+        }
+    }
+    std::string oldNick = client->getNickName();
+    setClientNick(client, params[0]);
+    if (NickName(oldNick) != client->getNick())
+        notifyOffline(oldNick);
+    notifyOnline(client);
+    propagate(line, link->getSocket());
+}
+
+void Server::linkJOIN(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.empty())
+        return;
+    std::string channelName = params[0];
+    if (channels.find(channelName) == channels.end())
+        channels[channelName] = new Channel(channelName);
+    Channel *channel = channels[channelName];
+    if (!channel->isUserInChannel(client->getSocket())) {
+        channel->addUser(client);
+        flushNotices(channel);
+        channel->broadcastMessage(client->getPrefix() + " JOIN " + channelName + "\r\n", client->getSocket());
+    }
+    propagate(line, link->getSocket());
+}
+
+void Server::linkPART(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.empty())
+        return;
+    std::map<ChannelName, Channel *>::iterator it = channels.find(params[0]);
+    if (it != channels.end() && it->second->isUserInChannel(client->getSocket())) {
+        Channel *channel = it->second;
+        flushNotices(channel);
+        channel->broadcastMessage(client->getPrefix() + " PART " + params[0] + "\r\n", client->getSocket());
+        channel->removeUser(client->getSocket());
+        if (channel->listUsers().empty()) {
+            deleteChannel(it);
+        }
+    }
+    propagate(line, link->getSocket());
+}
+
+void Server::linkPRIVMSG(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    relayMessage(link, source, params, line, "PRIVMSG");
+}
+
+void Server::linkNOTICE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    relayMessage(link, source, params, line, "NOTICE");
+}
+
+void Server::relayMessage(Link *link, const std::string &source, const std::vector<std::string> &params,
+    const std::string &line, const std::string &command) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.size() < 2)
+        return;
+    std::string target = params[0];
+    std::string message = client->getPrefix() + " " + command + " " + target + " :" + params[1] + "\r\n";
+    if (target[0] == '#' || target[0] == '!' || target[0] == '&' || target[0] == '+') {
+        std::map<ChannelName, Channel *>::iterator it = channels.find(target);
+        if (it == channels.end())
+            return;
+        SharedBuffer shared(message);
+        flushNotices(it->second);
+        it->second->broadcastMessage(shared, client->getSocket());
+        recordHistory(it->second, shared);
+        routeToChannel(it->second, line, link->getSocket());
+        return;
+    }
+    Client *targetClient = findClientByNick(target);
+    if (!targetClient)
+        return;
+    if (targetClient->isRemote())
+        routeToClient(targetClient, line);
+    else
+        sendToClient(targetClient->getSocket(), message);
+}
+
+void Server::linkMODE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.size() < 2)
+        return;
+    std::map<ChannelName, Channel *>::iterator it = channels.find(params[0]);
+    if (it == channels.end() || params[1].size() < 2)
+        return;
+    std::vector<ModeChange> changes = applyChannelModes(client, it->second, params);
+    if (!changes.empty()) {
+        flushNotices(it->second);
+        it->second->broadcastMessage(modeLines(client->getPrefix() + " MODE " + params[0], changes), client->getSocket());
+    }
+    propagate(line, link->getSocket());
+}
+
+void Server::linkTOPIC(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.size() < 2)
+        return;
+    std::map<ChannelName, Channel *>::iterator it = channels.find(params[0]);
+    if (it == channels.end())
+        return;
+    it->second->setTopic(params[1]);
+    flushNotices(it->second);
+    it->second->broadcastMessage(client->getPrefix() + " TOPIC " + params[0] + " :" + params[1] + "\r\n",
+        client->getSocket());
+    propagate(line, link->getSocket());
+}
+
+void Server::linkKICK(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client || params.size() < 2)
+        return;
+    std::map<ChannelName, Channel *>::iterator it = channels.find(params[0]);
+    if (it == channels.end())
+        return;
+    Channel *channel = it->second;
+    Client *targetClient = channel->getUserByNick(params[1]);
+    if (!targetClient)
+        return;
+    std::string reason = params.size() > 2 ? params[2] : "Kicked by operator";
+    std::string kickMsg = client->getPrefix() + " KICK " + params[0] + " " + params[1] + " :" + reason + "\r\n";
+    bool unannounced = dropNotices(channel, targetClient->getSocket());
+    flushNotices(channel);
+    if (unannounced)
+        sendToClient(targetClient->getSocket(), kickMsg);
+    else
+        channel->broadcastMessage(kickMsg, client->getSocket());
+    channel->removeUser(targetClient->getSocket());
+    if (channel->listUsers().empty()) {
+        deleteChannel(it);
+    }
+    propagate(line, link->getSocket());
+}
+
+void Server::linkQUIT(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    if (!client)
+        return;
+    quitRemoteClient(client, params.empty() ? "Client Quit" : params[0]);
+    propagate(line, link->getSocket());
+}
+
+/*
+** A link may only kill users it introduced itself; the rest of the tree
+** hears of it as a QUIT.
+*/
+void Server::linkKILL(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    (void)line;
+    Client *client = params.empty() ? NULL : findLinkClient(link, params[0]);
+    if (!client)
+        return;
+    std::string reason = "Killed (" + (params.size() > 1 ? params[1] : std::string("Killed")) + ")";
+    propagate(":" + client->getNickName() + " QUIT :" + reason, link->getSocket());
+    quitRemoteClient(client, reason);
+}
+
+void Server::linkINVITE(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    Client *client = findLinkClient(link, source);
+    Client *targetClient = params.size() < 2 ? NULL : findClientByNick(params[0]);
+    if (!client || !targetClient)
+        return;
+    if (targetClient->isRemote()) {
+        if (targetClient->getUplink() != link->getSocket())
+            routeToClient(targetClient, line);
+        return;
+    }
+    std::map<ChannelName, Channel *>::iterator it = channels.find(params[1]);
+    if (it != channels.end())
+        it->second->addInvite(targetClient->getSocket());
+    sendToClient(targetClient->getSocket(), client->getPrefix() + " INVITE " + params[0] + " :" + params[1] + "\r\n");
+}
+
+void Server::linkPING(Link *link, const std::string &source, const std::vector<std::string> &params, const std::string &line) {
+    (void)source;
+    (void)line;
+    link->queue("PONG :" + (params.empty() ? serverName : params[0]));
+}
@@ -0,0 +1,254 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerLoad.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/03 11:24:02 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/03 11:24:02 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** Overload mode.
+**
+** run() reports how long each pass of the loop worked; together with the
+** total send queue and the number of clients left with unparsed input this
+** decides whether the server is degraded. It enters as soon as one of the
+** three crosses its -overload limit and leaves once all of them have stayed
+** under half their limit for OVERLOAD_HOLD milliseconds. While degraded:
+**
+**   - the listeners are paused, so no new connection adds to the load;
+**   - per-client budgets (lines parsed, replay and query rows per tick)
+**     are divided by 1 << OVERLOAD_SHIFT;
+**   - the NAMES reply of a JOIN is produced later by a query cursor;
+**   - JOIN and PART in channels of OVERLOAD_CHANNEL members or more are
+**     sent once per tick as one shared buffer per member, and a JOIN
+**     followed by a PART in the same tick is not sent at all.
+**
+** Every transition is logged; STATS o reports the state and counters.
+*/
+
+long long Server::monotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+** "-overload 100,67108864,256": 100 ms of loop lag, 64 MiB of queued
+** output or 256 clients with a backlog. A limit of 0 disables that check.
+*/
+bool Server::setOverloadLimits(const std::string &spec) {
+    std::vector<std::string> fields = splitList(spec);
+
+    if (fields.size() != 3)
+        return false;
+    for (size_t i = 0; i < fields.size(); ++i) {
+        if (fields[i].empty() || fields[i].find_first_not_of("0123456789") != std::string::npos)
+            return false;
+    }
+    load.lagLimit = atol(fields[0].c_str());
+    load.sendqLimit = atol(fields[1].c_str());
+    load.backlogLimit = atol(fields[2].c_str());
+    return true;
+}
+
+void Server::measureLoad(long long busyMicros) {
+    long long now = nowMillis();
+    long long lagMillis;
+    bool over;
+    bool calm;
+
+    load.lag += (busyMicros - load.lag) / 8;
+    load.lagPeak = std::max(load.lagPeak, busyMicros);
+    load.sendqPeak = std::max(load.sendqPeak, load.sendq);
+    load.backlog = inputBacklog.size();
+    lagMillis = load.lag / 1000;
+    over = (load.lagLimit && lagMillis > load.lagLimit) || (load.sendqLimit && load.sendq > load.sendqLimit)
+        || (load.backlogLimit && load.backlog > load.backlogLimit);
+    calm = (!load.lagLimit || lagMillis * 2 < load.lagLimit) && (!load.sendqLimit || load.sendq * 2 < load.sendqLimit)
+        && (!load.backlogLimit || load.backlog * 2 < load.backlogLimit);
+    if (!load.degraded && over) {
+        std::ostringstream oss;
+        oss << "Overload: entering degraded mode (lag " << lagMillis << " ms, sendq " << load.sendq
+            << " bytes, backlog " << load.backlog << " clients)";
+        logMessage(oss.str());
+        load.degraded = true;
+        load.changedAt = now;
+        load.calmSince = 0;
+        load.transitions++;
+        pauseAccept(true);
+        return;
+    }
+    if (!load.degraded)
+        return;
+    if (!calm) {
+        load.calmSince = 0;
+        return;
+    }
+    if (!load.calmSince)
+        load.calmSince = now;
+    if (now - load.calmSince < OVERLOAD_HOLD)
+        return;
+    std::ostringstream oss;
+    oss << "Overload: leaving degraded mode after " << now - load.changedAt << " ms";
+    logMessage(oss.str());
+    load.degraded = false;
+    load.degradedMillis += now - load.changedAt;
+    load.changedAt = now;
+    load.transitions++;
+    pauseAccept(false);
+}
+
+size_t Server::budget(size_t normal) const {
+    return load.degraded ? std::max(normal >> OVERLOAD_SHIFT, static_cast<size_t>(1)) : normal;
+}
+
+/*
+** Sends a JOIN or PART to the other members of channel, or holds it for
+** flushNotices() when degraded and the channel is large.
+*/
+void Server::channelNotice(Channel *channel, Client *client, const std::string &line, bool join) {
+    if (!load.degraded || channel->getUsers().size() < OVERLOAD_CHANNEL) {
+        channel->broadcastMessage(line, client->getSocket());
+        return;
+    }
+    PendingNotice notice;
+    notice.fd = client->getSocket();
+    notice.join = join;
+    notice.line = line;
+    notices[channel->getKey()].push_back(notice);
+    load.coalescedNotices++;
+}
+
+/*
+** Called once per tick. A member who joined and left again during the tick
+** is not announced at all. Members with a notice of their own in the tick
+** are skipped: a joiner's deferred NAMES, produced after this, already
+** lists everyone.
+*/
+void Server::flushNotices() {
+    for (std::map<ChannelName, std::vector<PendingNotice> >::iterator it = notices.begin(); it != notices.end(); ++it) {
+        std::map<ChannelName, Channel *>::iterator chan = channels.find(it->first);
+        if (chan != channels.end())
+            sendNotices(chan->second, it->second);
+    }
+    notices.clear();
+}
+
+/*
+** Sends what is held for channel ahead of a line that goes out at once, so
+** members never see a message, MODE or KICK before the JOIN it follows.
+*/
+void Server::flushNotices(Channel *channel) {
+    if (notices.empty())
+        return;
+    std::map<ChannelName, std::vector<PendingNotice> >::iterator it = notices.find(channel->getKey());
+    if (it == notices.end())
+        return;
+    std::vector<PendingNotice> pending;
+    pending.swap(it->second);
+    notices.erase(it);
+    sendNotices(channel, pending);
+}
+
+/*
+** Forgets the notices held for fd in channel, when it quits or is kicked.
+** Returns true if the first of them was a JOIN: the other members have not
+** seen fd in the channel, so its leaving is not announced either.
+*/
+bool Server::dropNotices(Channel *channel, int fd) {
+    if (notices.empty())
+        return false;
+    std::map<ChannelName, std::vector<PendingNotice> >::iterator it = notices.find(channel->getKey());
+    if (it == notices.end())
+        return false;
+    std::vector<PendingNotice> &pending = it->second;
+    bool found = false;
+    bool unannounced = false;
+    for (size_t i = 0; i < pending.size();) {
+        if (pending[i].fd != fd) {
+            ++i;
+            continue;
+        }
+        if (!found)
+            unannounced = pending[i].join;
+        found = true;
+        pending.erase(pending.begin() + i);
+    }
+    if (pending.empty())
+        notices.erase(it);
+    return unannounced;
+}
+
+void Server::sendNotices(Channel *channel, const std::vector<PendingNotice> &pending) {
+    std::map<int, bool> joinedFirst;
+    std::map<int, bool> joinedLast;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        joinedFirst.insert(std::make_pair(pending[i].fd, pending[i].join));
+        joinedLast[pending[i].fd] = pending[i].join;
+    }
+    std::string lines;
+    for (size_t i = 0; i < pending.size(); ++i) {
+        if (!joinedFirst[pending[i].fd] || joinedLast[pending[i].fd])
+            lines += pending[i].line;
+    }
+    if (lines.empty())
+        return;
+    TaggedLine buffer((SharedBuffer(lines)));
+    Fanout fanout(buffer);
+    const std::map<int, Client *> &users = channel->getUsers();
+    for (std::map<int, Client *>::const_iterator user = users.begin(); user != users.end(); ++user) {
+        if (!user->second->isRemote() && !joinedFirst.count(user->first))
+            fanout.add(user->second);
+    }
+    fanout.send();
+}
+
+/*
+** 353 and 366 for a JOIN, at once or, when degraded, by a query cursor.
+*/
+void Server::sendNames(Client *client, Channel *channel) {
+    if (load.degraded) {
+        QueryCursor cursor;
+        cursor.kind = QueryCursor::NAMES;
+        cursor.target = channel->getName();
+        startQuery(client, cursor);
+        load.deferredNames++;
+        return;
+    }
+    std::vector<std::string> users = channel->listUsers();
+    std::string names;
+    for (size_t i = 0; i < users.size(); i++) {
+        Client *userClient = channel->getUserByNick(users[i]);
+        if (userClient && channel->isOperator(userClient->getSocket()))
+            names += "@";
+        names += users[i] + " ";
+    }
+    sendNumeric(client, RPL_NAMREPLY, "=", channel->getName(), names);
+    sendNumeric(client, RPL_ENDOFNAMES, channel->getName());
+}
+
+void Server::sendLoadStats(Client *client) {
+    long long now = nowMillis();
+    std::ostringstream state;
+    std::ostringstream limits;
+    std::ostringstream counts;
+
+    state << "overload " << (load.degraded ? "degraded" : "normal")
+        << " for " << (now - load.changedAt) / 1000 << "s transitions " << load.transitions
+        << " degraded-total " << (load.degradedMillis + (load.degraded ? now - load.changedAt : 0)) / 1000 << "s";
+    limits << "lag " << load.lag / 1000 << "ms peak " << load.lagPeak / 1000 << "ms limit " << load.lagLimit
+        << "ms sendq " << load.sendq << " peak " << load.sendqPeak << " limit " << load.sendqLimit
+        << " backlog " << load.backlog << " limit " << load.backlogLimit;
+    counts << "deferred-names " << load.deferredNames << " coalesced-notices " << load.coalescedNotices
+        << " accept " << (acceptPaused ? "paused" : "open");
+    sendNumeric(client, RPL_STATSDEBUG, state.str());
+    sendNumeric(client, RPL_STATSDEBUG, limits.str());
+    sendNumeric(client, RPL_STATSDEBUG, counts.str());
+    sendBusyPollStats(client);
+}
@@ -0,0 +1,155 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerMemory.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 10:31:05 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 10:31:05 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+#include "../inc/Memory.hpp"
+
+/*
+** Memory accounting.
+**
+** STATS z walks every owning structure and adds up what it holds on the
+** heap, using the estimates of Memory for the containers. The figures are
+** computed on demand, so nothing is paid for them between two requests:
+**
+**   clients   Client objects with their receive buffers and output state;
+**   channels  Channel objects with their member, mode and mask lists;
+**   buffers   shared line buffers in use (send and replay queues, history);
+**   indexes   the server's lookup tables: nicks, monitors, queries, ...;
+**   links     server links with their buffers;
+**   pools     freed output states and buffers kept for reuse.
+**
+** Once the users of a burst are gone, everything but the pools is back
+** where it was before it; bench/soak checks that over hours of churn.
+*/
+
+static size_t monitorSets(const std::map<NickName, std::set<Client *> > &monitors) {
+    size_t total = Memory::map(monitors);
+
+    for (std::map<NickName, std::set<Client *> >::const_iterator it = monitors.begin(); it != monitors.end(); ++it)
+        total += Memory::set(it->second);
+    return total;
+}
+
+static size_t monitoringSets(const std::map<Client *, std::set<NickName> > &monitoring) {
+    size_t total = Memory::map(monitoring);
+
+    for (std::map<Client *, std::set<NickName> >::const_iterator it = monitoring.begin(); it != monitoring.end(); ++it)
+        total += Memory::set(it->second);
+    return total;
+}
+
+static size_t queryCursors(const std::map<int, std::deque<QueryCursor> > &queries) {
+    size_t total = Memory::map(queries);
+
+    for (std::map<int, std::deque<QueryCursor> >::const_iterator it = queries.begin(); it != queries.end(); ++it) {
+        total += Memory::deque(it->second.size(), sizeof(QueryCursor));
+        for (std::deque<QueryCursor>::const_iterator cursor = it->second.begin(); cursor != it->second.end(); ++cursor) {
+            total += Memory::string(cursor->target) + Memory::string(cursor->resume) + Memory::string(cursor->pending)
+                + Memory::vector(cursor->masks) + Memory::vector(cursor->excluded);
+            for (size_t i = 0; i < cursor->masks.size(); ++i)
+                total += Memory::string(cursor->masks[i]);
+            for (size_t i = 0; i < cursor->excluded.size(); ++i)
+                total += Memory::string(cursor->excluded[i]);
+        }
+    }
+    return total;
+}
+
+static size_t pendingNotices(const std::map<ChannelName, std::vector<PendingNotice> > &notices) {
+    size_t total = Memory::map(notices);
+
+    for (std::map<ChannelName, std::vector<PendingNotice> >::const_iterator it = notices.begin(); it != notices.end(); ++it) {
+        total += Memory::vector(it->second);
+        for (size_t i = 0; i < it->second.size(); ++i)
+            total += Memory::string(it->second[i].line);
+    }
+    return total;
+}
+
+/*
+** Resident set size from /proc, 0 where it cannot be read.
+*/
+static size_t residentSize() {
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0;
+    size_t resident = 0;
+
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+void Server::accountMemory(MemoryStats &stats) const {
+    memset(&stats, 0, sizeof(stats));
+    for (std::map<int, Client *>::const_iterator it = clients.begin(); it != clients.end(); ++it) {
+        stats.clients += it->second->memoryUsage();
+        stats.sendq += it->second->getSendQueueSize();
+        stats.recvq += it->second->getInputSize();
+    }
+    for (std::map<int, Client *>::const_iterator it = remoteClients.begin(); it != remoteClients.end(); ++it)
+        stats.clients += it->second->memoryUsage();
+    for (std::map<ChannelName, Channel *>::const_iterator it = channels.begin(); it != channels.end(); ++it) {
+        stats.channels += it->second->memoryUsage();
+        stats.history += it->second->getHistoryBytes();
+    }
+    stats.bufferCount = SharedBuffer::getBlockCount();
+    stats.pools = SharedBuffer::getPooled() + Client::pooledOutputMemory();
+    stats.buffers = SharedBuffer::getAllocated() - SharedBuffer::getPooled();
+
+    stats.indexes = Memory::map(clients) + Memory::map(registeredUsers) + Memory::map(nicks) + Memory::map(channels)
+        + Memory::map(remoteClients) + Memory::vector(listeners) + Memory::vector(classes) + Memory::vector(events)
+        + Memory::set(inputBacklog) + Memory::set(tickReaders) + Memory::map(captureIds)
+        + historyLru.size() * Memory::node(sizeof(Channel *)) + Memory::map(historyLruPos)
+        + monitorSets(monitors) + monitoringSets(monitoring) + queryCursors(queries) + pendingNotices(notices)
+        + Memory::map(ipConnections) + Memory::map(operators) + Memory::map(bridgeAccounts) + Memory::map(bridges);
+    for (std::map<std::string, size_t>::const_iterator it = ipConnections.begin(); it != ipConnections.end(); ++it)
+        stats.indexes += Memory::string(it->first);
+    for (std::map<std::string, Client *>::const_iterator it = registeredUsers.begin(); it != registeredUsers.end(); ++it)
+        stats.indexes += Memory::string(it->first);
+    for (std::map<int, Bridge>::const_iterator it = bridges.begin(); it != bridges.end(); ++it)
+        stats.indexes += Memory::string(it->second.name) + Memory::map(it->second.users);
+
+    stats.links = Memory::map(links) + Memory::map(servers) + Memory::vector(linkTargets);
+    for (std::map<int, Link *>::const_iterator it = links.begin(); it != links.end(); ++it)
+        stats.links += it->second->memoryUsage();
+    for (std::map<std::string, int>::const_iterator it = servers.begin(); it != servers.end(); ++it)
+        stats.links += Memory::string(it->first);
+}
+
+/*
+** STATS z, operators only. One key/value line per group so scripts can
+** read it: bytes per subsystem, then how much of the buffers is queued
+** output, unparsed input and channel history, with the process RSS, then
+** the object counts.
+*/
+void Server::sendMemoryStats(Client *client) {
+    MemoryStats stats;
+    std::ostringstream memory;
+    std::ostringstream queued;
+    std::ostringstream objects;
+
+    if (!client->isIrcOperator()) {
+        sendNumeric(client, ERR_NOPRIVILEGES);
+        return;
+    }
+    accountMemory(stats);
+    memory << "memory clients " << stats.clients << " channels " << stats.channels << " buffers " << stats.buffers
+        << " indexes " << stats.indexes << " links " << stats.links << " pools " << stats.pools
+        << " total " << stats.clients + stats.channels + stats.buffers + stats.indexes + stats.links + stats.pools;
+    queued << "queued sendq " << stats.sendq << " recvq " << stats.recvq << " history " << stats.history
+        << " rss " << residentSize();
+    objects << "objects clients " << clients.size() + remoteClients.size() << " channels " << channels.size()
+        << " buffers " << stats.bufferCount << " links " << links.size();
+    sendNumeric(client, RPL_STATSDEBUG, memory.str());
+    sendNumeric(client, RPL_STATSDEBUG, queued.str());
+    sendNumeric(client, RPL_STATSDEBUG, objects.str());
+}
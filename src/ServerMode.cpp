@@ -0,0 +1,176 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerMode.cpp                                     :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/12 17:08:26 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/12 17:08:26 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** Channel mode strings, for MODE from local clients and from links.
+**
+** "MODE #c +itk-l+oo key alice bob" is read left to right: each of k, l
+** (when set), o, b, e and I takes the next argument. A local client may
+** pass up to MODES_MAX of them per command (advertised as MODES=); the rest
+** are ignored. A b, e or I with no argument left lists that mask list,
+** once per command, and counts toward the same limit. Changes that do nothing (+i on a +i channel, +o on an
+** operator) are dropped, and whatever is left goes to the channel in one
+** broadcast, as a single MODE line unless it would go over MODE_LINE_MAX.
+*/
+
+std::vector<ModeChange> Server::applyChannelModes(Client *source, Channel *channel,
+    const std::vector<std::string> &params) {
+    std::vector<ModeChange> changes;
+    const std::string &modes = params[1];
+    bool local = !source->isRemote();
+    bool adding = true;
+    size_t next = 2;
+    size_t withArgs = 0;
+    std::string listed;
+
+    for (size_t i = 0; i < modes.size(); ++i) {
+        char mode = modes[i];
+        if (mode == '+' || mode == '-') {
+            adding = mode == '+';
+            continue;
+        }
+        if (!std::strchr("itklo", mode) && !channel->getMaskList(mode)) {
+            if (local)
+                sendNumeric(source, ERR_UNKNOWNMODE, std::string(1, mode));
+            continue;
+        }
+        ModeChange change = {adding, mode, ""};
+        if (mode == 'k' || mode == 'o' || (mode == 'l' && adding) || channel->getMaskList(mode)) {
+            if (next < params.size())
+                change.arg = params[next++];
+            else if (local && channel->getMaskList(mode)) {
+                if (listed.find(mode) == std::string::npos && ++withArgs <= MODES_MAX) {
+                    listed += mode;
+                    sendMaskList(source, channel, mode);
+                }
+                continue;
+            } else if (mode != 'k' || adding) {
+                if (local)
+                    sendNumeric(source, ERR_NEEDMOREPARAMS, "MODE");
+                continue;
+            }
+            if (local && ++withArgs > MODES_MAX)
+                continue;
+        }
+        if (applyChannelMode(source, channel, change))
+            changes.push_back(change);
+    }
+    return changes;
+}
+
+/*
+** Applies one change and rewrites its argument the way it is echoed.
+** Returns false when nothing changed.
+*/
+bool Server::applyChannelMode(Client *source, Channel *channel, ModeChange &change) {
+    bool local = !source->isRemote();
+
+    if (change.mode == 'i' || change.mode == 't') {
+        if (channel->hasMode(change.mode) == change.adding)
+            return false;
+        if (change.adding)
+            channel->setMode(change.mode);
+        else
+            channel->unsetMode(change.mode);
+    } else if (change.mode == 'k') {
+        if (change.adding && change.arg.empty())
+            return false;
+        if (!change.adding && !channel->hasMode('k'))
+            return false;
+        if (change.adding)
+            channel->setMode('k');
+        else
+            channel->unsetMode('k');
+        channel->setPassword(change.adding ? change.arg : "");
+        if (!change.adding)
+            change.arg = "*";
+    } else if (change.mode == 'l') {
+        int limit = change.adding ? atoi(change.arg.c_str()) : 0;
+        if (change.adding && limit <= 0)
+            return false;
+        if (!change.adding && !channel->hasMode('l'))
+            return false;
+        if (change.adding)
+            channel->setMode('l');
+        else
+            channel->unsetMode('l');
+        channel->setUserLimit(limit);
+        std::ostringstream arg;
+        if (change.adding)
+            arg << limit;
+        change.arg = arg.str();
+    } else if (change.mode == 'o') {
+        Client *target = channel->getUserByNick(change.arg);
+        if (!target) {
+            if (local)
+                sendNumeric(source, ERR_NOSUCHNICK, change.arg);
+            return false;
+        }
+        if (channel->isOperator(target->getSocket()) == change.adding)
+            return false;
+        if (change.adding)
+            channel->addOperator(target->getSocket());
+        else
+            channel->removeOperator(target->getSocket());
+        change.arg = target->getNickName();
+    } else {
+        change.arg = MaskIndex::normalize(change.arg);
+        if (change.adding && channel->getMaskList(change.mode)->size() >= MAXLIST) {
+            if (local)
+                sendNumeric(source, ERR_BANLISTFULL, channel->getName(), std::string(1, change.mode));
+            return false;
+        }
+        if (change.adding)
+            return channel->addMask(change.mode, change.arg, source->getHostname(), time(NULL));
+        return channel->removeMask(change.mode, change.arg);
+    }
+    return true;
+}
+
+/*
+** "+it-k+o * alice" for changes[next...], as many as fit in room bytes (at
+** least one). next is left on the first change not written.
+*/
+std::string Server::modeLine(const std::vector<ModeChange> &changes, size_t &next, size_t room) {
+    std::string modes;
+    std::string args;
+    char sign = 0;
+
+    for (size_t first = next; next < changes.size(); ++next) {
+        char changeSign = changes[next].adding ? '+' : '-';
+        size_t modeSize = changeSign == sign ? 1 : 2;
+        size_t argSize = changes[next].arg.empty() ? 0 : changes[next].arg.size() + 1;
+        if (next > first && modes.size() + args.size() + modeSize + argSize > room)
+            break;
+        if (changeSign != sign)
+            modes += changeSign;
+        modes += changes[next].mode;
+        if (argSize)
+            args += " " + changes[next].arg;
+        sign = changeSign;
+    }
+    return modes + args;
+}
+
+/*
+** The CRLF-terminated MODE lines for changes, each starting with head.
+*/
+std::string Server::modeLines(const std::string &head, const std::vector<ModeChange> &changes) {
+    std::string lines;
+    size_t room = head.size() + 3 < MODE_LINE_MAX ? MODE_LINE_MAX - head.size() - 3 : 0;
+
+    for (size_t next = 0; next < changes.size();)
+        lines += head + " " + modeLine(changes, next, room) + "\r\n";
+    return lines;
+}
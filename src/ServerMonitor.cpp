@@ -0,0 +1,153 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerMonitor.cpp                                  :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/01 10:44:52 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/01 10:44:52 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** IRCv3 MONITOR.
+**
+** monitors maps a casefolded nick to the local clients watching it, so a
+** nick coming or going costs one lookup plus one line per watcher. The
+** forward map, monitoring, backs MONITOR L/C and the cleanup when a
+** watcher disconnects. Remote users count: they come online with UID and
+** go offline with QUIT, KILL or a netsplit.
+**
+**   MONITOR + nick[,nick...]   730/731 for each, 734 past MONITOR_MAX
+**   MONITOR - nick[,nick...]
+**   MONITOR C                  clear the list
+**   MONITOR L                  732 ... 733
+**   MONITOR S                  730/731 for the whole list
+*/
+
+void Server::handleMONITOR(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "MONITOR");
+        return;
+    }
+    if (params.empty() || params[0].size() != 1 || ((params[0] == "+" || params[0] == "-") && params.size() < 2)) {
+        sendNumeric(client, ERR_NEEDMOREPARAMS, "MONITOR");
+        return;
+    }
+    std::set<NickName> &watched = monitoring[client];
+    char action = params[0][0];
+
+    if (action == '+') {
+        std::vector<std::string> targets = splitList(params[1]);
+        std::vector<NickName> added;
+        for (size_t i = 0; i < targets.size(); ++i) {
+            NickName nick(targets[i]);
+            if (!nick.valid() || nick.empty() || targets[i].find_first_of("!@*?#&") != std::string::npos
+                || watched.count(nick))
+                continue;
+            if (watched.size() >= MONITOR_MAX) {
+                sendNumeric(client, ERR_MONLISTFULL, static_cast<size_t>(MONITOR_MAX), params[1]);
+                break;
+            }
+            watched.insert(nick);
+            monitors[nick].insert(client);
+            added.push_back(nick);
+        }
+        sendMonitorStatus(client, added);
+    } else if (action == '-') {
+        std::vector<std::string> targets = splitList(params[1]);
+        for (size_t i = 0; i < targets.size(); ++i)
+            unwatchNick(client, NickName(targets[i]));
+    } else if (action == 'C') {
+        clearMonitor(client);
+    } else if (action == 'L') {
+        std::string line;
+        for (std::set<NickName>::iterator it = watched.begin(); it != watched.end(); ++it) {
+            if (!line.empty() && line.size() + it->size() > 400) {
+                sendNumeric(client, RPL_MONLIST, line);
+                line.clear();
+            }
+            line += (line.empty() ? "" : ",") + it->str();
+        }
+        if (!line.empty())
+            sendNumeric(client, RPL_MONLIST, line);
+        sendNumeric(client, RPL_ENDOFMONLIST);
+    } else if (action == 'S') {
+        sendMonitorStatus(client, std::vector<NickName>(watched.begin(), watched.end()));
+    }
+    std::map<Client *, std::set<NickName> >::iterator own = monitoring.find(client);
+    if (own != monitoring.end() && own->second.empty())
+        monitoring.erase(own);
+}
+
+/*
+** 730 for the nicks that are online (as nick!user@host) and 731 for the
+** rest, packed several to a line.
+*/
+void Server::sendMonitorStatus(Client *client, const std::vector<NickName> &nicksToCheck) {
+    std::string online;
+    std::string offline;
+
+    for (size_t i = 0; i < nicksToCheck.size(); ++i) {
+        Client *target = findClientByNick(nicksToCheck[i]);
+        bool present = target && (target->isRegistered() || target->isRemote());
+        std::string &line = present ? online : offline;
+        std::string entry = present ? target->getHostname() : nicksToCheck[i].str();
+        if (!line.empty() && line.size() + entry.size() > 400) {
+            sendNumeric(client, present ? RPL_MONONLINE : RPL_MONOFFLINE, line);
+            line.clear();
+        }
+        line += (line.empty() ? "" : ",") + entry;
+    }
+    if (!online.empty())
+        sendNumeric(client, RPL_MONONLINE, online);
+    if (!offline.empty())
+        sendNumeric(client, RPL_MONOFFLINE, offline);
+}
+
+void Server::notifyOnline(Client *client) {
+    std::map<NickName, std::set<Client *> >::iterator it = monitors.find(client->getNick());
+    if (it == monitors.end())
+        return;
+    std::string hostname = client->getHostname();
+    for (std::set<Client *>::iterator watcher = it->second.begin(); watcher != it->second.end(); ++watcher)
+        sendNumeric(*watcher, RPL_MONONLINE, hostname);
+}
+
+void Server::notifyOffline(const std::string &nick) {
+    std::map<NickName, std::set<Client *> >::iterator it = monitors.find(NickName(nick));
+    if (it == monitors.end())
+        return;
+    for (std::set<Client *>::iterator watcher = it->second.begin(); watcher != it->second.end(); ++watcher)
+        sendNumeric(*watcher, RPL_MONOFFLINE, nick);
+}
+
+void Server::unwatchNick(Client *client, const NickName &nick) {
+    std::map<Client *, std::set<NickName> >::iterator own = monitoring.find(client);
+    if (own == monitoring.end() || !own->second.erase(nick))
+        return;
+    std::map<NickName, std::set<Client *> >::iterator it = monitors.find(nick);
+    if (it != monitors.end()) {
+        it->second.erase(client);
+        if (it->second.empty())
+            monitors.erase(it);
+    }
+}
+
+void Server::clearMonitor(Client *client) {
+    std::map<Client *, std::set<NickName> >::iterator own = monitoring.find(client);
+    if (own == monitoring.end())
+        return;
+    for (std::set<NickName>::iterator nick = own->second.begin(); nick != own->second.end(); ++nick) {
+        std::map<NickName, std::set<Client *> >::iterator it = monitors.find(*nick);
+        if (it == monitors.end())
+            continue;
+        it->second.erase(client);
+        if (it->second.empty())
+            monitors.erase(it);
+    }
+    monitoring.erase(own);
+}
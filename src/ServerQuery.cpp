@@ -0,0 +1,286 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   ServerQuery.cpp                                    :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/02 14:08:31 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/02 14:08:31 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Server.hpp"
+
+/*
+** LIST, WHO and WHOIS.
+**
+** The handlers only parse their arguments and queue a QueryCursor; the
+** replies are produced by advanceQueries() once per tick, like CHATHISTORY
+** replay: a cursor runs while its client's send queue is under
+** REPLAY_WATERMARK, and all cursors together examine at most QUERY_ROWS
+** table entries per tick. A LIST over a large network therefore costs the
+** other users a bounded amount of latency per tick and never builds more
+** output than the reader is taking.
+**
+**   LIST [<filter>[,<filter>...]]   ELIST=MNU: mask, !mask, >users, <users
+**   WHO <#channel|mask> [o]
+**   WHOIS [<server>] <nick>
+*/
+
+void Server::handleLIST(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "LIST");
+        return;
+    }
+    QueryCursor cursor;
+    cursor.kind = QueryCursor::LIST;
+    cursor.minUsers = 0;
+    cursor.maxUsers = static_cast<size_t>(-1);
+    if (!params.empty()) {
+        std::vector<std::string> filters = splitList(params[0]);
+        for (size_t i = 0; i < filters.size(); ++i) {
+            const std::string &filter = filters[i];
+            if (filter.size() > 1 && filter[0] == '>')
+                cursor.minUsers = std::max(cursor.minUsers, static_cast<size_t>(atol(filter.c_str() + 1)) + 1);
+            else if (filter.size() > 1 && filter[0] == '<')
+                cursor.maxUsers = std::min(cursor.maxUsers, static_cast<size_t>(atol(filter.c_str() + 1)));
+            else if (filter.size() > 1 && filter[0] == '!')
+                cursor.excluded.push_back(filter.substr(1));
+            else if (!filter.empty())
+                cursor.masks.push_back(filter);
+        }
+    }
+    sendNumeric(client, RPL_LISTSTART);
+    startQuery(client, cursor);
+}
+
+void Server::handleWHO(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "WHO");
+        return;
+    }
+    QueryCursor cursor;
+    cursor.target = params.empty() || params[0] == "0" ? "*" : params[0];
+    cursor.kind = std::string("#&!+").find(cursor.target[0]) != std::string::npos
+        ? QueryCursor::WHO_CHANNEL : QueryCursor::WHO_USERS;
+    cursor.opersOnly = params.size() > 1 && params[1] == "o";
+    startQuery(client, cursor);
+}
+
+void Server::handleWHOIS(Client *client, const std::vector<std::string> &params) {
+    if (!client->isRegistered()) {
+        sendNumeric(client, ERR_NOTREGISTERED, "WHOIS");
+        return;
+    }
+    if (params.empty()) {
+        sendNumeric(client, ERR_NONICKNAMEGIVEN);
+        return;
+    }
+    std::string nick = splitList(params.back()).empty() ? "" : splitList(params.back())[0];
+    Client *target = findClientByNick(nick);
+    if (!target || (!target->isRegistered() && !target->isRemote())) {
+        sendNumeric(client, ERR_NOSUCHNICK, nick);
+        sendNumeric(client, RPL_ENDOFWHOIS, nick);
+        return;
+    }
+    std::string userName = target->getUserName();
+    std::string address = target->getIpAddress();
+    ReplyArg name(target->getNick());
+    ReplyArg user(userName);
+    ReplyArg host(address);
+    ReplyArg realName(target->getRealName());
+    const ReplyArg *args[] = {&name, &user, &host, &realName};
+    sendNumeric(client, RPL_WHOISUSER, args, 4);
+    QueryCursor cursor;
+    cursor.kind = QueryCursor::WHOIS;
+    cursor.target = target->getNickName();
+    startQuery(client, cursor);
+}
+
+void Server::startQuery(Client *client, QueryCursor &cursor) {
+    cursor.started = false;
+    cursor.member = 0;
+    queries[client->getSocket()].push_back(cursor);
+}
+
+/*
+** Called once per tick from flushClients(). Each client's oldest cursor gets
+** an equal share of QUERY_ROWS (less when overloaded); a cursor that
+** finishes hands what is left of its share to the client's next one.
+** queryBacklog records whether some cursor stopped on the row budget rather
+** than on its send queue, in which case run() polls without waiting.
+*/
+void Server::advanceQueries() {
+    queryBacklog = false;
+    if (queries.empty())
+        return;
+    size_t share = budget(QUERY_ROWS) / queries.size() + 1;
+    std::map<int, std::deque<QueryCursor> >::iterator it = queries.begin();
+    while (it != queries.end()) {
+        std::map<int, Client *>::iterator owner = clients.find(it->first);
+        if (owner == clients.end()) {
+            queries.erase(it++);
+            continue;
+        }
+        Client *client = owner->second;
+        Client *sink = client->isVirtual() ? client->getBridge() : client;
+        size_t rows = share;
+        while (!it->second.empty() && rows > 0 && sink->getSendQueueSize() < REPLAY_WATERMARK) {
+            if (!stepQuery(client, it->second.front(), rows))
+                break;
+            it->second.pop_front();
+        }
+        if (it->second.empty()) {
+            queries.erase(it++);
+            continue;
+        }
+        if (rows == 0 && sink->getSendQueueSize() < REPLAY_WATERMARK)
+            queryBacklog = true;
+        ++it;
+    }
+}
+
+bool Server::hasPendingQuery(int fd) const {
+    return queries.find(fd) != queries.end();
+}
+
+/*
+** Runs one cursor until it has examined rows entries, its client's send
+** queue (its bridge's, for a bridged user) reaches REPLAY_WATERMARK or it
+** reaches the end of its table, and returns true in the last case, with the
+** end-of-list reply queued.
+*/
+bool Server::stepQuery(Client *client, QueryCursor &cursor, size_t &rows) {
+    Client *sink = client->isVirtual() ? client->getBridge() : client;
+    if (cursor.kind == QueryCursor::LIST || cursor.kind == QueryCursor::WHOIS) {
+        Client *target = cursor.kind == QueryCursor::WHOIS ? findClientByNick(cursor.target) : NULL;
+        std::map<ChannelName, Channel *>::iterator it = cursor.started
+            ? channels.upper_bound(ChannelName(cursor.resume)) : channels.begin();
+        for (; it != channels.end(); ++it) {
+            if (rows == 0 || sink->getSendQueueSize() >= REPLAY_WATERMARK || (cursor.kind == QueryCursor::WHOIS && !target))
+                break;
+            --rows;
+            Channel *channel = it->second;
+            cursor.started = true;
+            cursor.resume = channel->getName();
+            if (cursor.kind == QueryCursor::LIST) {
+                if (listMatches(cursor, channel))
+                    sendNumeric(client, RPL_LIST, cursor.resume, channel->getUsers().size(), channel->getTopic());
+                continue;
+            }
+            if (!channel->isUserInChannel(target->getSocket()))
+                continue;
+            std::string entry = (channel->isOperator(target->getSocket()) ? "@" : "") + channel->getName();
+            if (!cursor.pending.empty() && cursor.pending.size() + entry.size() > 400) {
+                sendNumeric(client, RPL_WHOISCHANNELS, cursor.target, cursor.pending);
+                cursor.pending.clear();
+            }
+            cursor.pending += (cursor.pending.empty() ? "" : " ") + entry;
+        }
+        if (it != channels.end() && !(cursor.kind == QueryCursor::WHOIS && !target))
+            return false;
+        if (cursor.kind == QueryCursor::LIST) {
+            sendNumeric(client, RPL_LISTEND);
+            return true;
+        }
+        if (target && !cursor.pending.empty())
+            sendNumeric(client, RPL_WHOISCHANNELS, cursor.target, cursor.pending);
+        if (target)
+            sendNumeric(client, RPL_WHOISSERVER, cursor.target, target->isRemote() ? target->getServer() : serverName);
+        if (target && target->isIrcOperator())
+            sendNumeric(client, RPL_WHOISOPERATOR, cursor.target);
+        sendNumeric(client, RPL_ENDOFWHOIS, cursor.target);
+        return true;
+    }
+    if (cursor.kind == QueryCursor::WHO_CHANNEL || cursor.kind == QueryCursor::NAMES) {
+        std::map<ChannelName, Channel *>::iterator chan = channels.find(ChannelName(cursor.target));
+        if (chan != channels.end()) {
+            const std::map<int, Client *> &users = chan->second->getUsers();
+            std::map<int, Client *>::const_iterator it = cursor.started
+                ? users.upper_bound(cursor.member) : users.begin();
+            for (; it != users.end(); ++it) {
+                if (rows == 0 || sink->getSendQueueSize() >= REPLAY_WATERMARK)
+                    return false;
+                --rows;
+                cursor.started = true;
+                cursor.member = it->first;
+                if (cursor.kind == QueryCursor::NAMES)
+                    addName(client, cursor, (chan->second->isOperator(it->first) ? "@" : "") + it->second->getNickName());
+                else if (!cursor.opersOnly || it->second->isIrcOperator())
+                    sendWhoReply(client, chan->second->getName(), it->second,
+                        chan->second->isOperator(it->first));
+            }
+        }
+        if (cursor.kind == QueryCursor::NAMES) {
+            if (!cursor.pending.empty())
+                sendNumeric(client, RPL_NAMREPLY, "=", cursor.target, cursor.pending);
+            sendNumeric(client, RPL_ENDOFNAMES, cursor.target);
+            return true;
+        }
+    } else {
+        std::map<NickName, Client *>::iterator it = cursor.started
+            ? nicks.upper_bound(NickName(cursor.resume)) : nicks.begin();
+        for (; it != nicks.end(); ++it) {
+            if (rows == 0 || sink->getSendQueueSize() >= REPLAY_WATERMARK)
+                return false;
+            --rows;
+            Client *user = it->second;
+            cursor.started = true;
+            cursor.resume = user->getNickName();
+            if (!user->isRegistered() && !user->isRemote())
+                continue;
+            if (cursor.opersOnly && !user->isIrcOperator())
+                continue;
+            if (cursor.target != "*" && !MaskIndex::match(cursor.target, user->getNickName())
+                && !MaskIndex::match(cursor.target, user->getHostname())
+                && !MaskIndex::match(cursor.target, user->getRealName()))
+                continue;
+            sendWhoReply(client, "*", user, false);
+        }
+    }
+    sendNumeric(client, RPL_ENDOFWHO, cursor.target);
+    return true;
+}
+
+void Server::addName(Client *client, QueryCursor &cursor, const std::string &name) {
+    if (!cursor.pending.empty() && cursor.pending.size() + name.size() > 400) {
+        sendNumeric(client, RPL_NAMREPLY, "=", cursor.target, cursor.pending);
+        cursor.pending.clear();
+    }
+    cursor.pending += (cursor.pending.empty() ? "" : " ") + name;
+}
+
+bool Server::listMatches(const QueryCursor &cursor, Channel *channel) const {
+    size_t users = channel->getUsers().size();
+    bool matched = cursor.masks.empty();
+
+    if (users < cursor.minUsers || users > cursor.maxUsers)
+        return false;
+    for (size_t i = 0; i < cursor.masks.size() && !matched; ++i)
+        matched = MaskIndex::match(cursor.masks[i], channel->getName());
+    for (size_t i = 0; i < cursor.excluded.size() && matched; ++i)
+        matched = !MaskIndex::match(cursor.excluded[i], channel->getName());
+    return matched;
+}
+
+void Server::sendWhoReply(Client *client, const std::string &channel, Client *user, bool channelOp) {
+    bool remote = user->isRemote();
+    char flags[4] = "H";
+    if (user->isIrcOperator())
+        strcat(flags, "*");
+    if (channelOp)
+        strcat(flags, "@");
+    std::string name = user->getUserName();
+    std::string address = user->getIpAddress();
+    ReplyArg where(channel);
+    ReplyArg userName(name);
+    ReplyArg host(address);
+    ReplyArg server(remote ? user->getServer().c_str() : serverName.c_str());
+    ReplyArg nick(user->getNick());
+    ReplyArg status(flags);
+    ReplyArg hops(remote ? "1" : "0");
+    ReplyArg realName(user->getRealName());
+    const ReplyArg *args[] = {&where, &userName, &host, &server, &nick, &status, &hops, &realName};
+    sendNumeric(client, RPL_WHOREPLY, args, 8);
+}
@@ -0,0 +1,127 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   SharedBuffer.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/17 09:41:03 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/17 09:41:03 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/SharedBuffer.hpp"
+#include "../inc/Memory.hpp"
+#include <algorithm>
+
+static const std::string emptyString;
+
+std::vector<SharedBuffer::Block *> SharedBuffer::pool;
+size_t SharedBuffer::blocks = 0;
+size_t SharedBuffer::bytes = 0;
+
+SharedBuffer::SharedBuffer() : block(NULL) {}
+
+SharedBuffer::SharedBuffer(const std::string &bytes) : block(new Block) {
+    block->refs = 1;
+    block->writable = false;
+    block->bytes = bytes;
+    blocks++;
+    SharedBuffer::bytes += footprint(block);
+}
+
+SharedBuffer::SharedBuffer(const SharedBuffer &other) : block(other.block) {
+    if (block)
+        block->refs++;
+}
+
+SharedBuffer &SharedBuffer::operator=(const SharedBuffer &other) {
+    if (block != other.block) {
+        release();
+        block = other.block;
+        if (block)
+            block->refs++;
+    }
+    return *this;
+}
+
+SharedBuffer::~SharedBuffer() { release(); }
+
+void SharedBuffer::release() {
+    if (block && --block->refs == 0) {
+        if (block->writable && pool.size() < SHARED_POOL && block->bytes.capacity() <= SHARED_BLOCK * 4) {
+            block->bytes.clear();
+            pool.push_back(block);
+        } else
+            destroy(block);
+    }
+    block = NULL;
+}
+
+size_t SharedBuffer::footprint(const Block *block) {
+    return Memory::block(sizeof(Block)) + Memory::string(block->bytes);
+}
+
+void SharedBuffer::destroy(Block *block) {
+    blocks--;
+    bytes -= footprint(block);
+    delete block;
+}
+
+const char *SharedBuffer::data() const { return block ? block->bytes.data() : ""; }
+
+size_t SharedBuffer::size() const { return block ? block->bytes.size() : 0; }
+
+bool SharedBuffer::empty() const { return size() == 0; }
+
+const std::string &SharedBuffer::str() const { return block ? block->bytes : emptyString; }
+
+/*
+** Grows a writable buffer by len bytes and returns where they go, or NULL
+** when the buffer is shared, read-only or would have to reallocate.
+*/
+char *SharedBuffer::extend(size_t len) {
+    if (!block || !block->writable || block->refs != 1 || block->bytes.size() + len > block->bytes.capacity())
+        return NULL;
+    size_t used = block->bytes.size();
+    block->bytes.resize(used + len);
+    return &block->bytes[used];
+}
+
+/*
+** An empty writable buffer with room for at least capacity bytes, taken
+** from the pool when it has one.
+*/
+SharedBuffer SharedBuffer::writable(size_t capacity) {
+    SharedBuffer buffer;
+
+    if (!pool.empty()) {
+        buffer.block = pool.back();
+        pool.pop_back();
+    } else {
+        buffer.block = new Block;
+        buffer.block->writable = true;
+        blocks++;
+        bytes += footprint(buffer.block);
+    }
+    buffer.block->refs = 1;
+    bytes -= footprint(buffer.block);
+    buffer.block->bytes.reserve(std::max(capacity, static_cast<size_t>(SHARED_BLOCK)));
+    bytes += footprint(buffer.block);
+    return buffer;
+}
+
+size_t SharedBuffer::getBlockCount() { return blocks; }
+
+/*
+** Every block still allocated, pooled ones included.
+*/
+size_t SharedBuffer::getAllocated() { return bytes; }
+
+size_t SharedBuffer::getPooled() {
+    size_t total = 0;
+
+    for (size_t i = 0; i < pool.size(); ++i)
+        total += footprint(pool[i]);
+    return total;
+}
@@ -0,0 +1,281 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TextScan.cpp                                       :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/28 10:17:51 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/28 10:17:51 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/TextScan.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+# include <immintrin.h>
+# define TEXTSCAN_X86 1
+#endif
+
+static size_t breaksFrom(const char *data, size_t i, size_t len, size_t *positions, size_t found, size_t max) {
+    for (; i < len && found < max; ++i) {
+        if (data[i] == '\r' || data[i] == '\n' || data[i] == '\0')
+            positions[found++] = i;
+    }
+    return found;
+}
+
+/*
+** Length of the well-formed UTF-8 sequence at s, or 0. Overlong forms,
+** surrogates and code points past U+10FFFF are rejected.
+*/
+static size_t utf8Sequence(const unsigned char *s, size_t len) {
+    unsigned char c = s[0];
+
+    if (c < 0x80)
+        return 1;
+    if (c >= 0xC2 && c <= 0xDF)
+        return len >= 2 && (s[1] & 0xC0) == 0x80 ? 2 : 0;
+    if (c >= 0xE0 && c <= 0xEF) {
+        if (len < 3 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80)
+            return 0;
+        if ((c == 0xE0 && s[1] < 0xA0) || (c == 0xED && s[1] > 0x9F))
+            return 0;
+        return 3;
+    }
+    if (c >= 0xF0 && c <= 0xF4) {
+        if (len < 4 || (s[1] & 0xC0) != 0x80 || (s[2] & 0xC0) != 0x80 || (s[3] & 0xC0) != 0x80)
+            return 0;
+        if ((c == 0xF0 && s[1] < 0x90) || (c == 0xF4 && s[1] > 0x8F))
+            return 0;
+        return 4;
+    }
+    return 0;
+}
+
+/*
+** Validates the sequences that start before stop and returns where the last
+** one ends, or len + 1 on an invalid sequence.
+*/
+static size_t utf8Until(const unsigned char *s, size_t i, size_t stop, size_t len) {
+    while (i < stop && i < len) {
+        size_t n = utf8Sequence(s + i, len - i);
+        if (!n)
+            return len + 1;
+        i += n;
+    }
+    return i;
+}
+
+static void unmaskFrom(char *dst, const char *src, size_t i, size_t len, const unsigned char *key, size_t phase) {
+    for (; i < len; ++i)
+        dst[i] = src[i] ^ key[(phase + i) & 3];
+}
+
+/*
+** The key rotated to the payload offset and repeated over 16 bytes.
+*/
+static void spreadKey(unsigned char *spread, const unsigned char *key, size_t phase, size_t width) {
+    for (size_t i = 0; i < width; ++i)
+        spread[i] = key[(phase + i) & 3];
+}
+
+static bool alwaysSupported() {
+    return true;
+}
+
+static size_t scalarBreaks(const char *data, size_t len, size_t *positions, size_t max) {
+    return breaksFrom(data, 0, len, positions, 0, max);
+}
+
+static bool scalarUtf8(const char *data, size_t len) {
+    return utf8Until(reinterpret_cast<const unsigned char *>(data), 0, len, len) == len;
+}
+
+static void scalarUnmask(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase) {
+    unmaskFrom(dst, src, 0, len, key, phase);
+}
+
+#ifdef TEXTSCAN_X86
+
+/*
+** One compare per character class and block; the movemask bits are walked
+** lowest first, so the offsets come out in order.
+*/
+__attribute__((target("sse2")))
+static size_t sse2Breaks(const char *data, size_t len, size_t *positions, size_t max) {
+    const __m128i cr = _mm_set1_epi8('\r');
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i nul = _mm_setzero_si128();
+    size_t found = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(block, cr), _mm_cmpeq_epi8(block, lf)),
+            _mm_cmpeq_epi8(block, nul));
+        unsigned int mask = _mm_movemask_epi8(hits);
+        while (mask) {
+            if (found == max)
+                return found;
+            positions[found++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    return breaksFrom(data, i, len, positions, found, max);
+}
+
+/*
+** Blocks without a byte >= 0x80 are skipped whole; a block that has one is
+** validated sequence by sequence, and the next block starts where the last
+** sequence ended.
+*/
+__attribute__((target("sse2")))
+static bool sse2Utf8(const char *data, size_t len) {
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+
+    while (i + 16 <= len) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+        if (!_mm_movemask_epi8(block)) {
+            i += 16;
+            continue;
+        }
+        i = utf8Until(s, i, i + 16, len);
+        if (i > len)
+            return false;
+    }
+    return utf8Until(s, i, len, len) == len;
+}
+
+__attribute__((target("avx2")))
+static size_t avx2Breaks(const char *data, size_t len, size_t *positions, size_t max) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i nul = _mm256_setzero_si256();
+    size_t found = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        __m256i hits = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(block, cr),
+            _mm256_cmpeq_epi8(block, lf)), _mm256_cmpeq_epi8(block, nul));
+        unsigned int mask = _mm256_movemask_epi8(hits);
+        while (mask) {
+            if (found == max)
+                return found;
+            positions[found++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+    return breaksFrom(data, i, len, positions, found, max);
+}
+
+__attribute__((target("avx2")))
+static bool avx2Utf8(const char *data, size_t len) {
+    const unsigned char *s = reinterpret_cast<const unsigned char *>(data);
+    size_t i = 0;
+
+    while (i + 32 <= len) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+        if (!_mm256_movemask_epi8(block)) {
+            i += 32;
+            continue;
+        }
+        i = utf8Until(s, i, i + 32, len);
+        if (i > len)
+            return false;
+    }
+    return utf8Until(s, i, len, len) == len;
+}
+
+/*
+** Every block is loaded before it is stored, so dst may be src.
+*/
+__attribute__((target("sse2")))
+static void sse2Unmask(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase) {
+    unsigned char spread[16];
+    size_t i = 0;
+
+    spreadKey(spread, key, phase, sizeof(spread));
+    const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i *>(spread));
+    for (; i + 16 <= len; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_xor_si128(block, mask));
+    }
+    unmaskFrom(dst, src, i, len, key, phase);
+}
+
+__attribute__((target("avx2")))
+static void avx2Unmask(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase) {
+    unsigned char spread[32];
+    size_t i = 0;
+
+    spreadKey(spread, key, phase, sizeof(spread));
+    const __m256i mask = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(spread));
+    for (; i + 32 <= len; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), _mm256_xor_si256(block, mask));
+    }
+    unmaskFrom(dst, src, i, len, key, phase);
+}
+
+static bool sse2Supported() {
+    return __builtin_cpu_supports("sse2");
+}
+
+static bool avx2Supported() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#endif
+
+/*
+** Widest first; detect() takes the first one the CPU supports.
+*/
+const TextScan::Impl TextScan::impls[] = {
+#ifdef TEXTSCAN_X86
+    {"avx2", avx2Breaks, avx2Utf8, avx2Unmask, avx2Supported},
+    {"sse2", sse2Breaks, sse2Utf8, sse2Unmask, sse2Supported},
+#endif
+    {"scalar", scalarBreaks, scalarUtf8, scalarUnmask, alwaysSupported}
+};
+
+const TextScan::Impl *TextScan::current = TextScan::detect();
+
+const TextScan::Impl *TextScan::detect() {
+#ifdef TEXTSCAN_X86
+    __builtin_cpu_init();
+#endif
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        if (impls[i].supported())
+            return &impls[i];
+    }
+    return &impls[sizeof(impls) / sizeof(impls[0]) - 1];
+}
+
+size_t TextScan::findBreaks(const char *data, size_t len, size_t *positions, size_t max) {
+    return current->findBreaks(data, len, positions, max);
+}
+
+bool TextScan::isUtf8(const char *data, size_t len) {
+    return current->isUtf8(data, len);
+}
+
+void TextScan::unmask(char *dst, const char *src, size_t len, const unsigned char *key, size_t phase) {
+    current->unmask(dst, src, len, key, phase);
+}
+
+const char *TextScan::getName() {
+    return current->name;
+}
+
+bool TextScan::select(const std::string &name) {
+    for (size_t i = 0; i < sizeof(impls) / sizeof(impls[0]); ++i) {
+        if (name == impls[i].name && impls[i].supported()) {
+            current = &impls[i];
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,245 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   TlsTransport.cpp                                   :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/10 09:21:44 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/10 09:21:44 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/TlsTransport.hpp"
+#include <openssl/err.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+
+static std::string sslError(const std::string &what) {
+    char reason[256];
+
+    ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+    ERR_clear_error();
+    return "Error: " + what + ": " + reason;
+}
+
+/*
+** OpenSSL writes with write(2), which has no MSG_NOSIGNAL, so SIGPIPE is
+** ignored for the whole process. Buffers of idle connections are given
+** back (SSL_MODE_RELEASE_BUFFERS), which keeps a quiet TLS client about as
+** cheap as a plain one.
+*/
+TlsTransport::TlsTransport(Transport *inner, const std::string &certificate, const std::string &key)
+    : inner(inner), context(SSL_CTX_new(TLS_server_method())), name(std::string("tls+") + inner->getName()) {
+    memset(&stats, 0, sizeof(stats));
+    if (!context)
+        throw std::runtime_error(sslError("cannot create TLS context"));
+    SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+    SSL_CTX_set_options(context, SSL_OP_ENABLE_KTLS | SSL_OP_IGNORE_UNEXPECTED_EOF | SSL_OP_NO_RENEGOTIATION);
+    SSL_CTX_set_mode(context, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER
+        | SSL_MODE_RELEASE_BUFFERS);
+    SSL_CTX_set_session_cache_mode(context, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(context, TLS_SESSION_CACHE);
+    SSL_CTX_set_session_id_context(context, reinterpret_cast<const unsigned char *>("ircserv"), 7);
+    SSL_CTX_set_num_tickets(context, 1);
+    if (SSL_CTX_use_certificate_chain_file(context, certificate.c_str()) != 1
+        || SSL_CTX_use_PrivateKey_file(context, key.c_str(), SSL_FILETYPE_PEM) != 1
+        || SSL_CTX_check_private_key(context) != 1) {
+        std::string error = sslError("cannot load " + certificate + " and " + key);
+        SSL_CTX_free(context);
+        throw std::runtime_error(error);
+    }
+    signal(SIGPIPE, SIG_IGN);
+}
+
+TlsTransport::~TlsTransport() {
+    for (std::map<int, TlsSession>::iterator it = sessions.begin(); it != sessions.end(); ++it)
+        SSL_free(it->second.ssl);
+    SSL_CTX_free(context);
+    delete inner;
+}
+
+const char *TlsTransport::getName() const { return name.c_str(); }
+
+/*
+** Starts the server side of a handshake on an accepted socket; the client
+** speaks first, so nothing happens until it is readable.
+*/
+bool TlsTransport::accept(int fd) {
+    TlsSession session;
+
+    session.ssl = SSL_new(context);
+    if (!session.ssl || SSL_set_fd(session.ssl, fd) != 1) {
+        SSL_free(session.ssl);
+        ERR_clear_error();
+        return false;
+    }
+    SSL_set_accept_state(session.ssl);
+    session.established = false;
+    session.broken = false;
+    session.ktls = false;
+    session.retry = 0;
+    sessions[fd] = session;
+    return true;
+}
+
+/*
+** Maps an SSL call's outcome onto the receive()/send() convention: -EAGAIN
+** while the socket is not ready either way, 0 on a clean close, -ECONNRESET
+** for anything else, after which the session is not shut down politely.
+*/
+ssize_t TlsTransport::result(TlsSession &session, int ret) {
+    int error = SSL_get_error(session.ssl, ret);
+
+    if (error == SSL_ERROR_WANT_READ || error == SSL_ERROR_WANT_WRITE)
+        return -EAGAIN;
+    session.broken = true;
+    ERR_clear_error();
+    return error == SSL_ERROR_ZERO_RETURN ? 0 : -ECONNRESET;
+}
+
+/*
+** Returns 1 once the handshake is complete, otherwise what result() made of
+** the attempt.
+*/
+ssize_t TlsTransport::handshake(TlsSession &session) {
+    int ret = SSL_do_handshake(session.ssl);
+
+    if (ret != 1) {
+        ssize_t status = result(session, ret);
+        if (status != -EAGAIN)
+            stats.failed++;
+        return status;
+    }
+    session.established = true;
+    stats.handshakes++;
+    if (SSL_session_reused(session.ssl))
+        stats.resumed++;
+    if (BIO_get_ktls_send(SSL_get_wbio(session.ssl))) {
+        session.ktls = true;
+        stats.ktls++;
+    }
+    return 1;
+}
+
+ssize_t TlsTransport::receive(int fd, char *buffer, size_t len) {
+    std::map<int, TlsSession>::iterator it = sessions.find(fd);
+    if (it == sessions.end())
+        return inner->receive(fd, buffer, len);
+    TlsSession &session = it->second;
+    if (session.broken)
+        return -ECONNRESET;
+    if (!session.established) {
+        ssize_t status = handshake(session);
+        if (status <= 0)
+            return status;
+    }
+    int n = SSL_read(session.ssl, buffer, len);
+    return n > 0 ? n : result(session, n);
+}
+
+/*
+** Up to one record of the queued lines is gathered and encrypted; a short
+** count makes the client keep the rest queued, as after a short sendmsg().
+*/
+ssize_t TlsTransport::send(int fd, const struct iovec *iov, size_t count) {
+    std::map<int, TlsSession>::iterator it = sessions.find(fd);
+    if (it == sessions.end())
+        return inner->send(fd, iov, count);
+    TlsSession &session = it->second;
+    if (session.broken)
+        return -EPIPE;
+    if (!session.established) {
+        ssize_t status = handshake(session);
+        if (status <= 0)
+            return status == 0 ? -EPIPE : status;
+    }
+    if (session.ktls)
+        return inner->send(fd, iov, count);
+    char record[TLS_RECORD];
+    size_t limit = session.retry ? session.retry : sizeof(record);
+    size_t len = 0;
+    for (size_t i = 0; i < count && len < limit; ++i) {
+        size_t n = std::min(iov[i].iov_len, limit - len);
+        memcpy(record + len, iov[i].iov_base, n);
+        len += n;
+    }
+    if (len == 0)
+        return 0;
+    int n = SSL_write(session.ssl, record, len);
+    if (n > 0) {
+        session.retry = 0;
+        return n;
+    }
+    ssize_t status = result(session, n);
+    if (status == -EAGAIN)
+        session.retry = len;
+    return status == 0 ? -EPIPE : status;
+}
+
+/*
+** close_notify is only attempted on a healthy session and never waited for.
+*/
+void TlsTransport::release(int fd) {
+    std::map<int, TlsSession>::iterator it = sessions.find(fd);
+    if (it != sessions.end()) {
+        if (it->second.established && !it->second.broken)
+            SSL_shutdown(it->second.ssl);
+        SSL_free(it->second.ssl);
+        ERR_clear_error();
+        sessions.erase(it);
+    }
+    inner->release(fd);
+}
+
+bool TlsTransport::peerName(int fd, struct sockaddr *addr, socklen_t *len) {
+    return inner->peerName(fd, addr, len);
+}
+
+int TlsTransport::openListener() {
+    return inner->openListener();
+}
+
+EventLoop *TlsTransport::createLoop() {
+    return inner->createLoop();
+}
+
+/*
+** The loop's own receive would hand over ciphertext.
+*/
+bool TlsTransport::readsDirect(int fd) {
+    return sessions.find(fd) == sessions.end() && inner->readsDirect(fd);
+}
+
+size_t TlsTransport::pending(int fd) {
+    std::map<int, TlsSession>::iterator it = sessions.find(fd);
+    if (it == sessions.end())
+        return inner->pending(fd);
+    return it->second.broken ? 0 : SSL_pending(it->second.ssl);
+}
+
+/*
+** Plain and kTLS connections keep the event loop's batched send; only the
+** connections encrypted here are taken out of the batch.
+*/
+void TlsTransport::sendBatch(EventLoop &loop, std::vector<SendRequest> &batch) {
+    std::vector<size_t> encrypted;
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        std::map<int, TlsSession>::iterator it = sessions.find(batch[i].fd);
+        if (it != sessions.end() && !it->second.ktls)
+            encrypted.push_back(i);
+    }
+    splitBatch(*inner, loop, batch, encrypted);
+}
+
+const TlsStats &TlsTransport::getStats() const { return stats; }
+
+size_t TlsTransport::getSessionCount() const { return sessions.size(); }
+
+size_t TlsTransport::getCachedSessions() const {
+    return SSL_CTX_sess_number(context);
+}
@@ -0,0 +1,107 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Trace.cpp                                          :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/04 09:51:41 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/04 09:51:41 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Trace.hpp"
+#include <fstream>
+#include <cstdio>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+std::vector<Trace::Ring *> Trace::rings;
+__thread Trace::Ring *Trace::local = NULL;
+bool Trace::enabled = false;
+
+/*
+** Nanoseconds on the monotonic clock.
+*/
+long long Trace::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+Trace::Ring *Trace::threadRing() {
+    if (!local) {
+        local = new Ring;
+        local->records.resize(TRACE_RING);
+        local->next = 0;
+        local->count = 0;
+        local->tid = syscall(SYS_gettid);
+        rings.push_back(local);
+    }
+    return local;
+}
+
+/*
+** Turning tracing on starts from empty rings, so a dump only shows spans
+** recorded since.
+*/
+void Trace::enable(bool on) {
+    if (on && !enabled) {
+        for (size_t i = 0; i < rings.size(); ++i) {
+            rings[i]->next = 0;
+            rings[i]->count = 0;
+        }
+    }
+    enabled = on;
+}
+
+void Trace::record(const char *name, long long begin, long long end, const char *argName, long arg) {
+    Ring *ring = threadRing();
+    TraceRecord &slot = ring->records[ring->next];
+
+    slot.name = name;
+    slot.argName = argName;
+    slot.begin = begin;
+    slot.end = end;
+    slot.arg = arg;
+    ring->next = (ring->next + 1) % TRACE_RING;
+    if (ring->count < TRACE_RING)
+        ring->count++;
+}
+
+/*
+** Writes every span that ended in the last `seconds` as a complete ("X")
+** event; timestamps are microseconds with nanosecond decimals. Returns the
+** number of spans written.
+*/
+size_t Trace::dump(const std::string &path, int seconds) {
+    std::ofstream out(path.c_str());
+    long long since = now() - (long long)seconds * 1000000000LL;
+    size_t written = 0;
+    char buffer[64];
+
+    if (!out)
+        return 0;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t r = 0; r < rings.size(); ++r) {
+        const Ring *ring = rings[r];
+        size_t first = (ring->next + TRACE_RING - ring->count) % TRACE_RING;
+        for (size_t i = 0; i < ring->count; ++i) {
+            const TraceRecord &span = ring->records[(first + i) % TRACE_RING];
+            if (span.end < since)
+                continue;
+            out << (written++ ? ",\n" : "\n") << "{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":"
+                << getpid() << ",\"tid\":" << ring->tid;
+            snprintf(buffer, sizeof(buffer), "%lld.%03lld", span.begin / 1000, span.begin % 1000);
+            out << ",\"ts\":" << buffer;
+            snprintf(buffer, sizeof(buffer), "%lld.%03lld", (span.end - span.begin) / 1000, (span.end - span.begin) % 1000);
+            out << ",\"dur\":" << buffer;
+            if (span.argName)
+                out << ",\"args\":{\"" << span.argName << "\":" << span.arg << "}";
+            out << "}";
+        }
+    }
+    out << "\n]}\n";
+    return out ? written : 0;
+}
@@ -0,0 +1,281 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   Transport.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/08 09:14:11 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/08 09:14:11 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/Transport.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+#include <sys/un.h>
+
+Transport::~Transport() {}
+
+bool Transport::peerName(int fd, struct sockaddr *addr, socklen_t *len) {
+    (void)fd;
+    (void)addr;
+    (void)len;
+    return false;
+}
+
+int Transport::openListener() {
+    return -1;
+}
+
+EventLoop *Transport::createLoop() {
+    return NULL;
+}
+
+bool Transport::readsDirect(int fd) {
+    (void)fd;
+    return true;
+}
+
+size_t Transport::pending(int fd) {
+    (void)fd;
+    return 0;
+}
+
+void Transport::sendBatch(EventLoop &loop, std::vector<SendRequest> &batch) {
+    loop.sendBatch(batch);
+}
+
+/*
+** For a transport layered on inner: the requests at the indices in own
+** (ascending) are written with this transport's send(), the others go down
+** to inner as one batch.
+*/
+void Transport::splitBatch(Transport &inner, EventLoop &loop, std::vector<SendRequest> &batch,
+    const std::vector<size_t> &own) {
+    if (own.empty()) {
+        inner.sendBatch(loop, batch);
+        return;
+    }
+    std::vector<SendRequest> direct;
+    std::vector<size_t> index;
+    for (size_t i = 0, next = 0; i < batch.size(); ++i) {
+        if (next < own.size() && own[next] == i) {
+            batch[i].result = send(batch[i].fd, batch[i].iov, batch[i].count);
+            next++;
+        } else {
+            direct.push_back(batch[i]);
+            index.push_back(i);
+        }
+    }
+    if (direct.empty())
+        return;
+    inner.sendBatch(loop, direct);
+    for (size_t i = 0; i < direct.size(); ++i)
+        batch[index[i]].result = direct[i].result;
+}
+
+const char *SocketTransport::getName() const { return "socket"; }
+
+ssize_t SocketTransport::receive(int fd, char *buffer, size_t len) {
+    ssize_t n = recv(fd, buffer, len, MSG_DONTWAIT);
+    return n < 0 ? -errno : n;
+}
+
+ssize_t SocketTransport::send(int fd, const struct iovec *iov, size_t count) {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = const_cast<struct iovec *>(iov);
+    msg.msg_iovlen = count;
+    ssize_t n = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+    return n < 0 ? -errno : n;
+}
+
+void SocketTransport::release(int fd) {
+    close(fd);
+}
+
+bool SocketTransport::peerName(int fd, struct sockaddr *addr, socklen_t *len) {
+    return getpeername(fd, addr, len) == 0;
+}
+
+MemoryTransport::MemoryTransport() : listenerFd(-1), nextFd(MEMORY_FD_BASE), sent(0), received(0) {}
+
+const char *MemoryTransport::getName() const { return "memory"; }
+
+/*
+** An endpoint the driver hung up on reads as EOF once drained; one that
+** does not exist reads as a reset connection.
+*/
+ssize_t MemoryTransport::receive(int fd, char *buffer, size_t len) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (it == endpoints.end() || it->second.released)
+        return -ECONNRESET;
+    std::string &in = it->second.toServer;
+    if (in.empty())
+        return it->second.hungUp ? 0 : -EAGAIN;
+    size_t n = std::min(len, in.size());
+    memcpy(buffer, in.data(), n);
+    in.erase(0, n);
+    received += n;
+    return n;
+}
+
+/*
+** Never short: the driver's side has no window, it only grows until read.
+*/
+ssize_t MemoryTransport::send(int fd, const struct iovec *iov, size_t count) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (it == endpoints.end() || it->second.released || it->second.hungUp)
+        return -EPIPE;
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        it->second.fromServer.append(static_cast<const char *>(iov[i].iov_base), iov[i].iov_len);
+        total += iov[i].iov_len;
+    }
+    sent += total;
+    return total;
+}
+
+/*
+** The endpoint stays around until the driver has read what was sent before
+** the server let go of it.
+*/
+void MemoryTransport::release(int fd) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (fd == listenerFd)
+        listenerFd = -1;
+    else if (it != endpoints.end()) {
+        it->second.released = true;
+        it->second.toServer.clear();
+        if (it->second.fromServer.empty())
+            endpoints.erase(it);
+    }
+}
+
+bool MemoryTransport::peerName(int fd, struct sockaddr *addr, socklen_t *len) {
+    struct sockaddr_un local;
+
+    if (endpoints.find(fd) == endpoints.end() || *len < sizeof(local.sun_family))
+        return false;
+    memset(&local, 0, sizeof(local));
+    local.sun_family = AF_UNIX;
+    memcpy(addr, &local, std::min(static_cast<size_t>(*len), sizeof(local)));
+    *len = sizeof(local);
+    return true;
+}
+
+int MemoryTransport::openListener() {
+    if (listenerFd < 0)
+        listenerFd = nextFd++;
+    return listenerFd;
+}
+
+EventLoop *MemoryTransport::createLoop() {
+    return new MemoryLoop(*this);
+}
+
+int MemoryTransport::connect() {
+    int fd = nextFd++;
+    MemoryEndpoint &endpoint = endpoints[fd];
+
+    endpoint.hungUp = false;
+    endpoint.released = false;
+    accepts.push_back(fd);
+    return fd;
+}
+
+void MemoryTransport::write(int fd, const std::string &data) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (it != endpoints.end() && !it->second.released && !it->second.hungUp)
+        it->second.toServer += data;
+}
+
+/*
+** Appends what the server sent since the last read to data and returns
+** its length. A released endpoint is forgotten once it has been drained.
+*/
+size_t MemoryTransport::read(int fd, std::string &data) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (it == endpoints.end())
+        return 0;
+    size_t n = it->second.fromServer.size();
+    data += it->second.fromServer;
+    it->second.fromServer.clear();
+    if (it->second.released)
+        endpoints.erase(it);
+    return n;
+}
+
+void MemoryTransport::hangup(int fd) {
+    std::map<int, MemoryEndpoint>::iterator it = endpoints.find(fd);
+    if (it != endpoints.end())
+        it->second.hungUp = true;
+}
+
+bool MemoryTransport::isReleased(int fd) const {
+    std::map<int, MemoryEndpoint>::const_iterator it = endpoints.find(fd);
+    return it == endpoints.end() || it->second.released;
+}
+
+size_t MemoryTransport::getBytesSent() const { return sent; }
+
+size_t MemoryTransport::getBytesReceived() const { return received; }
+
+/*
+** Pending connections are handed out only while the listener is polled,
+** so pausing accept works as it does on a socket.
+*/
+void MemoryTransport::collect(const std::map<int, short> &interest, std::vector<IoEvent> &events) {
+    IoEvent event;
+
+    std::map<int, short>::const_iterator listening = interest.find(listenerFd);
+    while (!accepts.empty() && listening != interest.end() && (listening->second & POLLIN)) {
+        event.type = IO_ACCEPT;
+        event.fd = listenerFd;
+        event.revents = 0;
+        event.result = accepts.front();
+        event.data = NULL;
+        accepts.pop_front();
+        events.push_back(event);
+    }
+    for (std::map<int, short>::const_iterator it = interest.begin(); it != interest.end(); ++it) {
+        std::map<int, MemoryEndpoint>::const_iterator endpoint = endpoints.find(it->first);
+        if (!(it->second & POLLIN) || endpoint == endpoints.end() || endpoint->second.released)
+            continue;
+        if (endpoint->second.toServer.empty() && !endpoint->second.hungUp)
+            continue;
+        event.type = IO_READY;
+        event.fd = it->first;
+        event.revents = POLLIN;
+        event.result = 0;
+        event.data = NULL;
+        events.push_back(event);
+    }
+}
+
+MemoryLoop::MemoryLoop(MemoryTransport &transport) : transport(transport) {}
+
+const char *MemoryLoop::getName() const { return "memory"; }
+
+void MemoryLoop::setEvents(int fd, short events) {
+    interest[fd] = events;
+}
+
+void MemoryLoop::remove(int fd) {
+    interest.erase(fd);
+}
+
+int MemoryLoop::wait(std::vector<IoEvent> &events, int timeout) {
+    (void)timeout;
+    events.clear();
+    transport.collect(interest, events);
+    return events.size();
+}
+
+void MemoryLoop::sendBatch(std::vector<SendRequest> &batch) {
+    for (size_t i = 0; i < batch.size(); ++i)
+        batch[i].result = transport.send(batch[i].fd, batch[i].iov, batch[i].count);
+}
@@ -0,0 +1,389 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   UringLoop.cpp                                      :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/03/26 11:02:37 by rtorres           #+#    #+#             */
+/*   Updated: 2025/03/26 11:02:37 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/UringLoop.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <stdexcept>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <unistd.h>
+
+UringLoop::UringLoop()
+    : ringFd(-1), sqRing(MAP_FAILED), cqRing(MAP_FAILED), sqes(NULL), sqLocalTail(0),
+      bufRing(NULL), buffers(NULL), bufTail(0) {
+    struct io_uring_params params;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4;
+    ringFd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ringFd < 0)
+        throw std::runtime_error("Error: io_uring_setup failed");
+    unsigned required = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if ((params.features & required) != required) {
+        close(ringFd);
+        throw std::runtime_error("Error: io_uring lacks required features");
+    }
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (cqRingSize > sqRingSize)
+        sqRingSize = cqRingSize;
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqeMap = sqRing == MAP_FAILED ? MAP_FAILED
+        : mmap(NULL, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqRing == MAP_FAILED || sqeMap == MAP_FAILED) {
+        if (sqRing != MAP_FAILED)
+            munmap(sqRing, sqRingSize);
+        close(ringFd);
+        throw std::runtime_error("Error: io_uring mmap failed");
+    }
+    cqRing = sqRing;
+    sqes = static_cast<struct io_uring_sqe *>(sqeMap);
+    char *sq = static_cast<char *>(sqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    sqEntries = params.sq_entries;
+    sqLocalTail = *sqTail;
+    cqHead = reinterpret_cast<unsigned *>(sq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(sq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(sq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe *>(sq + params.cq_off.cqes);
+
+    bufRingSize = URING_BUFFERS * sizeof(struct io_uring_buf);
+    void *ring = mmap(NULL, bufRingSize, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<unsigned long>(ring);
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = 0;
+    if (ring == MAP_FAILED || syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        if (ring != MAP_FAILED)
+            munmap(ring, bufRingSize);
+        munmap(sqes, sqesSize);
+        munmap(sqRing, sqRingSize);
+        close(ringFd);
+        throw std::runtime_error("Error: io_uring provided buffer ring unavailable");
+    }
+    bufRing = static_cast<struct io_uring_buf_ring *>(ring);
+    buffers = new char[URING_BUFFERS * URING_BUFFER_SIZE];
+    for (unsigned short id = 0; id < URING_BUFFERS; ++id)
+        delivered.push_back(id);
+    recycleBuffers();
+}
+
+UringLoop::~UringLoop() {
+    munmap(bufRing, bufRingSize);
+    delete[] buffers;
+    munmap(sqes, sqesSize);
+    munmap(sqRing, sqRingSize);
+    close(ringFd);
+}
+
+const char *UringLoop::getName() const { return "io_uring"; }
+
+unsigned long long UringLoop::userData(int op, int fd, unsigned int generation) {
+    return ((unsigned long long)generation << 32) | ((unsigned long long)(unsigned)fd << 8) | op;
+}
+
+UringLoop::Watch &UringLoop::watch(int fd) {
+    if ((size_t)fd >= watches.size()) {
+        Watch blank;
+        memset(&blank, 0, sizeof(blank));
+        watches.resize(fd + 1, blank);
+    }
+    return watches[fd];
+}
+
+void UringLoop::markDirty(int fd) {
+    Watch &w = watch(fd);
+    if (!w.dirty) {
+        w.dirty = true;
+        dirty.push_back(fd);
+    }
+}
+
+/*
+** Returns the next free submission slot, submitting what is queued first
+** when the ring is full.
+*/
+struct io_uring_sqe *UringLoop::getSqe() {
+    if (sqLocalTail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries)
+        enter(0, 0);
+    unsigned index = sqLocalTail & *sqMask;
+    struct io_uring_sqe *sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[index] = index;
+    sqLocalTail++;
+    return sqe;
+}
+
+/*
+** Publishes the queued submissions and, when minComplete is set, waits up
+** to timeout milliseconds (forever when negative) for completions.
+*/
+int UringLoop::enter(unsigned minComplete, int timeout) {
+    unsigned submit = sqLocalTail - *sqTail;
+    __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+    if (!submit && !minComplete)
+        return 0;
+    unsigned flags = minComplete ? IORING_ENTER_GETEVENTS : 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    void *argp = NULL;
+    size_t argsz = 0;
+    if (minComplete && timeout >= 0) {
+        ts.tv_sec = timeout / 1000;
+        ts.tv_nsec = (timeout % 1000) * 1000000L;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<unsigned long>(&ts);
+        argp = &arg;
+        argsz = sizeof(arg);
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+    int ret = syscall(__NR_io_uring_enter, ringFd, submit, minComplete, flags, argp, argsz);
+    if (ret < 0 && (errno == ETIME || errno == EINTR || errno == EAGAIN || errno == EBUSY))
+        return 0;
+    return ret;
+}
+
+void UringLoop::cancel(unsigned long long target) {
+    struct io_uring_sqe *sqe = getSqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = target;
+    sqe->user_data = userData(OP_CANCEL, 0, 0);
+}
+
+/*
+** Brings the operations outstanding on fd in line with what is wanted:
+** starts the multishot accept or recv, cancels a recv that is no longer
+** wanted (a full receive queue), and keeps one poll for the rest.
+*/
+void UringLoop::arm(int fd) {
+    Watch &w = watch(fd);
+    w.dirty = false;
+    if (!w.active)
+        return;
+    short pollMask = w.wanted;
+    if (w.accept || w.receive) {
+        pollMask &= ~POLLIN;
+        bool wantIn = w.wanted & POLLIN;
+        if (wantIn && !w.multishotArmed) {
+            struct io_uring_sqe *sqe = getSqe();
+            sqe->fd = fd;
+            if (w.accept) {
+                sqe->opcode = IORING_OP_ACCEPT;
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+                sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+                sqe->user_data = userData(OP_ACCEPT, fd, w.generation);
+            } else {
+                sqe->opcode = IORING_OP_RECV;
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+                sqe->flags = IOSQE_BUFFER_SELECT;
+                sqe->buf_group = 0;
+                sqe->user_data = userData(OP_RECV, fd, w.generation);
+            }
+            w.multishotArmed = true;
+        } else if (!wantIn && w.multishotArmed && !w.multishotCancelled) {
+            cancel(userData(w.accept ? OP_ACCEPT : OP_RECV, fd, w.generation));
+            w.multishotCancelled = true;
+        }
+    }
+    if (w.polled && (pollMask & ~w.polled) && !w.pollCancelled) {
+        cancel(userData(OP_POLL, fd, w.generation));
+        w.pollCancelled = true;
+    } else if (!w.polled && pollMask) {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_POLL_ADD;
+        sqe->fd = fd;
+        sqe->poll32_events = pollMask;
+        sqe->user_data = userData(OP_POLL, fd, w.generation);
+        w.polled = pollMask;
+    }
+}
+
+void UringLoop::setEvents(int fd, short events) {
+    Watch &w = watch(fd);
+    if (w.active && w.wanted == events)
+        return;
+    w.active = true;
+    w.wanted = events;
+    markDirty(fd);
+}
+
+/*
+** Called after the fd has been closed. Outstanding operations still hold
+** the socket open, so they are cancelled; their late completions carry the
+** old generation and are dropped.
+*/
+void UringLoop::remove(int fd) {
+    if ((size_t)fd >= watches.size() || !watches[fd].active)
+        return;
+    Watch &w = watches[fd];
+    if (w.polled)
+        cancel(userData(OP_POLL, fd, w.generation));
+    if (w.multishotArmed)
+        cancel(userData(w.accept ? OP_ACCEPT : OP_RECV, fd, w.generation));
+    unsigned int generation = w.generation + 1;
+    bool queued = w.dirty;
+    memset(&w, 0, sizeof(w));
+    w.generation = generation;
+    w.dirty = queued;
+}
+
+bool UringLoop::acceptMultishot(int fd) {
+    watch(fd).accept = true;
+    markDirty(fd);
+    return true;
+}
+
+bool UringLoop::recvMultishot(int fd) {
+    watch(fd).receive = true;
+    markDirty(fd);
+    return true;
+}
+
+/*
+** Gives the buffers delivered by the previous wait() back to the kernel.
+*/
+void UringLoop::recycleBuffers() {
+    if (delivered.empty())
+        return;
+    struct io_uring_buf *bufs = reinterpret_cast<struct io_uring_buf *>(bufRing);
+    for (size_t i = 0; i < delivered.size(); ++i) {
+        struct io_uring_buf *buf = &bufs[bufTail & (URING_BUFFERS - 1)];
+        buf->addr = reinterpret_cast<unsigned long>(buffers + (size_t)delivered[i] * URING_BUFFER_SIZE);
+        buf->len = URING_BUFFER_SIZE;
+        buf->bid = delivered[i];
+        bufTail++;
+    }
+    __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+    delivered.clear();
+}
+
+void UringLoop::handleCqe(const struct io_uring_cqe &cqe, std::vector<IoEvent> &events) {
+    int op = cqe.user_data & 0xff;
+    int fd = (cqe.user_data >> 8) & 0xffffff;
+    unsigned int generation = cqe.user_data >> 32;
+    bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+        delivered.push_back(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+    if (op == OP_CANCEL || op == OP_SEND || (size_t)fd >= watches.size())
+        return;
+    Watch &w = watches[fd];
+    if (!w.active || w.generation != generation)
+        return;
+    IoEvent event;
+    event.fd = fd;
+    event.revents = 0;
+    event.result = cqe.res;
+    event.data = NULL;
+    if (op == OP_POLL) {
+        w.polled = 0;
+        w.pollCancelled = false;
+        markDirty(fd);
+        if (cqe.res < 0)
+            return;
+        event.type = IO_READY;
+        event.revents = cqe.res & (w.wanted | POLLERR | POLLHUP);
+        if (event.revents)
+            events.push_back(event);
+        return;
+    }
+    if (!more) {
+        w.multishotArmed = false;
+        w.multishotCancelled = false;
+        markDirty(fd);
+    }
+    if (cqe.res == -ECANCELED || cqe.res == -ENOBUFS)
+        return;
+    if (op == OP_ACCEPT)
+        event.type = IO_ACCEPT;
+    else {
+        event.type = IO_RECV;
+        if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+            event.data = buffers + (size_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT) * URING_BUFFER_SIZE;
+        if (cqe.res <= 0)
+            w.wanted &= ~POLLIN;
+    }
+    events.push_back(event);
+}
+
+int UringLoop::wait(std::vector<IoEvent> &events, int timeout) {
+    events.clear();
+    recycleBuffers();
+    for (size_t i = 0; i < dirty.size(); ++i)
+        arm(dirty[i]);
+    dirty.clear();
+    for (size_t i = 0; i < deferred.size(); ++i)
+        handleCqe(deferred[i], events);
+    deferred.clear();
+    unsigned head = *cqHead;
+    if (events.empty() && head == __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) && timeout != 0) {
+        if (enter(1, timeout) < 0)
+            return -1;
+    } else if (enter(0, 0) < 0)
+        return -1;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head)
+        handleCqe(cqes[head & *cqMask], events);
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    return events.size();
+}
+
+/*
+** Queues one SENDMSG per request and submits them with a single
+** io_uring_enter(). MSG_DONTWAIT makes every send complete inline, so the
+** same call returns all results; completions of other operations reaped
+** meanwhile are kept for the next wait().
+*/
+void UringLoop::sendBatch(std::vector<SendRequest> &batch) {
+    std::vector<struct msghdr> msgs(batch.size());
+    size_t pending = 0;
+
+    for (size_t i = 0; i < batch.size(); ++i) {
+        memset(&msgs[i], 0, sizeof(msgs[i]));
+        msgs[i].msg_iov = batch[i].iov;
+        msgs[i].msg_iovlen = batch[i].count;
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = batch[i].fd;
+        sqe->addr = reinterpret_cast<unsigned long>(&msgs[i]);
+        sqe->len = 1;
+        sqe->msg_flags = MSG_DONTWAIT | MSG_NOSIGNAL;
+        sqe->user_data = userData(OP_SEND, i, 0);
+        batch[i].result = -EAGAIN;
+        pending++;
+    }
+    while (pending > 0) {
+        if (enter(pending, -1) < 0)
+            break;
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe &cqe = cqes[head & *cqMask];
+            if ((cqe.user_data & 0xff) == OP_SEND) {
+                batch[(cqe.user_data >> 8) & 0xffffff].result = cqe.res;
+                pending--;
+            } else
+                deferred.push_back(cqe);
+        }
+        __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+    }
+}
@@ -0,0 +1,459 @@
+/* ************************************************************************** */
+/*                                                                            */
+/*                                                        :::      ::::::::   */
+/*   WebSocketTransport.cpp                             :+:      :+:    :+:   */
+/*                                                    +:+ +:+         +:+     */
+/*   By: rtorres <rtorres@student.42.fr>            +#+  +:+       +#+        */
+/*                                                +#+#+#+#+#+   +#+           */
+/*   Created: 2025/04/11 09:44:17 by rtorres           #+#    #+#             */
+/*   Updated: 2025/04/11 09:44:17 by rtorres          ###   ########.fr       */
+/*                                                                            */
+/* ************************************************************************** */
+
+#include "../inc/WebSocketTransport.hpp"
+#include "../inc/TextScan.hpp"
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <strings.h>
+
+#define WS_CONTINUATION 0x0
+#define WS_TEXT 0x1
+#define WS_BINARY 0x2
+#define WS_CLOSE 0x8
+#define WS_PING 0x9
+#define WS_PONG 0xA
+
+/*
+** Value of the first "name:" header line of an HTTP request, trimmed.
+*/
+static std::string headerValue(const std::string &request, const char *name) {
+    size_t length = strlen(name);
+    std::string::size_type line = request.find("\r\n");
+
+    while (line != std::string::npos && line + 2 < request.size()) {
+        line += 2;
+        std::string::size_type end = request.find("\r\n", line);
+        if (end == std::string::npos)
+            end = request.size();
+        if (end - line > length && request[line + length] == ':'
+            && strncasecmp(request.c_str() + line, name, length) == 0) {
+            std::string::size_type start = request.find_first_not_of(" \t", line + length + 1);
+            std::string::size_type last = request.find_last_not_of(" \t", end - 1);
+            return start == std::string::npos || start > last ? "" : request.substr(start, last - start + 1);
+        }
+        line = end;
+    }
+    return "";
+}
+
+/*
+** Whether a comma-separated header value lists token, ignoring case.
+*/
+static bool hasToken(const std::string &value, const char *token) {
+    size_t length = strlen(token);
+    std::string::size_type start = 0;
+
+    while (start < value.size()) {
+        std::string::size_type comma = value.find(',', start);
+        if (comma == std::string::npos)
+            comma = value.size();
+        std::string::size_type first = value.find_first_not_of(" \t", start);
+        std::string::size_type last = value.find_last_not_of(" \t", comma - 1);
+        if (first != std::string::npos && first < comma && last - first + 1 == length
+            && strncasecmp(value.c_str() + first, token, length) == 0)
+            return true;
+        start = comma + 1;
+    }
+    return false;
+}
+
+static std::string acceptKey(const std::string &key) {
+    std::string source = key + WS_GUID;
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    unsigned char encoded[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+
+    SHA1(reinterpret_cast<const unsigned char *>(source.data()), source.size(), digest);
+    EVP_EncodeBlock(encoded, digest, SHA_DIGEST_LENGTH);
+    return reinterpret_cast<char *>(encoded);
+}
+
+WebSocketTransport::WebSocketTransport(Transport *inner)
+    : inner(inner), name(std::string("websocket+") + inner->getName()), upgrades(0) {}
+
+WebSocketTransport::~WebSocketTransport() {
+    delete inner;
+}
+
+const char *WebSocketTransport::getName() const { return name.c_str(); }
+
+void WebSocketTransport::accept(int fd) {
+    WebSocketSession &session = sessions[fd];
+
+    session.open = false;
+    session.binary = false;
+    session.closing = false;
+    session.request.clear();
+    session.headerLen = 0;
+    session.inPayload = false;
+    session.opcode = WS_TEXT;
+    session.fin = true;
+    session.remaining = 0;
+    session.phase = 0;
+    session.controlPayload.clear();
+    session.control.clear();
+    session.partial = 0;
+}
+
+size_t WebSocketTransport::frameHeader(unsigned char *header, unsigned char opcode, size_t len) {
+    header[0] = 0x80 | opcode;
+    if (len < 126) {
+        header[1] = len;
+        return 2;
+    }
+    if (len < 65536) {
+        header[1] = 126;
+        header[2] = len >> 8;
+        header[3] = len & 0xff;
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; ++i)
+        header[2 + i] = (static_cast<unsigned long long>(len) >> (56 - 8 * i)) & 0xff;
+    return 10;
+}
+
+/*
+** Collects the HTTP request and answers it. A request that is not a
+** version 13 WebSocket upgrade gets a 400 and the connection is dropped.
+** Frames the client sent right behind the request are decoded at once.
+*/
+ssize_t WebSocketTransport::upgrade(int fd, WebSocketSession &session, char *buffer, size_t len) {
+    char wire[WS_REQUEST_MAX];
+    ssize_t n = inner->receive(fd, wire, std::min(len - 2, sizeof(wire)));
+
+    if (n <= 0)
+        return n;
+    session.request.append(wire, n);
+    std::string::size_type end = session.request.find("\r\n\r\n");
+    if (end == std::string::npos)
+        return session.request.size() > WS_REQUEST_MAX ? -ECONNRESET : -EAGAIN;
+    std::string leftover = session.request.substr(end + 4);
+    session.request.resize(end + 2);
+    const std::string &request = session.request;
+    std::string key = headerValue(request, "Sec-WebSocket-Key");
+    std::string protocols = headerValue(request, "Sec-WebSocket-Protocol");
+    std::string response;
+    if (request.compare(0, 4, "GET ") != 0 || key.empty() || headerValue(request, "Sec-WebSocket-Version") != "13"
+        || !hasToken(headerValue(request, "Upgrade"), "websocket")
+        || !hasToken(headerValue(request, "Connection"), "upgrade"))
+        response = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+    else {
+        response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+            "Sec-WebSocket-Accept: " + acceptKey(key) + "\r\n";
+        session.binary = hasToken(protocols, "binary.ircv3.net");
+        if (session.binary)
+            response += "Sec-WebSocket-Protocol: binary.ircv3.net\r\n";
+        else if (hasToken(protocols, "text.ircv3.net"))
+            response += "Sec-WebSocket-Protocol: text.ircv3.net\r\n";
+        response += "\r\n";
+        session.open = true;
+    }
+    std::string().swap(session.request);
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(response.data());
+    iov.iov_len = response.size();
+    if (inner->send(fd, &iov, 1) != static_cast<ssize_t>(response.size()) || !session.open)
+        return -ECONNRESET;
+    upgrades++;
+    if (leftover.empty())
+        return -EAGAIN;
+    return decode(session, leftover.data(), leftover.size(), buffer);
+}
+
+/*
+** Bytes of the header being read: two until the length byte is in, then
+** the whole header with its extended length and masking key.
+*/
+size_t WebSocketTransport::headerSize(const WebSocketSession &session) {
+    if (session.headerLen < 2)
+        return 2;
+    size_t len = session.header[1] & 0x7f;
+    return 2 + (len == 126 ? 2 : len == 127 ? 8 : 0) + (session.header[1] & 0x80 ? 4 : 0);
+}
+
+/*
+** Clients must mask, control frames must be short and unfragmented, and
+** data frames are bounded by WS_FRAME_MAX; anything else ends the
+** connection.
+*/
+bool WebSocketTransport::parseHeader(WebSocketSession &session) {
+    const unsigned char *header = session.header;
+    size_t len = header[1] & 0x7f;
+    size_t at = 2;
+
+    if ((header[0] & 0x70) || !(header[1] & 0x80))
+        return false;
+    session.opcode = header[0] & 0x0f;
+    session.fin = header[0] & 0x80;
+    if (len == 126) {
+        len = (header[2] << 8) | header[3];
+        at = 4;
+    } else if (len == 127) {
+        unsigned long long wide = 0;
+        for (int i = 0; i < 8; ++i)
+            wide = (wide << 8) | header[2 + i];
+        len = wide > WS_FRAME_MAX ? WS_FRAME_MAX + 1 : wide;
+        at = 10;
+    }
+    memcpy(session.key, header + at, 4);
+    if (session.opcode & 0x8) {
+        if (!session.fin || len > 125 || session.opcode > WS_PONG)
+            return false;
+    } else if (session.opcode > WS_BINARY || len > WS_FRAME_MAX)
+        return false;
+    session.remaining = len;
+    session.phase = 0;
+    session.headerLen = 0;
+    session.inPayload = true;
+    session.controlPayload.clear();
+    return true;
+}
+
+/*
+** The last frame of a message ends an IRC line. A ping is answered and a
+** close is echoed; both answers wait in control for the next write.
+*/
+void WebSocketTransport::endFrame(WebSocketSession &session, char *buffer, size_t &out) {
+    unsigned char header[2];
+
+    session.inPayload = false;
+    if (!(session.opcode & 0x8)) {
+        if (session.fin) {
+            buffer[out++] = '\r';
+            buffer[out++] = '\n';
+        }
+        return;
+    }
+    if (session.opcode == WS_PONG)
+        return;
+    std::string payload = session.opcode == WS_PING ? session.controlPayload : session.controlPayload.substr(0, 2);
+    unsigned char opcode = session.opcode == WS_PING ? WS_PONG : WS_CLOSE;
+    session.control.append(reinterpret_cast<char *>(header), frameHeader(header, opcode, payload.size()));
+    session.control += payload;
+    if (opcode == WS_CLOSE)
+        session.closing = true;
+}
+
+/*
+** Decodes n bytes off the wire into buffer. Every frame header takes at
+** least six bytes and gives back at most two (the CRLF), so buffer needs
+** room for n + 2 bytes: two more than the wire for a frame whose header
+** came in an earlier read.
+*/
+ssize_t WebSocketTransport::decode(WebSocketSession &session, const char *wire, size_t n, char *buffer) {
+    size_t out = 0;
+    size_t i = 0;
+
+    while (i < n && !session.closing) {
+        if (!session.inPayload) {
+            size_t need = headerSize(session);
+            size_t take = std::min(need - session.headerLen, n - i);
+            memcpy(session.header + session.headerLen, wire + i, take);
+            session.headerLen += take;
+            i += take;
+            if (session.headerLen < headerSize(session))
+                continue;
+            if (!parseHeader(session))
+                return -ECONNRESET;
+            if (session.remaining == 0)
+                endFrame(session, buffer, out);
+            continue;
+        }
+        size_t take = std::min(session.remaining, n - i);
+        if (session.opcode & 0x8) {
+            size_t at = session.controlPayload.size();
+            session.controlPayload.append(wire + i, take);
+            TextScan::unmask(&session.controlPayload[at], &session.controlPayload[at], take, session.key,
+                session.phase);
+        } else {
+            TextScan::unmask(buffer + out, wire + i, take, session.key, session.phase);
+            out += take;
+        }
+        session.phase += take;
+        session.remaining -= take;
+        i += take;
+        if (session.remaining == 0)
+            endFrame(session, buffer, out);
+    }
+    return out;
+}
+
+/*
+** Control frames go out whole before the next data frame, never in the
+** middle of one.
+*/
+ssize_t WebSocketTransport::flushControl(int fd, WebSocketSession &session) {
+    if (session.control.empty() || session.partial)
+        return 0;
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(session.control.data());
+    iov.iov_len = session.control.size();
+    ssize_t n = inner->send(fd, &iov, 1);
+    if (n < 0)
+        return n;
+    session.control.erase(0, n);
+    return session.control.empty() ? 0 : -EAGAIN;
+}
+
+/*
+** Reads at most len - 2 bytes off the wire, see decode(). A read that only
+** completed a header or a control frame has nothing for the parser yet.
+*/
+ssize_t WebSocketTransport::receive(int fd, char *buffer, size_t len) {
+    std::map<int, WebSocketSession>::iterator it = sessions.find(fd);
+    if (it == sessions.end())
+        return inner->receive(fd, buffer, len);
+    WebSocketSession &session = it->second;
+    ssize_t out;
+    if (session.closing)
+        return 0;
+    if (!session.open)
+        out = upgrade(fd, session, buffer, len);
+    else {
+        char wire[WS_FRAME_MAX];
+        ssize_t n = inner->receive(fd, wire, std::min(len - 2, sizeof(wire)));
+        if (n <= 0)
+            return n;
+        out = decode(session, wire, n, buffer);
+    }
+    if (out >= 0)
+        flushControl(fd, session);
+    if (out == 0)
+        return session.closing ? 0 : -EAGAIN;
+    return out;
+}
+
+/*
+** Each queued line becomes a frame without its CRLF: a header iovec in
+** front of the line where it already is. A line is only reported sent once
+** its whole frame went out; the part of a frame the socket took is kept in
+** partial and skipped on the next call, which starts with the same line.
+*/
+ssize_t WebSocketTransport::send(int fd, const struct iovec *iov, size_t count) {
+    std::map<int, WebSocketSession>::iterator it = sessions.find(fd);
+    if (it == sessions.end())
+        return inner->send(fd, iov, count);
+    WebSocketSession &session = it->second;
+    if (!session.open)
+        return -EAGAIN;
+    ssize_t status = flushControl(fd, session);
+    if (status < 0)
+        return status;
+    if (session.closing)
+        return -EPIPE;
+
+    struct iovec out[WS_IOV];
+    unsigned char headers[WS_IOV / 2][10];
+    size_t source[WS_IOV / 2];
+    size_t wire[WS_IOV / 2];
+    size_t frames = 0;
+    size_t k = 0;
+    unsigned char opcode = session.binary ? WS_BINARY : WS_TEXT;
+    for (size_t i = 0; i < count && k + 2 <= WS_IOV; ++i) {
+        const char *p = static_cast<const char *>(iov[i].iov_base);
+        const char *end = p + iov[i].iov_len;
+        while (p < end && k + 2 <= WS_IOV) {
+            const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+            const char *next = newline ? newline + 1 : end;
+            const char *stop = newline ? newline : end;
+            if (stop > p && stop[-1] == '\r')
+                stop--;
+            size_t header = frameHeader(headers[frames], opcode, stop - p);
+            out[k].iov_base = headers[frames];
+            out[k++].iov_len = header;
+            if (stop > p) {
+                out[k].iov_base = const_cast<char *>(p);
+                out[k++].iov_len = stop - p;
+            }
+            source[frames] = next - p;
+            wire[frames++] = header + (stop - p);
+            p = next;
+        }
+    }
+    size_t first = 0;
+    for (size_t skip = session.partial; skip > 0; ) {
+        if (skip >= out[first].iov_len)
+            skip -= out[first++].iov_len;
+        else {
+            out[first].iov_base = static_cast<char *>(out[first].iov_base) + skip;
+            out[first].iov_len -= skip;
+            skip = 0;
+        }
+    }
+    ssize_t n = inner->send(fd, out + first, k - first);
+    if (n < 0)
+        return n;
+    size_t sent = n + session.partial;
+    size_t consumed = 0;
+    for (size_t f = 0; f < frames && sent >= wire[f]; ++f) {
+        sent -= wire[f];
+        consumed += source[f];
+    }
+    session.partial = sent;
+    return consumed;
+}
+
+/*
+** A close frame is attempted unless one was already exchanged or a data
+** frame is half written.
+*/
+void WebSocketTransport::release(int fd) {
+    std::map<int, WebSocketSession>::iterator it = sessions.find(fd);
+    if (it != sessions.end()) {
+        WebSocketSession &session = it->second;
+        if (session.open && !session.closing && !session.partial) {
+            unsigned char header[2];
+            session.control.append(reinterpret_cast<char *>(header), frameHeader(header, WS_CLOSE, 2));
+            session.control += "\x03\xe8";
+            flushControl(fd, session);
+        }
+        sessions.erase(it);
+    }
+    inner->release(fd);
+}
+
+bool WebSocketTransport::peerName(int fd, struct sockaddr *addr, socklen_t *len) {
+    return inner->peerName(fd, addr, len);
+}
+
+int WebSocketTransport::openListener() {
+    return inner->openListener();
+}
+
+EventLoop *WebSocketTransport::createLoop() {
+    return inner->createLoop();
+}
+
+bool WebSocketTransport::readsDirect(int fd) {
+    return sessions.find(fd) == sessions.end() && inner->readsDirect(fd);
+}
+
+size_t WebSocketTransport::pending(int fd) {
+    return inner->pending(fd);
+}
+
+void WebSocketTransport::sendBatch(EventLoop &loop, std::vector<SendRequest> &batch) {
+    std::vector<size_t> framed;
+
+    for (size_t i = 0; i < batch.size(); ++i)
+        if (sessions.find(batch[i].fd) != sessions.end())
+            framed.push_back(i);
+    splitBatch(*inner, loop, batch, framed);
+}
+
+size_t WebSocketTransport::getSessionCount() const { return sessions.size(); }
+
+size_t WebSocketTransport::getUpgrades() const { return upgrades; }
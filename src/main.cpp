@@ -27,17 +27,112 @@ void signalHandler(int signum) {
 }
 
 
+static void usage() {
+    std::cerr << "Usage: ./ircserv <port> <password> [-name <server>] [-link <port>,<secret>]\n"
+        << "                 [-connect <host:port>,<secret>]...\n"
+        << "                 [-targmax <n>] [-class <name>,<sendq>,<recvq>[,<address prefix>]]...\n"
+        << "                 [-io poll|epoll|uring] [-backlog <n>] [-defer <seconds>] [-ipmax <n>]\n"
+        << "                 [-listen [tls:|ws:|wss:]<port|host:port|[ipv6]:port|unix:path>[,<class>]]...\n"
+        << "                 [-overload <lag-ms>,<sendq-bytes>,<backlog-clients>] [-oper <name>,<password>]...\n"
+        << "                 [-capture <file>] [-tls <certificate>,<key>] [-bridge <name>,<password>[,<class>]]...\n"
+        << "                 [-busypoll <microseconds>[,<cpu>]]" << std::endl;
+}
+
+/*
+** "-class local,1048576,16384,127." gives clients connecting from 127.* a
+** 1 MiB send queue and a 16 KiB receive queue.
+*/
+static bool addClass(Server *server, const std::string &value) {
+    std::vector<std::string> fields;
+    std::string::size_type start = 0;
+    std::string::size_type comma;
+
+    while ((comma = value.find(',', start)) != std::string::npos) {
+        fields.push_back(value.substr(start, comma - start));
+        start = comma + 1;
+    }
+    fields.push_back(value.substr(start));
+    if (fields.size() < 3 || fields.size() > 4 || fields[0].empty()
+        || atol(fields[1].c_str()) <= 0 || atol(fields[2].c_str()) <= 0)
+        return false;
+    server->addConnClass(fields[0], atol(fields[1].c_str()), atol(fields[2].c_str()),
+        fields.size() == 4 ? fields[3] : "");
+    return true;
+}
+
+/*
+** "-link 7000,secret" and "-connect host:7000,secret". A link's secret is
+** its own, never the client password.
+*/
+static bool addLink(Server *server, const std::string &option, const std::string &value) {
+    std::string::size_type comma = value.find(',');
+    if (comma == std::string::npos || comma == 0)
+        return false;
+    std::string address = value.substr(0, comma);
+    std::string secret = value.substr(comma + 1);
+    if (secret.empty() || secret[0] == ':' || secret.find(' ') != std::string::npos)
+        return false;
+    if (option == "-link") {
+        server->setLinkPort(address, secret);
+        return true;
+    }
+    std::string::size_type colon = address.rfind(':');
+    if (colon == std::string::npos)
+        return false;
+    server->addLinkTarget(address.substr(0, colon), address.substr(colon + 1), secret);
+    return true;
+}
+
 int main(int argc, char *argv[])
 {
-    if (argc != 3)
+    if (argc < 3 || (argc - 3) % 2 != 0)
     {
-        std::cerr << "Usage: ./ircserv <port> <password>" << std::endl;
+        usage();
         return (1);
     }
     std::string port = argv[1];
     std::string password = argv[2];
     Server *server = new Server(port, password);
     globalServer = server;
+    for (int i = 3; i < argc; i += 2) {
+        std::string option = argv[i];
+        std::string value = argv[i + 1];
+        if (option == "-name")
+            server->setServerName(value);
+        else if ((option == "-link" || option == "-connect") && addLink(server, option, value))
+            ;
+        else if (option == "-targmax" && atoi(value.c_str()) > 0)
+            server->setMaxTargets(atoi(value.c_str()));
+        else if (option == "-class" && addClass(server, value))
+            ;
+        else if (option == "-io" && server->setIoBackend(value))
+            ;
+        else if (option == "-backlog" && atoi(value.c_str()) > 0)
+            server->setBacklog(atoi(value.c_str()));
+        else if (option == "-defer" && atoi(value.c_str()) >= 0)
+            server->setDeferAccept(atoi(value.c_str()));
+        else if (option == "-ipmax" && atoi(value.c_str()) >= 0)
+            server->setMaxPerIp(atoi(value.c_str()));
+        else if (option == "-listen" && server->addListener(value))
+            ;
+        else if (option == "-overload" && server->setOverloadLimits(value))
+            ;
+        else if (option == "-oper" && server->addOperator(value))
+            ;
+        else if (option == "-capture" && server->setCapture(value))
+            ;
+        else if (option == "-tls" && server->setTls(value))
+            ;
+        else if (option == "-bridge" && server->addBridge(value))
+            ;
+        else if (option == "-busypoll" && server->setBusyPoll(value))
+            ;
+        else {
+            usage();
+            delete server;
+            return (1);
+        }
+    }
     signal(SIGINT, signalHandler);
     server->run();
     delete server; 